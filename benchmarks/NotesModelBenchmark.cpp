@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * A headless benchmark for bulk edits of a pattern's notes
+ *
+ * This does the same sort of work MidiRecorder::applyToPattern does when applying a recording to a
+ * pattern (adding subnotes to every step of a 64 row by 16 column pattern, and setting the velocity,
+ * duration and delay of each of them), and times that, both directly on the pattern and through a
+ * PatternTransaction. To show what the storage itself costs, it also
+ * times setting the note and metadata of every position of a 64x16 NotesModel, next to the same
+ * edits done on a copy of the model's previous storage (a list of rows, where changing an entry meant
+ * copying out the row, changing that, and assigning it back).
+ *
+ * Run with --help to see the options.
+ */
+
+#include "Note.h"
+#include "NotesModel.h"
+#include "PatternModel.h"
+#include "PlayGridManager.h"
+#include "PlaybackProfiler.h"
+#include "SequenceModel.h"
+
+#include <libzl.h>
+#include <SyncTimer.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+#define BENCHMARK_ROWS 64
+#define BENCHMARK_COLUMNS 16
+
+/**
+ * \brief The way NotesModel used to store its entries, kept here as the point of comparison
+ */
+class RowListNotesStore {
+public:
+    struct Entry {
+        Note* note{nullptr};
+        QVariant metaData;
+        QVariantHash keyedData;
+    };
+    void ensurePositionExists(int row, int column) {
+        for (int i = entries.count(); i < row + 1; ++i) {
+            entries << QList<Entry>();
+        }
+        QList<Entry> rowList = entries[row];
+        if (rowList.count() < column + 1) {
+            for (int i = rowList.count(); i < column + 1; ++i) {
+                rowList << Entry();
+            }
+            entries[row] = rowList;
+        }
+    }
+    void setNote(int row, int column, Note *note) {
+        ensurePositionExists(row, column);
+        QList<Entry> rowList = entries[row];
+        rowList[column].note = note;
+        entries[row] = rowList;
+    }
+    void setMetadata(int row, int column, const QVariant &metadata) {
+        ensurePositionExists(row, column);
+        QList<Entry> rowList = entries[row];
+        rowList[column].metaData = metadata;
+        entries[row] = rowList;
+    }
+    QVariant getMetadata(int row, int column) const {
+        QVariant data;
+        if (row < entries.count() && column < entries.at(row).count()) {
+            data = entries.at(row).at(column).metaData;
+        }
+        return data;
+    }
+    void clear() {
+        entries.clear();
+    }
+private:
+    QList< QList<Entry> > entries;
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("notesmodel-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the cost of bulk edits on a 64x16 pattern, such as applying a recording to it");
+    parser.addHelpOption();
+    QCommandLineOption iterationsOption("iterations", "The number of times to repeat each bulk edit", "count", "50");
+    QCommandLineOption subnotesOption("subnotes", "The number of subnotes added to each step", "count", "4");
+    QCommandLineOption seedOption("seed", "The seed for the random note generation", "seed", "1");
+    parser.addOptions({iterationsOption, subnotesOption, seedOption});
+    parser.process(app);
+
+    const int iterations{qMax(1, parser.value(iterationsOption).toInt())};
+    const int subnoteCount{qMax(1, parser.value(subnotesOption).toInt())};
+    QRandomGenerator generator{parser.value(seedOption).toUInt()};
+
+    SyncTimer *syncTimer = qobject_cast<SyncTimer*>(SyncTimer_instance());
+    syncTimer->setMultiplier(32);
+    PlayGridManager *playGridManager = PlayGridManager::instance();
+    QTextStream out(stdout);
+
+    // Pick the notes up front, so the bulk edits all do the same work
+    QList<Note*> notes;
+    for (int i = 0; i < BENCHMARK_ROWS * BENCHMARK_COLUMNS * subnoteCount; ++i) {
+        notes << qobject_cast<Note*>(playGridManager->getNote(36 + generator.bounded(48), 0));
+    }
+    QList<QVariantHash> metadata;
+    for (int i = 0; i < BENCHMARK_ROWS * BENCHMARK_COLUMNS; ++i) {
+        metadata << QVariantHash{{"velocity", 32 + generator.bounded(96)}, {"duration", generator.bounded(16)}, {"delay", generator.bounded(8)}};
+    }
+
+    // The applyToPattern style edit, on a real pattern
+    SequenceModel *sequence = qobject_cast<SequenceModel*>(playGridManager->getSequenceModel("T1"));
+    PatternModel *pattern = qobject_cast<PatternModel*>(sequence->get(0));
+    pattern->setMidiChannel(0);
+    pattern->setWidth(BENCHMARK_COLUMNS);
+    pattern->setHeight(BENCHMARK_ROWS);
+    PlaybackHistogram patternTimings;
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        pattern->clear();
+        const quint64 start{PlaybackProfiler::timestamp()};
+        int noteIndex{0};
+        for (int row = 0; row < BENCHMARK_ROWS; ++row) {
+            for (int column = 0; column < BENCHMARK_COLUMNS; ++column) {
+                const QVariantHash &stepMetadata = metadata.at((row * BENCHMARK_COLUMNS) + column);
+                for (int subnote = 0; subnote < subnoteCount; ++subnote) {
+                    const int subnoteIndex = pattern->addSubnote(row, column, notes.at(noteIndex++));
+                    pattern->setSubnoteMetadata(row, column, subnoteIndex, "velocity", stepMetadata.value("velocity"));
+                    pattern->setSubnoteMetadata(row, column, subnoteIndex, "duration", stepMetadata.value("duration"));
+                    pattern->setSubnoteMetadata(row, column, subnoteIndex, "delay", stepMetadata.value("delay"));
+                }
+            }
+        }
+        patternTimings.record(PlaybackProfiler::timestamp() - start);
+        QCoreApplication::processEvents();
+    }
+
+    // The same edit, gathered up in a transaction, which is how applyToPattern does it
+    PlaybackHistogram transactionTimings;
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        pattern->clear();
+        const quint64 start{PlaybackProfiler::timestamp()};
+        PatternTransaction transaction(pattern);
+        int noteIndex{0};
+        for (int row = 0; row < BENCHMARK_ROWS; ++row) {
+            for (int column = 0; column < BENCHMARK_COLUMNS; ++column) {
+                const QVariantHash &stepMetadata = metadata.at((row * BENCHMARK_COLUMNS) + column);
+                for (int subnote = 0; subnote < subnoteCount; ++subnote) {
+                    const int subnoteIndex = transaction.addSubnote(row, column, notes.at(noteIndex++));
+                    transaction.setSubnoteMetadata(row, column, subnoteIndex, "velocity", stepMetadata.value("velocity"));
+                    transaction.setSubnoteMetadata(row, column, subnoteIndex, "duration", stepMetadata.value("duration"));
+                    transaction.setSubnoteMetadata(row, column, subnoteIndex, "delay", stepMetadata.value("delay"));
+                }
+            }
+        }
+        transaction.commit();
+        transactionTimings.record(PlaybackProfiler::timestamp() - start);
+        QCoreApplication::processEvents();
+    }
+
+    // Setting every position's note and metadata, on the model's storage and on the old storage
+    NotesModel model(playGridManager);
+    RowListNotesStore rowListStore;
+    PlaybackHistogram modelTimings;
+    PlaybackHistogram rowListTimings;
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        model.clear();
+        rowListStore.clear();
+        quint64 start{PlaybackProfiler::timestamp()};
+        for (int row = 0; row < BENCHMARK_ROWS; ++row) {
+            for (int column = 0; column < BENCHMARK_COLUMNS; ++column) {
+                const int position{(row * BENCHMARK_COLUMNS) + column};
+                model.setNote(row, column, notes.at(position));
+                model.setMetadata(row, column, metadata.at(position));
+            }
+        }
+        modelTimings.record(PlaybackProfiler::timestamp() - start);
+        start = PlaybackProfiler::timestamp();
+        for (int row = 0; row < BENCHMARK_ROWS; ++row) {
+            for (int column = 0; column < BENCHMARK_COLUMNS; ++column) {
+                const int position{(row * BENCHMARK_COLUMNS) + column};
+                rowListStore.setNote(row, column, notes.at(position));
+                rowListStore.setMetadata(row, column, metadata.at(position));
+            }
+        }
+        rowListTimings.record(PlaybackProfiler::timestamp() - start);
+        QCoreApplication::processEvents();
+    }
+
+    const auto printSummary = [&out](const QString &name, const PlaybackHistogram &timings) {
+        const QVariantMap summary{timings.summary()};
+        out << name << ": " << (summary.value("mean").toDouble() / 1000.0) << " µs mean, "
+            << (summary.value("p50").toULongLong() / 1000.0) << " µs p50, "
+            << (summary.value("max").toULongLong() / 1000.0) << " µs max" << endl;
+    };
+    out << "Bulk edits of a " << BENCHMARK_ROWS << "x" << BENCHMARK_COLUMNS << " pattern, repeated " << iterations << " times" << endl;
+    printSummary(QString("Applying %1 subnotes per step to a pattern").arg(subnoteCount), patternTimings);
+    printSummary(QString("Applying %1 subnotes per step to a pattern in a transaction").arg(subnoteCount), transactionTimings);
+    printSummary("Setting every note and metadata entry on a NotesModel", modelTimings);
+    printSummary("Setting every note and metadata entry on the previous row list storage", rowListTimings);
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * A headless benchmark for the sequencer's playback path
+ *
+ * This builds the plugin's sequencer sources against the stand-ins for libzl and JUCE in the stubs
+ * directory, fills all ten global sequences with a synthetic sketch of the requested density, and
+ * then drives PlayGridManager::handleMetronomeTick() (and through that, SequenceModel::advanceSequence
+ * and every playing pattern) for the requested number of ticks, the way SyncTimer would during playback.
+ *
+ * Run with --help to see the options.
+ */
+
+#include "Note.h"
+#include "PatternModel.h"
+#include "PlayGridManager.h"
+#include "PlaybackProfiler.h"
+#include "SequenceModel.h"
+
+#include <libzl.h>
+#include <SyncTimer.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+#include <atomic>
+#include <cstdlib>
+
+// Count every allocation made by anything in the process (including Qt's containers, which use malloc
+// directly rather than operator new) while the benchmark is measuring
+static std::atomic<bool> countAllocations{false};
+static std::atomic<quint64> allocationCount{0};
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    if (countAllocations.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (countAllocations.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    if (countAllocations.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return __libc_realloc(pointer, size);
+}
+}
+#define ALLOCATION_COUNTING_AVAILABLE 1
+#else
+#define ALLOCATION_COUNTING_AVAILABLE 0
+#endif
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("sequencer-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the cost of the sequencer's per-tick playback work on a synthetic sketch");
+    parser.addHelpOption();
+    QCommandLineOption ticksOption("ticks", "The number of ticks to measure", "ticks", "10000");
+    QCommandLineOption warmupOption("warmup", "The number of ticks to run before measuring", "ticks", "1000");
+    QCommandLineOption sequencesOption("sequences", "The number of global sequences to fill (1 through 10)", "count", "10");
+    QCommandLineOption barsOption("bars", "The number of bars in each pattern (1 through 8)", "bars", "8");
+    QCommandLineOption subnotesOption("subnotes", "The number of subnotes on each step which has notes", "count", "4");
+    QCommandLineOption densityOption("density", "The fraction of steps which have notes (0 through 1)", "fraction", "1");
+    QCommandLineOption noteLengthOption("note-length", "The note length of each pattern (1 through 6)", "length", "3");
+    QCommandLineOption delaysOption("delays", "Give the subnotes random delays of up to half a step in either direction");
+    QCommandLineOption multiplierOption("multiplier", "The number of timer ticks per quarter note", "ticks", "32");
+    QCommandLineOption seedOption("seed", "The seed for the random sketch generation", "seed", "1");
+    QCommandLineOption profileOption("profile", "Enable the playback profiler, and print its per-stage timings");
+    parser.addOptions({ticksOption, warmupOption, sequencesOption, barsOption, subnotesOption, densityOption, noteLengthOption, delaysOption, multiplierOption, seedOption, profileOption});
+    parser.process(app);
+
+    const quint64 ticks{parser.value(ticksOption).toULongLong()};
+    const quint64 warmupTicks{parser.value(warmupOption).toULongLong()};
+    const int sequenceCount{qBound(1, parser.value(sequencesOption).toInt(), 10)};
+    const int bars{qBound(1, parser.value(barsOption).toInt(), 8)};
+    const int subnoteCount{qMax(0, parser.value(subnotesOption).toInt())};
+    const double density{qBound(0.0, parser.value(densityOption).toDouble(), 1.0)};
+    const int noteLength{qBound(1, parser.value(noteLengthOption).toInt(), 6)};
+    const bool useDelays{parser.isSet(delaysOption)};
+    QRandomGenerator generator{parser.value(seedOption).toUInt()};
+
+    // This has to happen before anything asks for the timing table (which PlayGridManager does on construction)
+    SyncTimer *syncTimer = qobject_cast<SyncTimer*>(SyncTimer_instance());
+    syncTimer->setMultiplier(qMax(32, parser.value(multiplierOption).toInt()));
+    PlayGridManager *playGridManager = PlayGridManager::instance();
+
+    QTextStream out(stdout);
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+    // The step duration in the patterns' internal 32ppqn, used for the random delays
+    const int noteDuration{32 >> (noteLength - 1)};
+    quint64 subnotesCreated{0};
+    QList<SequenceModel*> sequences;
+    for (int sequenceIndex = 0; sequenceIndex < sequenceCount; ++sequenceIndex) {
+        SequenceModel *sequence = qobject_cast<SequenceModel*>(playGridManager->getSequenceModel(QString("T%1").arg(sequenceIndex + 1)));
+        sequences << sequence;
+        for (int patternIndex = 0; patternIndex < sequence->rowCount(); ++patternIndex) {
+            PatternModel *pattern = qobject_cast<PatternModel*>(sequence->get(patternIndex));
+            if (!pattern) {
+                continue;
+            }
+            pattern->startLongOperation();
+            pattern->setNoteLength(noteLength);
+            pattern->setAvailableBars(bars);
+            pattern->setMidiChannel(pattern->channelIndex());
+            pattern->setEnabled(true);
+            for (int row = 0; row < bars; ++row) {
+                for (int column = 0; column < pattern->width(); ++column) {
+                    if (generator.generateDouble() >= density) {
+                        continue;
+                    }
+                    for (int subnoteIndex = 0; subnoteIndex < subnoteCount; ++subnoteIndex) {
+                        QObject *note = playGridManager->getNote(36 + generator.bounded(48), pattern->midiChannel());
+                        const int subnote = pattern->addSubnote(row, column, note);
+                        pattern->setSubnoteMetadata(row, column, subnote, "velocity", 32 + generator.bounded(96));
+                        if (useDelays) {
+                            pattern->setSubnoteMetadata(row, column, subnote, "delay", generator.bounded(noteDuration + 1) - (noteDuration / 2));
+                        }
+                        ++subnotesCreated;
+                    }
+                }
+            }
+            pattern->endLongOperation();
+        }
+    }
+    out << "Generated " << sequenceCount << " sequences of " << sequences.first()->rowCount() << " patterns, with " << bars << " bars of 16 steps, "
+        << subnoteCount << " subnotes per step at a density of " << density << " (" << subnotesCreated << " subnotes) in " << elapsedTimer.elapsed() << " ms" << endl;
+
+    elapsedTimer.restart();
+    bool prepared{false};
+    playGridManager->preparePatternsForPlayback(sequences, [&prepared](){ prepared = true; });
+    while (!prepared) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    out << "Prepared the patterns for playback in " << elapsedTimer.elapsed() << " ms" << endl;
+
+    syncTimer->start();
+    for (SequenceModel *sequence : qAsConst(sequences)) {
+        sequence->prepareSequencePlayback();
+    }
+    // Let anything queued up during setup (such as snapshot publishing) happen before we start
+    QCoreApplication::processEvents();
+
+    quint64 tick{0};
+    for (; tick < warmupTicks; ++tick) {
+        syncTimer->setCumulativeBeat(tick);
+        playGridManager->handleMetronomeTick(int(tick));
+    }
+
+    playGridManager->setPlaybackProfilingEnabled(parser.isSet(profileOption));
+    playGridManager->resetPlaybackProfile();
+    syncTimer->resetCounters();
+    PlaybackHistogram tickTimings;
+    allocationCount.store(0);
+    countAllocations.store(true);
+    const quint64 measuredStart{PlaybackProfiler::timestamp()};
+    for (const quint64 lastTick = tick + ticks; tick < lastTick; ++tick) {
+        syncTimer->setCumulativeBeat(tick);
+        const quint64 tickStart{PlaybackProfiler::timestamp()};
+        playGridManager->handleMetronomeTick(int(tick));
+        tickTimings.record(PlaybackProfiler::timestamp() - tickStart);
+    }
+    const quint64 measuredDuration{PlaybackProfiler::timestamp() - measuredStart};
+    countAllocations.store(false);
+    const quint64 allocations{allocationCount.load()};
+
+    const QVariantMap tickSummary{tickTimings.summary()};
+    const double tickCount{double(qMax(quint64(1), ticks))};
+    out << "Ticks measured: " << ticks << " (after " << warmupTicks << " warmup ticks)" << endl;
+    out << "Time per tick: " << (measuredDuration / tickCount) << " ns mean, "
+        << tickSummary.value("p50").toULongLong() << " ns p50, "
+        << tickSummary.value("p99").toULongLong() << " ns p99, "
+        << tickSummary.value("max").toULongLong() << " ns max" << endl;
+    if (ALLOCATION_COUNTING_AVAILABLE) {
+        out << "Allocations per tick: " << (allocations / tickCount) << " (" << allocations << " in total)" << endl;
+    } else {
+        out << "Allocations per tick: not available (allocation counting needs glibc)" << endl;
+    }
+    out << "Events scheduled: " << syncTimer->scheduledEvents() << " (" << (syncTimer->scheduledEvents() / tickCount) << " per tick), using "
+        << syncTimer->schedulingCalls() << " scheduling calls (" << (syncTimer->schedulingCalls() / tickCount) << " per tick)" << endl;
+    if (parser.isSet(profileOption)) {
+        out << "Playback profile (all durations in nanoseconds):" << endl;
+        out << QJsonDocument::fromVariant(playGridManager->playbackProfile().value("stages")).toJson();
+    }
+
+    syncTimer->stop();
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// A stand-in for libzl's ClipAudioSource, for the benchmark build only
+
+#ifndef CLIPAUDIOSOURCE_H
+#define CLIPAUDIOSOURCE_H
+
+#include <QObject>
+
+class ClipAudioSource : public QObject {
+    Q_OBJECT
+public:
+    explicit ClipAudioSource(int id, QObject *parent = nullptr)
+        : QObject(parent)
+        , m_id(id)
+    {}
+    int id() const { return m_id; }
+    int keyZoneStart() const { return 0; }
+    int keyZoneEnd() const { return 127; }
+    int rootNote() const { return 60; }
+    int slices() const { return 16; }
+    int sliceBaseMidiNote() const { return 60; }
+    int sliceForMidiNote(int midiNote) const { return (midiNote - sliceBaseMidiNote()) % slices(); }
+    float volumeAbsolute() const { return 1.0f; }
+    Q_SIGNAL void keyZoneStartChanged();
+    Q_SIGNAL void keyZoneEndChanged();
+private:
+    int m_id{0};
+};
+
+#endif//CLIPAUDIOSOURCE_H
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// A stand-in for libzl's ClipCommand, for the benchmark build only
+
+#ifndef CLIPCOMMAND_H
+#define CLIPCOMMAND_H
+
+class ClipAudioSource;
+struct ClipCommand {
+    static ClipCommand *channelCommand(ClipAudioSource *clip, int midiChannel) {
+        ClipCommand *command = new ClipCommand;
+        command->clip = clip;
+        command->midiChannel = midiChannel;
+        return command;
+    }
+    static ClipCommand *noEffectCommand(ClipAudioSource *clip) {
+        return channelCommand(clip, -2);
+    }
+    static ClipCommand *effectedCommand(ClipAudioSource *clip) {
+        return channelCommand(clip, -1);
+    }
+    ClipAudioSource *clip{nullptr};
+    int midiChannel{-1};
+    int midiNote{-1};
+    bool startPlayback{false};
+    bool stopPlayback{false};
+    bool changeSlice{false};
+    int slice{0};
+    bool changeLooping{false};
+    bool looping{false};
+    bool changeVolume{false};
+    float volume{0.0f};
+};
+
+#endif//CLIPCOMMAND_H
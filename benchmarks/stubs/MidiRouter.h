@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// A stand-in for libzl's MidiRouter, for the benchmark build only
+
+#ifndef MIDIROUTER_H
+#define MIDIROUTER_H
+
+#include <QObject>
+#include <QList>
+
+class MidiRouter : public QObject {
+    Q_OBJECT
+public:
+    static MidiRouter *instance() {
+        static MidiRouter *instance{nullptr};
+        if (!instance) {
+            instance = new MidiRouter;
+        }
+        return instance;
+    }
+    enum ListenerPort {
+        UnknownPort = -1,
+        PassthroughPort = 0,
+        InternalPassthroughPort = 1,
+        HardwareInPassthroughPort = 2,
+        ExternalOutPort = 3,
+    };
+    enum RoutingDestination {
+        ZynthianDestination = 0,
+        SamplerDestination = 1,
+        ExternalDestination = 2,
+    };
+    void setChannelDestination(int channel, RoutingDestination destination, int externalChannel = -1) {
+        Q_UNUSED(channel) Q_UNUSED(destination) Q_UNUSED(externalChannel)
+    }
+    void setCurrentChannel(int currentChannel) {
+        Q_UNUSED(currentChannel)
+    }
+    void setZynthianChannels(int channel, QList<int> zynthianChannels) {
+        Q_UNUSED(channel) Q_UNUSED(zynthianChannels)
+    }
+    Q_SIGNAL void noteChanged(const MidiRouter::ListenerPort &port, const int &midiNote, const int &midiChannel, const int &velocity, const bool &setOn, const double &timeStamp, const unsigned char &byte1, const unsigned char &byte2, const unsigned char &byte3);
+};
+
+#endif//MIDIROUTER_H
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "libzl.h"
+#include "ClipAudioSource.h"
+#include "ClipCommand.h"
+#include "MidiRouter.h"
+#include "SyncTimer.h"
+#include "TimerCommand.h"
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+QObject *SyncTimer_instance()
+{
+    static SyncTimer *instance{nullptr};
+    if (!instance) {
+        instance = new SyncTimer;
+    }
+    return instance;
+}
+
+ClipAudioSource *ClipAudioSource_byID(int id)
+{
+    // The synthetic sketches do not use any samples
+    Q_UNUSED(id)
+    return nullptr;
+}
+
+SyncTimer::SyncTimer(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void SyncTimer::addCallback(void (*functionPtr)(int))
+{
+    Q_UNUSED(functionPtr)
+}
+
+void SyncTimer::removeCallback(void (*functionPtr)(int))
+{
+    Q_UNUSED(functionPtr)
+}
+
+void SyncTimer::start(int bpm)
+{
+    m_bpm = bpm;
+    if (!m_timerRunning) {
+        m_timerRunning = true;
+        Q_EMIT timerRunningChanged();
+    }
+}
+
+void SyncTimer::stop()
+{
+    if (m_timerRunning) {
+        m_timerRunning = false;
+        Q_EMIT timerRunningChanged();
+    }
+}
+
+bool SyncTimer::timerRunning()
+{
+    return m_timerRunning;
+}
+
+void SyncTimer::setBpm(quint64 bpm)
+{
+    m_bpm = bpm;
+}
+
+quint64 SyncTimer::getBpm() const
+{
+    return m_bpm;
+}
+
+int SyncTimer::getMultiplier() const
+{
+    return m_multiplier;
+}
+
+void SyncTimer::setMultiplier(int multiplier)
+{
+    m_multiplier = multiplier;
+}
+
+quint64 SyncTimer::cumulativeBeat() const
+{
+    return m_cumulativeBeat;
+}
+
+void SyncTimer::setCumulativeBeat(quint64 cumulativeBeat)
+{
+    m_cumulativeBeat = cumulativeBeat;
+}
+
+quint64 SyncTimer::scheduleAheadAmount() const
+{
+    return 0;
+}
+
+void SyncTimer::scheduleNote(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 delay)
+{
+    Q_UNUSED(midiNote) Q_UNUSED(midiChannel) Q_UNUSED(setOn) Q_UNUSED(velocity) Q_UNUSED(delay)
+    // A note with a duration is both an on and an off event
+    m_scheduledEvents += (duration > 0) ? 2 : 1;
+    ++m_schedulingCalls;
+}
+
+void SyncTimer::scheduleMidiBuffer(const juce::MidiBuffer &buffer, quint64 delay)
+{
+    Q_UNUSED(delay)
+    m_scheduledEvents += buffer.getNumEvents();
+    ++m_schedulingCalls;
+}
+
+void SyncTimer::sendNoteImmediately(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity)
+{
+    Q_UNUSED(midiNote) Q_UNUSED(midiChannel) Q_UNUSED(setOn) Q_UNUSED(velocity)
+}
+
+void SyncTimer::sendMidiBufferImmediately(const juce::MidiBuffer &buffer)
+{
+    Q_UNUSED(buffer)
+}
+
+ClipCommand *SyncTimer::getClipCommand()
+{
+    return new ClipCommand;
+}
+
+void SyncTimer::scheduleClipCommand(ClipCommand *command, quint64 delay)
+{
+    Q_UNUSED(delay)
+    delete command;
+}
+
+TimerCommand *SyncTimer::getTimerCommand()
+{
+    return new TimerCommand;
+}
+
+void SyncTimer::scheduleTimerCommand(quint64 delay, TimerCommand *command)
+{
+    Q_UNUSED(delay)
+    delete command;
+}
+
+quint64 SyncTimer::scheduledEvents() const
+{
+    return m_scheduledEvents;
+}
+
+quint64 SyncTimer::schedulingCalls() const
+{
+    return m_schedulingCalls;
+}
+
+void SyncTimer::resetCounters()
+{
+    m_scheduledEvents = 0;
+    m_schedulingCalls = 0;
+}
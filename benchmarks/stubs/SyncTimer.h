@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// A stand-in for libzl's SyncTimer, for the benchmark build only
+
+#ifndef SYNCTIMER_H
+#define SYNCTIMER_H
+
+#include <QObject>
+
+namespace juce {
+    class MidiBuffer;
+}
+struct ClipCommand;
+struct TimerCommand;
+
+/**
+ * \brief A SyncTimer which never runs on its own, and just counts what gets scheduled with it
+ *
+ * The benchmark drives the ticks itself, by setting the cumulative beat and calling
+ * PlayGridManager::handleMetronomeTick() the way the real timer's callback would.
+ */
+class SyncTimer : public QObject {
+    Q_OBJECT
+public:
+    explicit SyncTimer(QObject *parent = nullptr);
+
+    void addCallback(void (*functionPtr)(int));
+    void removeCallback(void (*functionPtr)(int));
+    void start(int bpm = 120);
+    void stop();
+    bool timerRunning();
+    Q_SIGNAL void timerRunningChanged();
+    void setBpm(quint64 bpm);
+    quint64 getBpm() const;
+    int getMultiplier() const;
+    void setMultiplier(int multiplier);
+    quint64 cumulativeBeat() const;
+    void setCumulativeBeat(quint64 cumulativeBeat);
+    quint64 scheduleAheadAmount() const;
+
+    void scheduleNote(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 delay);
+    void scheduleMidiBuffer(const juce::MidiBuffer &buffer, quint64 delay);
+    void sendNoteImmediately(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity);
+    void sendMidiBufferImmediately(const juce::MidiBuffer &buffer);
+    ClipCommand *getClipCommand();
+    void scheduleClipCommand(ClipCommand *command, quint64 delay);
+    TimerCommand *getTimerCommand();
+    void scheduleTimerCommand(quint64 delay, TimerCommand *command);
+    Q_SIGNAL void clipCommandSent(ClipCommand *clipCommand);
+    Q_SIGNAL void timerCommand(TimerCommand *command);
+
+    /**
+     * \brief The number of midi events handed to the timer since the counters were last reset
+     */
+    quint64 scheduledEvents() const;
+    /**
+     * \brief The number of calls made to scheduleMidiBuffer and scheduleNote since the counters were last reset
+     */
+    quint64 schedulingCalls() const;
+    void resetCounters();
+private:
+    bool m_timerRunning{false};
+    quint64 m_bpm{120};
+    int m_multiplier{32};
+    quint64 m_cumulativeBeat{0};
+    quint64 m_scheduledEvents{0};
+    quint64 m_schedulingCalls{0};
+};
+
+#endif//SYNCTIMER_H
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// A stand-in for libzl's TimerCommand, for the benchmark build only
+
+#ifndef TIMERCOMMAND_H
+#define TIMERCOMMAND_H
+
+#include <QtGlobal>
+
+struct TimerCommand {
+    enum Operation {
+        InvalidOperation = 0,
+        StartPartOperation,
+        StopPartOperation,
+        StartClipLoopOperation,
+        StopClipLoopOperation,
+        ClipCommandOperation,
+        SamplerChannelEnabledStateOperation,
+        StopPlaybackOperation,
+    };
+    static TimerCommand *cloneTimerCommand(const TimerCommand *other) {
+        TimerCommand *clone = new TimerCommand;
+        *clone = *other;
+        return clone;
+    }
+    Operation operation{InvalidOperation};
+    int parameter{0};
+    int parameter2{0};
+    int parameter3{0};
+    quint64 bigParameter{0};
+    void *dataParameter{nullptr};
+};
+
+#endif//TIMERCOMMAND_H
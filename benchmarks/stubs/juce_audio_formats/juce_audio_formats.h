@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// A stand-in for the parts of JUCE's midi classes used by the plugin, for the benchmark build only
+
+#ifndef JUCE_AUDIO_FORMATS_STUB_H
+#define JUCE_AUDIO_FORMATS_STUB_H
+
+#include <cstddef>
+#include <vector>
+
+namespace juce {
+
+class MidiMessage {
+public:
+    MidiMessage(unsigned char byte1, unsigned char byte2, unsigned char byte3)
+        : bytes{byte1, byte2, byte3}
+    {}
+    static MidiMessage allNotesOff(int channel) {
+        return MidiMessage(0xB0 + ((channel - 1) & 0x0F), 123, 0);
+    }
+    static MidiMessage pitchWheel(int channel, int position) {
+        return MidiMessage(0xE0 + ((channel - 1) & 0x0F), position & 0x7F, (position >> 7) & 0x7F);
+    }
+    static MidiMessage controllerEvent(int channel, int controllerType, int value) {
+        return MidiMessage(0xB0 + ((channel - 1) & 0x0F), controllerType & 0x7F, value & 0x7F);
+    }
+    const unsigned char *getRawData() const {
+        return bytes;
+    }
+private:
+    unsigned char bytes[3];
+};
+
+/**
+ * Like JUCE's own MidiBuffer, this keeps its storage around when cleared, and only allocates when
+ * it has to grow (or when asked to using ensureSize), so allocation counts stay representative.
+ */
+class MidiBuffer {
+public:
+    MidiBuffer() {}
+    explicit MidiBuffer(const MidiMessage &message) {
+        addEvent(message, 0);
+    }
+    void addEvent(const MidiMessage &message, int samplePosition) {
+        addEvent(message.getRawData(), 3, samplePosition);
+    }
+    bool addEvent(const void *rawMidiData, int maxBytesOfMidiData, int samplePosition) {
+        const unsigned char *bytes = static_cast<const unsigned char*>(rawMidiData);
+        data.push_back(static_cast<unsigned char>(samplePosition));
+        data.insert(data.end(), bytes, bytes + maxBytesOfMidiData);
+        ++numEvents;
+        return true;
+    }
+    void clear() {
+        data.clear();
+        numEvents = 0;
+    }
+    void ensureSize(size_t minimumNumBytes) {
+        data.reserve(minimumNumBytes);
+    }
+    int getNumEvents() const {
+        return numEvents;
+    }
+private:
+    std::vector<unsigned char> data;
+    int numEvents{0};
+};
+
+}
+
+#endif//JUCE_AUDIO_FORMATS_STUB_H
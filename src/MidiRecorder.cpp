@@ -24,6 +24,7 @@
 #include "Note.h"
 #include "PlayGridManager.h"
 #include "PatternModel.h"
+#include "PlaybackTiming.h"
 
 #include <libzl.h>
 #include <SyncTimer.h>
@@ -294,29 +295,8 @@ bool MidiRecorder::applyToPattern(PatternModel *patternModel, QFlags<MidiRecorde
 
     // work out how many microseconds we've got per step in the given pattern
     SyncTimer *syncTimer{qobject_cast<SyncTimer*>(patternModel->playGridManager()->syncTimer())};
-    int subbeatsPerStep{0};
-    switch (patternModel->noteLength()) {
-    case 1:
-        subbeatsPerStep = 32;
-        break;
-    case 2:
-        subbeatsPerStep = 16;
-        break;
-    case 3:
-        subbeatsPerStep = 8;
-        break;
-    case 4:
-        subbeatsPerStep = 4;
-        break;
-    case 5:
-        subbeatsPerStep = 2;
-        break;
-    case 6:
-        subbeatsPerStep = 1;
-        break;
-    default:
-        break;
-    }
+    const PlaybackTiming &timing = PlaybackTiming::instance();
+    const int subbeatsPerStep{timing.isValidNoteLength(patternModel->noteLength()) ? timing.noteDuration(patternModel->noteLength()) : 0};
     int microsecondsPerStep = syncTimer->subbeatCountToSeconds(syncTimer->getBpm(), subbeatsPerStep) * 1000000;
     int microsecondsPerSubbeat = syncTimer->subbeatCountToSeconds(syncTimer->getBpm(), 1) * 1000000;
 
@@ -349,6 +329,8 @@ bool MidiRecorder::applyToPattern(PatternModel *patternModel, QFlags<MidiRecorde
         // fetch the messages in order until the step position is "next step" and then forward the step, find the matching off note (if none is found, set duration 0) and insert them on the current step (if the message's channel is in the accepted list, remembering juce's 1-indexing)
         int step{0}, midiChannel{0}, midiNote{0}, timestamp{0}, duration{0}, velocity{0}, delay{0}, row{0}, column{0}, subnoteIndex{0};
         Note* note{nullptr};
+        // Gather up all the changes, so the pattern only gets updated once, at the end
+        PatternTransaction transaction(patternModel);
         for (int messageIndex = 0; messageIndex < d->midiMessageSequence.getNumEvents(); ++messageIndex) {
             juce::MidiMessageSequence::MidiEventHolder *message = d->midiMessageSequence.getEventPointer(messageIndex);
             if (!message) {
@@ -389,16 +371,17 @@ bool MidiRecorder::applyToPattern(PatternModel *patternModel, QFlags<MidiRecorde
             note = qobject_cast<Note*>(patternModel->playGridManager()->getNote(midiNote, midiChannel));
             row = patternModel->bankOffset() + (step / patternModel->width());
             column = step % patternModel->width();
-            subnoteIndex = patternModel->addSubnote(row, column, note);
+            subnoteIndex = transaction.addSubnote(row, column, note);
             qDebug() << Q_FUNC_INFO << "Inserted subnote at" << row << column << "New subnote is" << note;
-            patternModel->setSubnoteMetadata(row, column, subnoteIndex, "velocity", velocity);
+            transaction.setSubnoteMetadata(row, column, subnoteIndex, "velocity", velocity);
             if (duration > 0) {
-                patternModel->setSubnoteMetadata(row, column, subnoteIndex, "duration", duration);
+                transaction.setSubnoteMetadata(row, column, subnoteIndex, "duration", duration);
             }
             if (delay > 0) {
-                patternModel->setSubnoteMetadata(row, column, subnoteIndex, "delay", delay);
+                transaction.setSubnoteMetadata(row, column, subnoteIndex, "delay", delay);
             }
         }
+        transaction.commit();
         success = true;
     } else {
         qWarning() << Q_FUNC_INFO << "Failed to find a last step";
@@ -33,6 +33,8 @@ public:
     int midiChannel{0};
     bool isPlaying{false};
     QVariantList subnotes;
+    // The same as subnotes, but already converted, for the C++ side (see typedSubnotes())
+    QVector<Note*> typedSubnotes;
     int scaleIndex{0};
 
     SyncTimer *syncTimer{nullptr};
@@ -114,19 +116,14 @@ bool Note::isPlaying() const
 
 void Note::setSubnotes(const QVariantList& subnotes)
 {
-    bool different = false;
-    if (subnotes.count() == d->subnotes.count()) {
-        for (int i = 0; i < subnotes.count(); ++i) {
-            if (subnotes[i] != d->subnotes[i]) {
-                different = true;
-                break;
-            }
-        }
-    } else {
-        different = true;
+    QVector<Note*> typedSubnotes;
+    typedSubnotes.reserve(subnotes.count());
+    for (const QVariant &subnote : subnotes) {
+        typedSubnotes << subnote.value<Note*>();
     }
-    if (different) {
+    if (typedSubnotes != d->typedSubnotes) {
         d->subnotes = subnotes;
+        d->typedSubnotes = typedSubnotes;
         Q_EMIT subnotesChanged();
     }
 }
@@ -136,6 +133,16 @@ QVariantList Note::subnotes() const
     return d->subnotes;
 }
 
+const QVector<Note*> &Note::typedSubnotes() const
+{
+    return d->typedSubnotes;
+}
+
+int Note::subnoteCount() const
+{
+    return d->typedSubnotes.count();
+}
+
 void Note::setScaleIndex(int scaleIndex)
 {
     if (d->scaleIndex != scaleIndex) {
@@ -152,11 +159,10 @@ int Note::scaleIndex() const
 void Note::setSubnotesOn(const QVariantList &velocities) const
 {
     int i = -1;
-    for (const QVariant &note : d->subnotes) {
-        if (++i >= d->subnotes.count()) {
+    for (const Note *subnote : qAsConst(d->typedSubnotes)) {
+        if (++i >= velocities.count()) {
             break;
         }
-        const Note* subnote = note.value<Note*>();
         if (subnote) {
             d->playGridManager->sendAMidiNoteMessage(subnote->midiNote(), velocities[i].toUInt(), subnote->midiChannel(), true);
         }
@@ -170,8 +176,7 @@ void Note::setOn(int velocity) const
             d->playGridManager->sendAMidiNoteMessage(d->midiNote, velocity, d->midiChannel, true);
         }
     }
-    for (const QVariant &note : d->subnotes) {
-        const Note* subnote = note.value<Note*>();
+    for (const Note *subnote : qAsConst(d->typedSubnotes)) {
         if (subnote) {
             d->playGridManager->sendAMidiNoteMessage(subnote->midiNote(), velocity, subnote->midiChannel(), true);
         }
@@ -185,8 +190,7 @@ void Note::setOff() const
             d->playGridManager->sendAMidiNoteMessage(d->midiNote, 0, d->midiChannel, false);
         }
     }
-    for (const QVariant &note : d->subnotes) {
-        const Note* subnote = note.value<Note*>();
+    for (const Note *subnote : qAsConst(d->typedSubnotes)) {
         if (subnote) {
             d->playGridManager->sendAMidiNoteMessage(subnote->midiNote(), 0, subnote->midiChannel(), false);
         }
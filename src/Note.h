@@ -23,6 +23,7 @@
 #define NOTE_H
 
 #include <QObject>
+#include <QVector>
 #include "PlayGridManager.h"
 
 class Note : public QObject
@@ -60,6 +61,18 @@ public:
     void setSubnotes(const QVariantList& subnotes);
     QVariantList subnotes() const;
     Q_SIGNAL void subnotesChanged();
+    /**
+     * \brief The subnotes as Note instances, for use from C++
+     * This holds the same subnotes as the subnotes property, in the same order (with null in place of
+     * anything in that list which is not a Note), without having to copy the list or convert anything
+     * out of a QVariant. Use subnotes() for QML.
+     * @note The reference is only valid until the subnotes are changed
+     */
+    const QVector<Note*> &typedSubnotes() const;
+    /**
+     * \brief The number of subnotes (the same as subnotes().count(), without copying the list)
+     */
+    int subnoteCount() const;
 
     void setScaleIndex(int scaleIndex);
     int scaleIndex() const;
@@ -26,13 +26,126 @@
 #include <QDebug>
 #include <QTimer>
 #include <QJSValue>
+#include <QPoint>
+#include <QPointer>
+#include <QRect>
+#include <QSet>
+#include <QVector>
+
+#include <algorithm>
+
+// The number of rows in each of the chunks a model's entries are stored in (this is the default bank length of a pattern)
+#define NOTESMODEL_CHUNK_ROWS 8
 
 struct Entry {
     Note* note{nullptr};
+    // Metadata in the form of a list of subnote hashes (which is what patterns store) is kept in
+    // subnoteMetadata, and anything else is kept in metaData exactly as it was given
     QVariant metaData;
+    SubnoteMetadata subnoteMetadata;
     QVariantHash keyedData;
+
+    inline QVariant metadata() const {
+        return subnoteMetadata.isNull() ? metaData : QVariant(subnoteMetadata.toVariantList());
+    }
+    inline void setMetadata(const QVariant &metadata) {
+        subnoteMetadata = SubnoteMetadata::fromVariant(metadata);
+        metaData = subnoteMetadata.isNull() ? metadata : QVariant();
+    }
+    inline bool operator==(const Entry &other) const {
+        return note == other.note && metaData == other.metaData && subnoteMetadata == other.subnoteMetadata && keyedData == other.keyedData;
+    }
+    inline bool operator!=(const Entry &other) const {
+        return !(*this == other);
+    }
+};
+Q_DECLARE_TYPEINFO(Entry, Q_MOVABLE_TYPE);
+
+class NotesModelContentsData : public QSharedData {
+public:
+    // The same as the fields of the same names in NotesModel::Private
+    QVector<QVector<Entry>> chunks;
+    QVector<int> rowLengths;
+    int columnCapacity{0};
+    QVector<int> rowSubnotePositionCounts;
+    int subnotePositionCount{0};
 };
 
+NotesModelContents::NotesModelContents() = default;
+NotesModelContents::NotesModelContents(const NotesModelContents &other) = default;
+NotesModelContents::~NotesModelContents() = default;
+NotesModelContents &NotesModelContents::operator=(const NotesModelContents &other) = default;
+
+int NotesModelContents::rowCount() const
+{
+    return d ? d->rowLengths.count() : 0;
+}
+
+int NotesModelContents::columnCount(int row) const
+{
+    return (d && row >= 0 && row < d->rowLengths.count()) ? d->rowLengths.at(row) : 0;
+}
+
+// The entry in the given position of the contents, or null if the position is outside them
+static inline const Entry *contentsEntry(const NotesModelContentsData *contents, int row, int column)
+{
+    if (contents && row >= 0 && row < contents->rowLengths.count() && column >= 0 && column < contents->rowLengths.at(row)) {
+        return contents->chunks.at(row / NOTESMODEL_CHUNK_ROWS).constData() + ((row % NOTESMODEL_CHUNK_ROWS) * contents->columnCapacity) + column;
+    }
+    return nullptr;
+}
+
+Note *NotesModelContents::note(int row, int column) const
+{
+    const Entry *entry = contentsEntry(d.constData(), row, column);
+    return entry ? entry->note : nullptr;
+}
+
+QVariant NotesModelContents::metadata(int row, int column) const
+{
+    const Entry *entry = contentsEntry(d.constData(), row, column);
+    return entry ? entry->metadata() : QVariant();
+}
+
+SubnoteMetadata NotesModelContents::typedMetadata(int row, int column) const
+{
+    const Entry *entry = contentsEntry(d.constData(), row, column);
+    return entry ? entry->subnoteMetadata : SubnoteMetadata();
+}
+
+QVariantHash NotesModelContents::keyedData(int row, int column) const
+{
+    const Entry *entry = contentsEntry(d.constData(), row, column);
+    return entry ? entry->keyedData : QVariantHash();
+}
+
+bool NotesModelContents::operator==(const NotesModelContents &other) const
+{
+    static const NotesModelContentsData emptyContents;
+    const NotesModelContentsData &mine = d ? *d : emptyContents;
+    const NotesModelContentsData &theirs = other.d ? *other.d : emptyContents;
+    if (&mine == &theirs) {
+        return true;
+    }
+    if (mine.rowLengths != theirs.rowLengths) {
+        return false;
+    }
+    for (int row = 0; row < mine.rowLengths.count(); ++row) {
+        const QVector<Entry> &myChunk = mine.chunks.at(row / NOTESMODEL_CHUNK_ROWS);
+        const QVector<Entry> &theirChunk = theirs.chunks.at(row / NOTESMODEL_CHUNK_ROWS);
+        // A chunk which is still shared between the two has not been changed by either
+        if (mine.columnCapacity == theirs.columnCapacity && myChunk.constData() == theirChunk.constData()) {
+            continue;
+        }
+        const Entry *myRow = myChunk.constData() + ((row % NOTESMODEL_CHUNK_ROWS) * mine.columnCapacity);
+        const Entry *theirRow = theirChunk.constData() + ((row % NOTESMODEL_CHUNK_ROWS) * theirs.columnCapacity);
+        if (!std::equal(myRow, myRow + mine.rowLengths.at(row), theirRow)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 class NotesModel::Private {
 public:
     Private(NotesModel *q)
@@ -40,21 +153,7 @@ public:
     {
         noteDataChangedUpdater.setInterval(1);
         noteDataChangedUpdater.setSingleShot(true);
-        QObject::connect(&noteDataChangedUpdater, &QTimer::timeout, q, [this,q](){
-            for (const QList<Entry> &list : entries) {
-                for (const Entry &obj : list) {
-                    Note *note = obj.note;
-                    if (note) {
-                        note->disconnect(q);
-                        connect(note, &Note::nameChanged, q, [this,note](){ noteChanged(note); });
-                        connect(note, &Note::midiNoteChanged, q, [this,note](){ noteChanged(note); });
-                        connect(note, &Note::midiChannelChanged, q, [this,note](){ noteChanged(note); });
-                        connect(note, &Note::isPlayingChanged, q, [this,note](){ noteChanged(note); });
-                        connect(note, &Note::subnotesChanged, q, [this,note](){ noteChanged(note); });
-                    }
-                }
-            }
-        });
+        QObject::connect(&noteDataChangedUpdater, &QTimer::timeout, q, [this](){ updateNoteSubscriptions(); });
         noteDataChangedEmitter.setInterval(0);
         noteDataChangedEmitter.setSingleShot(true);
         QObject::connect(&noteDataChangedEmitter, &QTimer::timeout, q, [this](){ emitNoteDataChanged(); });
@@ -67,31 +166,239 @@ public:
     int parentRow{-1};
     QTimer *lastModifiedChanger{nullptr};
     quint64 lastModified{0};
+    void updateLastModified() {
+        // Never reuse a stamp, so anything comparing stamps (like PatternModel's saving) sees every change
+        lastModified = qMax(quint64(QDateTime::currentMSecsSinceEpoch()), lastModified + 1);
+        Q_EMIT q->lastModifiedChanged();
+    }
     QList<NotesModel*> childModels;
     bool isEmpty{true};
     int isWorking{0};
-    QList< QList<Entry> > entries;
+    // The model's entries, stored row-major in chunks of NOTESMODEL_CHUNK_ROWS rows. Every row takes
+    // up columnCapacity entries, of which the first rowLengths[row] are actually part of the model
+    // (the rest are kept empty, so rows can grow in place). Editing a position changes its entry
+    // directly, rather than copying out the whole row, changing that, and assigning it back.
+    // The chunks are implicitly shared, so a snapshot of the model (see NotesModel::contents()) does
+    // not copy any entries, and a chunk is only copied when it is first changed after that.
+    QVector<QVector<Entry>> chunks;
+    QVector<int> rowLengths;
+    int columnCapacity{0};
 
-    void ensurePositionExists(int row, int column) {
-        if (entries.count() < row + 1) {
-            if (isWorking == 0) { q->beginInsertRows(QModelIndex(), entries.count(), row); }
-            for (int i = entries.count(); i < row + 1; ++i) {
-                entries << QList<Entry>();
+    inline int rowCount() const {
+        return rowLengths.count();
+    }
+    inline int columnCount(int row) const {
+        return rowLengths.at(row);
+    }
+    inline const Entry *constRowEntries(int row) const {
+        return chunks.at(row / NOTESMODEL_CHUNK_ROWS).constData() + ((row % NOTESMODEL_CHUNK_ROWS) * columnCapacity);
+    }
+    // The start of the given row's entries, for changing them (this detaches the row's chunk if it is shared)
+    inline Entry *rowEntries(int row) {
+        return chunks[row / NOTESMODEL_CHUNK_ROWS].data() + ((row % NOTESMODEL_CHUNK_ROWS) * columnCapacity);
+    }
+    inline const Entry &entryAt(int row, int column) const {
+        return constRowEntries(row)[column];
+    }
+    inline Entry &entry(int row, int column) {
+        return rowEntries(row)[column];
+    }
+    /**
+     * \brief Make sure there are exactly as many chunks as are needed to hold the given number of rows
+     */
+    void resizeChunks(int rows) {
+        const int chunkCount{(rows + NOTESMODEL_CHUNK_ROWS - 1) / NOTESMODEL_CHUNK_ROWS};
+        if (chunks.count() > chunkCount) {
+            chunks.resize(chunkCount);
+        } else {
+            chunks.reserve(chunkCount);
+            while (chunks.count() < chunkCount) {
+                chunks << QVector<Entry>(NOTESMODEL_CHUNK_ROWS * columnCapacity);
             }
-            if (isWorking == 0) { q->endInsertRows(); }
         }
-        QList<Entry> rowList = entries[row];
-        if (rowList.count() < column + 1) {
-            if (isWorking == 0) { q->beginInsertColumns(QModelIndex(), rowList.count(), column + 1); }
-            for (int i = rowList.count(); i < column + 1; ++i) {
-                rowList << Entry();
+    }
+    /**
+     * \brief Make sure each row has room for at least the given number of columns
+     * This moves all the rows apart if there is not already enough room, so call it sparingly
+     */
+    void ensureColumnCapacity(int capacity) {
+        if (columnCapacity < capacity) {
+            QVector<QVector<Entry>> newChunks(chunks.count(), QVector<Entry>(NOTESMODEL_CHUNK_ROWS * capacity));
+            for (int row = 0; row < rowLengths.count(); ++row) {
+                const Entry *rowStart = constRowEntries(row);
+                std::copy(rowStart, rowStart + rowLengths.at(row), newChunks[row / NOTESMODEL_CHUNK_ROWS].begin() + ((row % NOTESMODEL_CHUNK_ROWS) * capacity));
+            }
+            chunks.swap(newChunks);
+            columnCapacity = capacity;
+        }
+    }
+    // Copy all of a row's entries (including the empty ones past its end) to another row
+    void copyRowEntries(int from, int to) {
+        // Fetch the destination first, so the source is read from after any detaching that causes
+        Entry *destination = rowEntries(to);
+        const Entry *source = constRowEntries(from);
+        std::copy(source, source + columnCapacity, destination);
+    }
+    void insertRowEntries(int row, const QVector<Entry> &newEntries) {
+        ensureColumnCapacity(newEntries.count());
+        resizeChunks(rowLengths.count() + 1);
+        // Move everything from the row onwards down by one, to make room for the new row
+        for (int moved = rowLengths.count(); moved > row; --moved) {
+            copyRowEntries(moved - 1, moved);
+        }
+        Entry *rowStart = rowEntries(row);
+        std::copy(newEntries.constBegin(), newEntries.constEnd(), rowStart);
+        std::fill(rowStart + newEntries.count(), rowStart + columnCapacity, Entry());
+        rowLengths.insert(row, newEntries.count());
+        const int rowSubnotePositions{countSubnotePositions(newEntries)};
+        rowSubnotePositionCounts.insert(row, rowSubnotePositions);
+        subnotePositionCount += rowSubnotePositions;
+        notePositionsDirty = true;
+    }
+    void setRowEntries(int row, const QVector<Entry> &newEntries) {
+        const int rowSubnotePositions{countSubnotePositions(newEntries)};
+        subnotePositionCount += rowSubnotePositions - rowSubnotePositionCounts.at(row);
+        rowSubnotePositionCounts[row] = rowSubnotePositions;
+        ensureColumnCapacity(newEntries.count());
+        Entry *rowStart = rowEntries(row);
+        // Anything past the new end of the row must be left empty, in case the row grows again later
+        if (rowLengths.at(row) > newEntries.count()) {
+            std::fill(rowStart + newEntries.count(), rowStart + rowLengths.at(row), Entry());
+        }
+        std::copy(newEntries.constBegin(), newEntries.constEnd(), rowStart);
+        rowLengths[row] = newEntries.count();
+        notePositionsDirty = true;
+    }
+    void removeRowEntries(int row) {
+        const int lastRow{rowLengths.count() - 1};
+        for (int moved = row + 1; moved <= lastRow; ++moved) {
+            copyRowEntries(moved, moved - 1);
+        }
+        Entry *lastRowStart = rowEntries(lastRow);
+        std::fill(lastRowStart, lastRowStart + columnCapacity, Entry());
+        rowLengths.removeAt(row);
+        resizeChunks(rowLengths.count());
+        subnotePositionCount -= rowSubnotePositionCounts.takeAt(row);
+        notePositionsDirty = true;
+    }
+    void clearEntries() {
+        chunks.clear();
+        rowLengths.clear();
+        columnCapacity = 0;
+        rowSubnotePositionCounts.clear();
+        subnotePositionCount = 0;
+        notePositionsDirty = true;
+    }
+
+    // The number of positions in each row which contain a note with subnotes (and the total of those),
+    // kept up to date on every change, so it is cheap to find out whether a model has any notes in it
+    QVector<int> rowSubnotePositionCounts;
+    int subnotePositionCount{0};
+    static inline bool hasSubnotes(const Note *note) {
+        return note && note->subnoteCount() > 0;
+    }
+    static int countSubnotePositions(const QVector<Entry> &rowEntries) {
+        int count{0};
+        for (const Entry &entry : rowEntries) {
+            if (hasSubnotes(entry.note)) {
+                ++count;
+            }
+        }
+        return count;
+    }
+    void updateSubnotePositionCount(int row, const Note *oldNote, const Note *newNote) {
+        const int change{int(hasSubnotes(newNote)) - int(hasSubnotes(oldNote))};
+        rowSubnotePositionCounts[row] += change;
+        subnotePositionCount += change;
+    }
+
+    // The positions (as column, row) each note is found in, so a change to a note can be turned into
+    // dataChanged for just those positions. Changes to a single position update this directly, and
+    // anything which moves entries around marks it dirty instead, to be rebuilt the next time it's needed.
+    QHash<Note*, QVector<QPoint>> notePositions;
+    bool notePositionsDirty{true};
+    void ensureNotePositions() {
+        if (notePositionsDirty) {
+            notePositions.clear();
+            for (int row = 0; row < rowCount(); ++row) {
+                for (int column = 0; column < columnCount(row); ++column) {
+                    Note *note = entryAt(row, column).note;
+                    if (note) {
+                        notePositions[note] << QPoint(column, row);
+                    }
+                }
+            }
+            notePositionsDirty = false;
+        }
+    }
+    void updateNotePosition(int row, int column, Note *oldNote, Note *newNote) {
+        if (!notePositionsDirty && oldNote != newNote) {
+            if (oldNote) {
+                QHash<Note*, QVector<QPoint>>::iterator positions = notePositions.find(oldNote);
+                if (positions != notePositions.end()) {
+                    positions.value().removeOne(QPoint(column, row));
+                    if (positions.value().isEmpty()) {
+                        notePositions.erase(positions);
+                    }
+                }
+            }
+            if (newNote) {
+                notePositions[newNote] << QPoint(column, row);
             }
-            entries[row] = rowList;
+        }
+    }
+
+    void ensurePositionExists(int row, int column) {
+        if (rowCount() < row + 1) {
+            if (isWorking == 0) { q->beginInsertRows(QModelIndex(), rowCount(), row); }
+            rowLengths.resize(row + 1);
+            rowSubnotePositionCounts.resize(row + 1);
+            resizeChunks(rowLengths.count());
+            if (isWorking == 0) { q->endInsertRows(); }
+        }
+        if (columnCount(row) < column + 1) {
+            if (isWorking == 0) { q->beginInsertColumns(QModelIndex(), columnCount(row), column + 1); }
+            ensureColumnCapacity(column + 1);
+            rowLengths[row] = column + 1;
             if (isWorking == 0) { q->endInsertColumns(); }
         }
     }
     QTimer noteDataChangedUpdater;
-    QList<Note*> updateNotes;
+    // The notes we have asked PlayGridManager to tell us about changes to. This is brought in line with
+    // the notes in the model when noteDataChangedUpdater fires, subscribing only to the notes which were
+    // added since last time, and unsubscribing from the ones which have gone.
+    QSet<Note*> subscribedNotes;
+    // Guarded, as models owned by PlayGridManager are deleted after it has torn itself down
+    QPointer<PlayGridManager> subscriptionManager;
+    void updateNoteSubscriptions() {
+        ensureNotePositions();
+        if (!subscriptionManager) {
+            subscriptionManager = q->playGridManager();
+        }
+        QSet<Note*> currentNotes;
+        currentNotes.reserve(notePositions.count());
+        for (QHash<Note*, QVector<QPoint>>::const_iterator position = notePositions.constBegin(); position != notePositions.constEnd(); ++position) {
+            currentNotes << position.key();
+            if (!subscribedNotes.contains(position.key())) {
+                subscriptionManager->subscribeToNote(position.key(), q);
+            }
+        }
+        for (Note *note : qAsConst(subscribedNotes)) {
+            if (!currentNotes.contains(note)) {
+                subscriptionManager->unsubscribeFromNote(note, q);
+            }
+        }
+        subscribedNotes.swap(currentNotes);
+    }
+    void unsubscribeFromAllNotes() {
+        if (subscriptionManager) {
+            for (Note *note : qAsConst(subscribedNotes)) {
+                subscriptionManager->unsubscribeFromNote(note, q);
+            }
+        }
+        subscribedNotes.clear();
+    }
+    QSet<Note*> updateNotes;
     void noteChanged(Note* note) {
         if (!updateNotes.contains(note)) {
             updateNotes << note;
@@ -101,26 +408,52 @@ public:
     QTimer noteDataChangedEmitter;
     void emitNoteDataChanged() {
         if (isWorking == 0) {
-            for (int row = 0; row < entries.count(); ++row) {
-                const QList<Entry>& rowEntries = entries[row];
-                for (int column = 0; column < rowEntries.count(); ++column) {
-                    const Entry &entry = rowEntries.at(column);
-                    if (updateNotes.contains(entry.note)) {
-                        QModelIndex idx = q->index(row, column);
-                        q->dataChanged(idx, idx);
-                    }
+            ensureNotePositions();
+            QVector<QPoint> changedPositions;
+            for (Note *note : qAsConst(updateNotes)) {
+                changedPositions << notePositions.value(note);
+            }
+            // Sort by row and then column, so neighbouring positions in a row can be sent as a single range
+            std::sort(changedPositions.begin(), changedPositions.end(), [](const QPoint &first, const QPoint &second) {
+                return first.y() < second.y() || (first.y() == second.y() && first.x() < second.x());
+            });
+            int rangeStart{0};
+            for (int i = 0; i < changedPositions.count(); ++i) {
+                const QPoint &position = changedPositions.at(i);
+                const bool rangeEnds{i + 1 == changedPositions.count()
+                    || changedPositions.at(i + 1).y() != position.y()
+                    || changedPositions.at(i + 1).x() > position.x() + 1};
+                if (rangeEnds) {
+                    q->dataChanged(q->index(position.y(), changedPositions.at(rangeStart).x()), q->index(position.y(), position.x()));
+                    rangeStart = i + 1;
                 }
             }
         }
         updateNotes.clear();
     }
 
+    // While positionChangeDepth is above zero, changes to single positions are gathered up in the
+    // changedArea, rather than being sent out immediately (see beginPositionChanges())
+    int positionChangeDepth{0};
+    QRect changedArea;
+    void positionChanged(int row, int column) {
+        if (isWorking == 0) {
+            if (positionChangeDepth > 0) {
+                changedArea |= QRect(column, row, 1, 1);
+            } else {
+                QModelIndex changed = q->index(row, column);
+                q->dataChanged(changed, changed);
+            }
+        }
+    }
+
     QTimer isEmtpyUpdater;
     void updateIsEmtpy() {
         bool updatedIsEmpty{true};
-        for (const QList<Entry> &row : entries) {
-            for (const Entry &entry : row) {
-                if (entry.note && (entry.note->midiNote() < 128 || entry.note->subnotes().count() > 0)) {
+        for (int row = 0; row < rowCount(); ++row) {
+            for (int column = 0; column < columnCount(row); ++column) {
+                const Entry &entry = entryAt(row, column);
+                if (entry.note && (entry.note->midiNote() < 128 || entry.note->subnoteCount() > 0)) {
                     updatedIsEmpty = false;
                     break;
                 }
@@ -143,10 +476,7 @@ NotesModel::NotesModel(PlayGridManager* parent)
     d->lastModifiedChanger = new QTimer(this);
     d->lastModifiedChanger->setInterval(1);
     d->lastModifiedChanger->setSingleShot(true);
-    connect(d->lastModifiedChanger, &QTimer::timeout, this, [this](){
-        d->lastModified = QDateTime::currentMSecsSinceEpoch();
-        Q_EMIT lastModifiedChanged();
-    });
+    connect(d->lastModifiedChanger, &QTimer::timeout, this, [this](){ d->updateLastModified(); });
     connect(this, &QAbstractItemModel::dataChanged, d->lastModifiedChanger, QOverload<>::of(&QTimer::start));
     connect(this, &QAbstractItemModel::modelReset, d->lastModifiedChanger, QOverload<>::of(&QTimer::start));
     connect(this, &QAbstractItemModel::rowsInserted, d->lastModifiedChanger, QOverload<>::of(&QTimer::start));
@@ -190,6 +520,7 @@ NotesModel::NotesModel(NotesModel* parent, int row)
 
 NotesModel::~NotesModel()
 {
+    d->unsubscribeFromAllNotes();
     delete d;
 }
 
@@ -222,7 +553,7 @@ int NotesModel::rowCount(const QModelIndex& parent) const
         }
     } else {
         if (!parent.isValid()) {
-            count = d->entries.count();
+            count = d->rowCount();
         }
     }
     return count;
@@ -235,8 +566,8 @@ int NotesModel::columnCount(const QModelIndex& parent) const
         if (parent.isValid()) {
             count = 1;
         }
-    } else if (parent.isValid() && parent.row() >= 0 && parent.row() < d->entries.count()) {
-        count = d->entries.at(parent.row()).count();
+    } else if (parent.isValid() && parent.row() >= 0 && parent.row() < d->rowCount()) {
+        count = d->columnCount(parent.row());
     }
     return count;
 }
@@ -247,17 +578,16 @@ QVariant NotesModel::data(const QModelIndex& index, int role) const
 //     qDebug() << Q_FUNC_INFO << this << objectName() << d->parentModel << d->parentRow << index.row();
     if (d->parentModel) {
         result = d->parentModel->data(d->parentModel->index(d->parentRow, index.row()), role);
-    } else if (index.row() >= 0 && index.row() < d->entries.count()) {
-        const QList<Entry> &rowEntries = d->entries.at(index.row());
-        if (index.column() >= 0 && index.column() < rowEntries.count()) {
-            const Entry &entry = rowEntries.at(index.column());
+    } else if (index.row() >= 0 && index.row() < d->rowCount()) {
+        if (index.column() >= 0 && index.column() < d->columnCount(index.row())) {
+            const Entry &entry = d->entryAt(index.row(), index.column());
             switch(role) {
             case Qt::DisplayRole:
             case NoteRole:
                 result.setValue<QObject*>(entry.note);
                 break;
             case MetadataRole:
-                result = entry.metaData;
+                result = entry.metadata();
                 break;
             case RowModelRole:
             {
@@ -287,8 +617,8 @@ QVariant NotesModel::data(const QModelIndex& index, int role) const
 QModelIndex NotesModel::index(int row, int column, const QModelIndex& /*parent*/) const
 {
     QModelIndex idx;
-    if (row >= 0 && row < d->entries.count()) {
-        if (column >= 0 && column < d->entries[row].count()) {
+    if (row >= 0 && row < d->rowCount()) {
+        if (column >= 0 && column < d->columnCount(row)) {
             idx = createIndex(row, column);
         }
     }
@@ -315,6 +645,14 @@ void NotesModel::registerChange()
     d->lastModifiedChanger->start();
 }
 
+void NotesModel::flushChanges()
+{
+    if (d->lastModifiedChanger->isActive()) {
+        d->lastModifiedChanger->stop();
+        d->updateLastModified();
+    }
+}
+
 bool NotesModel::isEmpty() const
 {
     return d->isEmpty;
@@ -324,10 +662,9 @@ QVariantList NotesModel::getRow(int row) const
 {
     QVariantList list;
     if (!d->parentModel) {
-        if (row >= 0 && row < d->entries.count()) {
-            const QList<Entry> &entries = d->entries.at(row);
-            for (const Entry &entry : entries) {
-                list << QVariant::fromValue<QObject*>(entry.note);
+        if (row >= 0 && row < d->rowCount()) {
+            for (int column = 0; column < d->columnCount(row); ++column) {
+                list << QVariant::fromValue<QObject*>(d->entryAt(row, column).note);
             }
         }
     }
@@ -338,12 +675,12 @@ QVariantList NotesModel::uniqueRowNotes(int row) const
 {
     QVariantList notes;
     if (!d->parentModel) {
-        if (row >= 0 && row < d->entries.count()) {
+        if (row >= 0 && row < d->rowCount()) {
             std::function<void(Note*)> addNotesIfNotThere;
             addNotesIfNotThere = [&notes,&addNotesIfNotThere](Note *note) {
-                if (note && note->subnotes().count() > 0) {
-                    for (const QVariant &subnote : note->subnotes()) {
-                        addNotesIfNotThere(subnote.value<Note*>());
+                if (note && note->subnoteCount() > 0) {
+                    for (Note *subnote : note->typedSubnotes()) {
+                        addNotesIfNotThere(subnote);
                     }
                 } else if (note) {
                     bool foundNote{false};
@@ -358,9 +695,8 @@ QVariantList NotesModel::uniqueRowNotes(int row) const
                     }
                 }
             };
-            const QList<Entry> &entries = d->entries.at(row);
-            for (const Entry &entry : entries) {
-                addNotesIfNotThere(entry.note);
+            for (int column = 0; column < d->columnCount(row); ++column) {
+                addNotesIfNotThere(d->entryAt(row, column).note);
             }
         }
     }
@@ -371,10 +707,9 @@ QObject* NotesModel::getNote(int row, int column) const
 {
     QObject *obj{nullptr};
     if (!d->parentModel) {
-        if (row >= 0 && row < d->entries.count()) {
-            const QList<Entry> &rowEntries = d->entries.at(row);
-            if (column >= 0 && column < rowEntries.count()) {
-                obj = rowEntries.at(column).note;
+        if (row >= 0 && row < d->rowCount()) {
+            if (column >= 0 && column < d->columnCount(row)) {
+                obj = d->entryAt(row, column).note;
             }
         }
     }
@@ -385,14 +720,12 @@ void NotesModel::setNote(int row, int column, QObject* note)
 {
     if (!d->parentModel) {
         d->ensurePositionExists(row, column);
-        QList<Entry> rowList = d->entries[row];
-        rowList[column].note = qobject_cast<Note*>(note);
-        d->entries[row] = rowList;
+        Entry &entry = d->entry(row, column);
+        d->updateNotePosition(row, column, entry.note, qobject_cast<Note*>(note));
+        d->updateSubnotePositionCount(row, entry.note, qobject_cast<Note*>(note));
+        entry.note = qobject_cast<Note*>(note);
         d->isEmtpyUpdater.start();
-        if (d->isWorking == 0) {
-            QModelIndex changed = createIndex(row, column);
-            dataChanged(changed, changed);
-        }
+        d->positionChanged(row, column);
     }
 }
 
@@ -400,10 +733,9 @@ QVariantList NotesModel::getRowMetadata(int row) const
 {
     QVariantList list;
     if (!d->parentModel) {
-        if (row >= 0 && row < d->entries.count()) {
-            const QList<Entry> &entries = d->entries.at(row);
-            for (const Entry &entry : entries) {
-                list << entry.metaData;
+        if (row >= 0 && row < d->rowCount()) {
+            for (int column = 0; column < d->columnCount(row); ++column) {
+                list << d->entryAt(row, column).metadata();
             }
         }
     }
@@ -414,10 +746,9 @@ QVariant NotesModel::getMetadata(int row, int column) const
 {
     QVariant data;
     if (!d->parentModel) {
-        if (row >= 0 && row < d->entries.count()) {
-            const QList<Entry> &rowEntries = d->entries.at(row);
-            if (column >= 0 && column < rowEntries.count()) {
-                data = rowEntries.at(column).metaData;
+        if (row >= 0 && row < d->rowCount()) {
+            if (column >= 0 && column < d->columnCount(row)) {
+                data = d->entryAt(row, column).metadata();
             }
         }
     }
@@ -429,30 +760,49 @@ void NotesModel::setMetadata(int row, int column, QVariant metadata)
     static const QLatin1String jsvalueType{"QJSValue"};
     if (!d->parentModel) {
         d->ensurePositionExists(row, column);
-        QList<Entry> rowList = d->entries[row];
         QVariant actualMeta{metadata};
         if (QString(metadata.typeName()) == jsvalueType) {
             const QJSValue tempMeta{metadata.value<QJSValue>()};
             actualMeta = tempMeta.toVariant();
         }
-        rowList[column].metaData = actualMeta;
-        d->entries[row] = rowList;
+        d->entry(row, column).setMetadata(actualMeta);
         d->isEmtpyUpdater.start();
-        if (d->isWorking == 0) {
-            QModelIndex changed = createIndex(row, column);
-            dataChanged(changed, changed);
+        d->positionChanged(row, column);
+    }
+}
+
+SubnoteMetadata NotesModel::getTypedMetadata(int row, int column) const
+{
+    SubnoteMetadata data;
+    if (!d->parentModel) {
+        if (row >= 0 && row < d->rowCount()) {
+            if (column >= 0 && column < d->columnCount(row)) {
+                data = d->entryAt(row, column).subnoteMetadata;
+            }
         }
     }
+    return data;
+}
+
+void NotesModel::setTypedMetadata(int row, int column, const SubnoteMetadata &metadata)
+{
+    if (!d->parentModel) {
+        d->ensurePositionExists(row, column);
+        Entry &entry = d->entry(row, column);
+        entry.metaData = QVariant();
+        entry.subnoteMetadata = metadata;
+        d->isEmtpyUpdater.start();
+        d->positionChanged(row, column);
+    }
 }
 
 QVariant NotesModel::getKeyedMetadata(int row, int column, const QString &key) const
 {
     QVariant data;
     if (!d->parentModel) {
-        if (row >= 0 && row < d->entries.count()) {
-            const QList<Entry> &rowEntries = d->entries.at(row);
-            if (column >= 0 && column < rowEntries.count()) {
-                const QVariantHash &hash = rowEntries.at(column).keyedData;
+        if (row >= 0 && row < d->rowCount()) {
+            if (column >= 0 && column < d->columnCount(row)) {
+                const QVariantHash &hash = d->entryAt(row, column).keyedData;
                 if (hash.contains(key)) {
                     data = hash[key];
                 }
@@ -466,10 +816,9 @@ QVariantHash NotesModel::getKeyedData(int row, int column) const
 {
     QVariantHash data;
     if (!d->parentModel) {
-        if (row >= 0 && row < d->entries.count()) {
-            const QList<Entry> &rowEntries = d->entries.at(row);
-            if (column >= 0 && column < rowEntries.count()) {
-                data = rowEntries.at(column).keyedData;
+        if (row >= 0 && row < d->rowCount()) {
+            if (column >= 0 && column < d->columnCount(row)) {
+                data = d->entryAt(row, column).keyedData;
             }
         }
     }
@@ -480,11 +829,12 @@ void NotesModel::setKeyedMetadata(int row, int column, const QString &key, const
 {
     static const QLatin1String jsvalueType{"QJSValue"};
     if (!d->parentModel) {
+        contentsAboutToChange();
         d->ensurePositionExists(row, column);
-        QList<Entry> rowList = d->entries[row];
+        Entry &entry = d->entry(row, column);
         if (metadata.type() == QVariant::String && metadata.toString() == "") {
-            if (rowList[column].keyedData.contains(key)) {
-                rowList[column].keyedData.remove(key);
+            if (entry.keyedData.contains(key)) {
+                entry.keyedData.remove(key);
             }
         } else {
             QVariant actualMeta{metadata};
@@ -492,14 +842,11 @@ void NotesModel::setKeyedMetadata(int row, int column, const QString &key, const
                 const QJSValue tempMeta{metadata.value<QJSValue>()};
                 actualMeta = tempMeta.toVariant();
             }
-            rowList[column].keyedData[key] = actualMeta;
+            entry.keyedData[key] = actualMeta;
         }
-        d->entries[row] = rowList;
         d->isEmtpyUpdater.start();
-        if (d->isWorking == 0) {
-            QModelIndex changed = createIndex(row, column);
-            dataChanged(changed, changed);
-        }
+        d->positionChanged(row, column);
+        contentsChanged();
     }
 }
 
@@ -509,7 +856,8 @@ void NotesModel::setRowData(int row, QVariantList notes, QVariantList metadata,
     static const QLatin1String jsvalueType{"QJSValue"};
     if (!d->parentModel) {
         if (row > -1 && row < rowCount()) {
-            QList<Entry> rowList;
+            QVector<Entry> rowList;
+            rowList.reserve(notes.count());
             for (int i = 0; i < notes.count(); ++i) {
                 Note* actualNote = notes.at(i).value<Note*>();
                 QVariant actualMeta{metadata.at(i)};
@@ -527,15 +875,17 @@ void NotesModel::setRowData(int row, QVariantList notes, QVariantList metadata,
                 }
                 Entry entry;
                 entry.note = actualNote;
-                entry.metaData = actualMeta;
+                entry.setMetadata(actualMeta);
                 entry.keyedData = actualKeyedData.toHash();
                 rowList.append(entry);
             }
-            d->entries[row] = rowList;
+            contentsAboutToChange();
+            d->setRowEntries(row, rowList);
             d->isEmtpyUpdater.start();
             if (d->isWorking == 0) {
                 dataChanged(createIndex(row, 0), createIndex(row, rowList.count() - 1));
             }
+            contentsChanged();
         }
     }
 }
@@ -543,11 +893,12 @@ void NotesModel::setRowData(int row, QVariantList notes, QVariantList metadata,
 void NotesModel::trim()
 {
     if (!d->parentModel) {
-        QList< QList<Entry> > newList;
-        for (const QList<Entry> &rowList : d->entries) {
-            QList<Entry> newRow;
-            QList<Entry> trailing;
-            for (const Entry& entry : rowList) {
+        QList< QVector<Entry> > newList;
+        for (int row = 0; row < d->rowCount(); ++row) {
+            QVector<Entry> newRow;
+            QVector<Entry> trailing;
+            for (int column = 0; column < d->columnCount(row); ++column) {
+                const Entry &entry = d->entryAt(row, column);
                 if (entry.note) {
                     newRow << trailing;
                     trailing.clear();
@@ -560,10 +911,20 @@ void NotesModel::trim()
                 newList << newRow;
             }
         }
+        contentsAboutToChange();
         if (d->isWorking == 0) { beginResetModel(); }
-        d->entries = newList;
+        d->clearEntries();
+        int longestRow{0};
+        for (const QVector<Entry> &newRow : qAsConst(newList)) {
+            longestRow = qMax(longestRow, newRow.count());
+        }
+        d->ensureColumnCapacity(longestRow);
+        for (const QVector<Entry> &newRow : qAsConst(newList)) {
+            d->insertRowEntries(d->rowCount(), newRow);
+        }
         d->isEmtpyUpdater.start();
         if (d->isWorking == 0) { endResetModel(); }
+        contentsChanged();
     }
 }
 
@@ -571,54 +932,88 @@ void NotesModel::clear()
 {
     if (!d->parentModel) {
         if (d->isWorking == 0) { beginResetModel(); }
-        for (QList<Entry> &list : d->entries) {
-            for (const Entry &entry : list) {
-                if (entry.note) {
-                    entry.note->disconnect(this);
-                }
-            }
-        }
-        d->entries.clear();
+        d->unsubscribeFromAllNotes();
+        d->clearEntries();
         d->isEmtpyUpdater.start();
         if (d->isWorking == 0) { endResetModel(); }
         Q_EMIT rowsChanged();
     }
 }
 
+NotesModelContents NotesModel::contents() const
+{
+    NotesModelContents contents;
+    if (!d->parentModel) {
+        contents.d = new NotesModelContentsData;
+        contents.d->chunks = d->chunks;
+        contents.d->rowLengths = d->rowLengths;
+        contents.d->columnCapacity = d->columnCapacity;
+        contents.d->rowSubnotePositionCounts = d->rowSubnotePositionCounts;
+        contents.d->subnotePositionCount = d->subnotePositionCount;
+    }
+    return contents;
+}
+
+void NotesModel::setContents(const NotesModelContents &contents)
+{
+    if (!d->parentModel) {
+        if (d->isWorking == 0) { beginResetModel(); }
+        const int oldRowCount{d->rowCount()};
+        if (contents.d) {
+            d->chunks = contents.d->chunks;
+            d->rowLengths = contents.d->rowLengths;
+            d->columnCapacity = contents.d->columnCapacity;
+            d->rowSubnotePositionCounts = contents.d->rowSubnotePositionCounts;
+            d->subnotePositionCount = contents.d->subnotePositionCount;
+            d->notePositionsDirty = true;
+        } else {
+            d->clearEntries();
+        }
+        d->noteDataChangedUpdater.start();
+        d->isEmtpyUpdater.start();
+        if (d->isWorking == 0) { endResetModel(); }
+        if (oldRowCount != d->rowCount()) {
+            Q_EMIT rowsChanged();
+        }
+    }
+}
+
 void NotesModel::addRow(const QVariantList &notes, const QVariantList &metadata)
 {
     if (!d->parentModel) {
-        QList<Entry> actualNotes;
+        QVector<Entry> actualNotes;
         int metadataCount = metadata.count();
         for (int i = 0; i < notes.count(); ++i) {
             Entry entry;
             Note *note = notes[i].value<Note*>();
             entry.note = note;
             if (i < metadataCount) {
-                entry.metaData = metadata[i];
+                entry.setMetadata(metadata[i]);
             }
             actualNotes << entry;
         }
         if (actualNotes.count() > 0) {
+            contentsAboutToChange();
             if (d->isWorking == 0) {  beginInsertRows(QModelIndex(), 0, 0); }
-            d->entries.insert(0, actualNotes);
+            d->insertRowEntries(0, actualNotes);
             d->noteDataChangedUpdater.start();
             d->isEmtpyUpdater.start();
             if (d->isWorking == 0) {  endInsertRows(); }
             Q_EMIT rowsChanged();
+            contentsChanged();
         }
     }
 }
 
 void NotesModel::appendRow(const QVariantList& notes, const QVariantList& metadata)
 {
-    insertRow(d->entries.count(), notes, metadata);
+    insertRow(d->rowCount(), notes, metadata);
 }
 
 void NotesModel::insertRow(int index, const QVariantList& notes, const QVariantList& metadata, const QVariantList& keyedData)
 {
-    if (!d->parentModel && index > -1 && index <= d->entries.count()) {
-        QList<Entry> actualNotes;
+    if (!d->parentModel && index > -1 && index <= d->rowCount()) {
+        QVector<Entry> actualNotes;
         const int metadataCount = metadata.count();
         const int keyedDataCount = keyedData.count();
         for (int i = 0; i < notes.count(); ++i) {
@@ -626,7 +1021,7 @@ void NotesModel::insertRow(int index, const QVariantList& notes, const QVariantL
             Note *note = notes[i].value<Note*>();
             entry.note = note;
             if (i < metadataCount) {
-                entry.metaData = metadata[i];
+                entry.setMetadata(metadata[i]);
             }
             if (i < keyedDataCount) {
                 entry.keyedData = keyedData[i].toHash();
@@ -634,35 +1029,41 @@ void NotesModel::insertRow(int index, const QVariantList& notes, const QVariantL
             actualNotes << entry;
         }
         if (actualNotes.count() > 0) {
+            contentsAboutToChange();
             if (d->isWorking == 0) { beginInsertRows(QModelIndex(), index, index); }
-            d->entries.insert(index, actualNotes);
+            d->insertRowEntries(index, actualNotes);
             d->noteDataChangedUpdater.start();
             if (d->isWorking == 0) { endInsertRows(); }
             d->isEmtpyUpdater.start();
             Q_EMIT rowsChanged();
+            contentsChanged();
         }
     }
 }
 
 void NotesModel::removeRow(int row)
 {
-    if (!d->parentModel && row > -1 && row < d->entries.count()) {
+    if (!d->parentModel && row > -1 && row < d->rowCount()) {
+        contentsAboutToChange();
         if (d->isWorking == 0) { beginRemoveRows(QModelIndex(), row, row); }
-        d->entries.removeAt(row);
+        d->removeRowEntries(row);
         d->isEmtpyUpdater.start();
         if (d->isWorking == 0) { endRemoveRows(); }
+        contentsChanged();
     }
 }
 
 Note *switchNoteMidiChannel(Note *note, int newMidiChannel) {
     Note *newNote{nullptr};
     if (note) {
-        if (note->subnotes().count() > 0) {
-            QVariantList subnotes;
-            for (const QVariant &variantNote : note->subnotes()) {
-                subnotes << QVariant::fromValue<QObject*>(switchNoteMidiChannel(variantNote.value<Note*>(), newMidiChannel));
+        const QVector<Note*> &oldSubnotes = note->typedSubnotes();
+        if (oldSubnotes.count() > 0) {
+            QVector<Note*> subnotes;
+            subnotes.reserve(oldSubnotes.count());
+            for (Note *subnote : oldSubnotes) {
+                subnotes << switchNoteMidiChannel(subnote, newMidiChannel);
             }
-            newNote = qobject_cast<Note*>(PlayGridManager::instance()->getCompoundNote(subnotes));
+            newNote = PlayGridManager::instance()->getCompoundNote(subnotes);
         } else {
             newNote = qobject_cast<Note*>(PlayGridManager::instance()->getNote(note->midiNote(), newMidiChannel));
         }
@@ -674,13 +1075,22 @@ void NotesModel::changeMidiChannel(int midiChannel)
 {
     qDebug() << this << "Changing midi to" << midiChannel;
     int longestRow{0};
-    for (QList<Entry> &entries : d->entries) {
-        for (int i = 0; i < entries.count(); ++i) {
-            entries[i].note = switchNoteMidiChannel(entries[i].note, qBound(-1, midiChannel, 16));
+    for (int row = 0; row < d->rowCount(); ++row) {
+        for (int column = 0; column < d->columnCount(row); ++column) {
+            Entry &entry = d->entry(row, column);
+            Note *newNote = switchNoteMidiChannel(entry.note, qBound(-1, midiChannel, 16));
+            d->updateSubnotePositionCount(row, entry.note, newNote);
+            entry.note = newNote;
         }
-        longestRow = qMax(longestRow, entries.count());
+        longestRow = qMax(longestRow, d->columnCount(row));
     }
-    if (d->isWorking == 0) { dataChanged(createIndex(0, 0), createIndex(d->entries.count(), longestRow)); }
+    d->notePositionsDirty = true;
+    if (d->isWorking == 0) { dataChanged(createIndex(0, 0), createIndex(d->rowCount(), longestRow)); }
+}
+
+void NotesModel::notifyNoteChanged(Note *note)
+{
+    d->noteChanged(note);
 }
 
 PlayGridManager* NotesModel::playGridManager() const
@@ -699,6 +1109,44 @@ void NotesModel::startLongOperation()
     }
 }
 
+int NotesModel::rowSubnotePositionCount(int row) const
+{
+    int count{0};
+    if (!d->parentModel && row > -1 && row < d->rowCount()) {
+        count = d->rowSubnotePositionCounts.at(row);
+    }
+    return count;
+}
+
+int NotesModel::subnotePositionCount() const
+{
+    return d->parentModel ? 0 : d->subnotePositionCount;
+}
+
+void NotesModel::beginPositionChanges()
+{
+    d->positionChangeDepth++;
+}
+
+void NotesModel::endPositionChanges()
+{
+    d->positionChangeDepth--;
+    if (d->positionChangeDepth == 0 && d->changedArea.isValid()) {
+        if (d->isWorking == 0) {
+            dataChanged(createIndex(d->changedArea.top(), d->changedArea.left()), createIndex(d->changedArea.bottom(), d->changedArea.right()));
+        }
+        d->changedArea = QRect();
+    }
+}
+
+void NotesModel::contentsAboutToChange()
+{
+}
+
+void NotesModel::contentsChanged()
+{
+}
+
 void NotesModel::endLongOperation()
 {
     d->isWorking--;
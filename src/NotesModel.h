@@ -23,7 +23,73 @@
 #define NOTESMODEL_H
 
 #include <QAbstractListModel>
+#include <QSharedDataPointer>
 #include "PlayGridManager.h"
+#include "SubnoteMetadata.h"
+
+class NotesModelContentsData;
+/**
+ * \brief A snapshot of everything stored in the positions of a NotesModel (notes, metadata and keyed data)
+ *
+ * The model stores its positions in implicitly shared chunks of rows, and a snapshot simply holds on to
+ * those chunks, so taking one does not copy any positions. When the model is changed afterwards, only
+ * the chunks which are changed get copied, so keeping a snapshot around costs memory only for the parts
+ * of the model which have since changed.
+ *
+ * A default constructed instance is null, which is the same as the contents of an empty model.
+ * As a snapshot never changes, it is safe to read from any thread, while the model carries on being changed.
+ * @see NotesModel::contents()
+ * @see NotesModel::setContents()
+ */
+class NotesModelContents {
+public:
+    NotesModelContents();
+    NotesModelContents(const NotesModelContents &other);
+    ~NotesModelContents();
+    NotesModelContents &operator=(const NotesModelContents &other);
+
+    inline bool isNull() const {
+        return !d;
+    }
+    /**
+     * \brief The number of rows in the snapshot
+     */
+    int rowCount() const;
+    /**
+     * \brief The number of positions in the given row of the snapshot
+     */
+    int columnCount(int row) const;
+    /**
+     * \brief The note in the given position (see NotesModel::getNote()), or null if there is none
+     */
+    Note *note(int row, int column) const;
+    /**
+     * \brief The metadata for the given position (see NotesModel::getMetadata())
+     */
+    QVariant metadata(int row, int column) const;
+    /**
+     * \brief The typed subnote metadata for the given position (see NotesModel::getTypedMetadata())
+     */
+    SubnoteMetadata typedMetadata(int row, int column) const;
+    /**
+     * \brief The keyed data for the given position (see NotesModel::getKeyedData())
+     */
+    QVariantHash keyedData(int row, int column) const;
+
+    /**
+     * \brief Whether the two snapshots hold the same contents
+     * Only the chunks which are not shared between the two are compared position by position,
+     * so comparing a snapshot to one taken after a few changes is cheap.
+     */
+    bool operator==(const NotesModelContents &other) const;
+    inline bool operator!=(const NotesModelContents &other) const {
+        return !(*this == other);
+    }
+private:
+    friend class NotesModel;
+    QSharedDataPointer<NotesModelContentsData> d;
+};
+Q_DECLARE_TYPEINFO(NotesModelContents, Q_MOVABLE_TYPE);
 
 class NotesModel : public QAbstractListModel
 {
@@ -72,7 +138,7 @@ public:
     Q_SIGNAL void parentRowChanged();
     /**
      * \brief When the last change was made on the model (setting notes, metadata, or anything else really)
-     * @return The timestamp of the most recent change, to the nearest second
+     * @return The timestamp of the most recent change, in milliseconds (each change gets a distinct, later stamp)
      */
     quint64 lastModified() const;
     Q_SIGNAL void lastModifiedChanged();
@@ -80,6 +146,12 @@ public:
      * \brief Call this to make the object notice that a change has happened (changing lastModified)
      */
     void registerChange();
+    /**
+     * \brief Update lastModified right away, if there are changes it does not include yet
+     * Changes are only stamped onto lastModified shortly after they happen, so a burst of changes
+     * results in a single update. Use this when lastModified has to include every change made so far.
+     */
+    void flushChanges();
 
     bool isEmpty() const;
     Q_SIGNAL void isEmptyChanged();
@@ -141,6 +213,25 @@ public:
      * @param metadata The piece of metadata you wish to set
      */
     Q_INVOKABLE virtual void setMetadata(int row, int column, QVariant metadata);
+    /**
+     * \brief Retrieve the typed subnote metadata for the given position
+     * Metadata which is a list of hashes (one for each subnote of the position's compound note) is stored
+     * as a SubnoteMetadata, and this gives you direct access to that, without converting it to a list
+     * @note Not valid on child models (see parentModel())
+     * @param row The row of the position to fetch metadata for
+     * @param column The column of the position to fetch metadata for
+     * @return The typed metadata (this is null if there was none set, or if what was set was not a list of hashes)
+     */
+    SubnoteMetadata getTypedMetadata(int row, int column) const;
+    /**
+     * \brief Set the typed subnote metadata for the given position
+     * This replaces any metadata set on the position, the same way setMetadata() does
+     * @note Not valid on child models (see parentModel())
+     * @param row The row of the position to set metadata for
+     * @param column The column of the position to set the metadata for
+     * @param metadata The new subnote metadata
+     */
+    virtual void setTypedMetadata(int row, int column, const SubnoteMetadata &metadata);
     /**
      * \brief Set a piece of named metadata for the given position
      * @note Not valid on child models (see parentModel())
@@ -190,6 +281,20 @@ public:
      * @note Not valid on child models (see parentModel())
      */
     Q_INVOKABLE virtual void clear();
+    /**
+     * \brief A snapshot of the contents of all the model's positions
+     * Taking a snapshot is cheap, and so is keeping it around (see NotesModelContents)
+     * @note Not valid on child models (see parentModel())
+     * @return The model's contents (this is null for child models)
+     */
+    NotesModelContents contents() const;
+    /**
+     * \brief Replace the contents of all the model's positions with those in the given snapshot
+     * This resets the model. Passing a null snapshot empties the model.
+     * @note Not valid on child models (see parentModel())
+     * @param contents A snapshot, from this or any other model
+     */
+    virtual void setContents(const NotesModelContents &contents);
     /**
      * \brief Add a new row of notes to the top of the model
      * @note Not valid on child models (see parentModel())
@@ -233,6 +338,14 @@ public:
      * @param midiChannel The midi channel (0 through 15) that all notes and subnotes (etc) in the model should use
      */
     Q_INVOKABLE void changeMidiChannel(int midiChannel);
+    /**
+     * \brief Called by PlayGridManager when a note this model has subscribed to has changed
+     * The positions containing the note are marked as changed shortly afterwards (along with any other
+     * notes which changed in the meantime)
+     * @param note The note which changed
+     * @see PlayGridManager::subscribeToNote()
+     */
+    void notifyNoteChanged(Note *note);
     /**
      * \brief Get the PlayGridManager instance associated with this model
      * @return The PlayGridManager associated with this model (either the immediate parent, or the one from the parent model)
@@ -253,6 +366,44 @@ public:
      * @see startLongOperation()
      */
     Q_INVOKABLE void endLongOperation();
+protected:
+    /**
+     * \brief The number of positions in the given row which contain a note with subnotes
+     * This is kept up to date as the model changes, so it is cheap to call
+     * @note Not valid on child models (see parentModel())
+     */
+    int rowSubnotePositionCount(int row) const;
+    /**
+     * \brief The number of positions in the model which contain a note with subnotes
+     * This is kept up to date as the model changes, so it is cheap to call
+     * @note Not valid on child models (see parentModel())
+     */
+    int subnotePositionCount() const;
+    /**
+     * \brief Call this before changing a number of positions, to have them reported as a single change
+     * Until the matching endPositionChanges() call, changes to individual positions are not reported
+     * straight away, and instead a single dataChanged covering all of them is emitted at the end. Unlike
+     * startLongOperation(), this does not reset the model. These calls can be nested.
+     */
+    void beginPositionChanges();
+    /**
+     * \brief Call this after changing a number of positions
+     * @see beginPositionChanges()
+     */
+    void endPositionChanges();
+    /**
+     * \brief Called before the model's contents are changed by one of the functions which work on
+     * whole rows or directly on the entries (such as insertRow(), removeRow(), setRowData(), trim() and
+     * setKeyedMetadata()), which is to say the ones which do not go through setNote() and setMetadata()
+     * The default implementation does nothing
+     */
+    virtual void contentsAboutToChange();
+    /**
+     * \brief Called after the model's contents have been changed by one of those same functions
+     * The default implementation does nothing
+     * @see contentsAboutToChange()
+     */
+    virtual void contentsChanged();
 private:
     class Private;
     Private* d;
@@ -0,0 +1,612 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PatternFile.h"
+#include "Note.h"
+#include "PatternModel.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+#include <limits>
+
+// The QDataStream version used for the extra data section
+#define PATTERN_FILE_STREAM_VERSION QDataStream::Qt_5_11
+
+static const char patternFileMagic[4]{'Z', 'B', 'P', 'T'};
+
+struct PatternFileHeader {
+    char magic[4];
+    quint32_le version;
+    // The size of the header, so later versions can add to it without breaking older readers
+    quint32_le headerSize;
+    qint32_le width;
+    qint32_le height;
+    qint32_le noteDestination;
+    qint32_le midiChannel;
+    qint32_le defaultNoteDuration;
+    qint32_le noteLength;
+    qint32_le availableBars;
+    qint32_le activeBar;
+    qint32_le bankOffset;
+    qint32_le bankLength;
+    qint32_le gridModelStartNote;
+    qint32_le gridModelEndNote;
+    quint32_le enabled;
+    quint32_le layerDataSize;
+    quint32_le stepCount;
+    quint32_le subnoteCount;
+    quint32_le extraDataSize;
+};
+static_assert(sizeof(PatternFileHeader) == 80, "The pattern file header must not contain any padding");
+
+enum PatternFileStepFlag {
+    // The position holds a compound note made up of the step's subnotes (otherwise the position holds
+    // the note in the step's single subnote record, or no note at all if it has no subnote records)
+    StepCompoundNote = 0x1,
+    // The position's metadata is the typed metadata in the step's subnote records
+    StepSubnoteMetadata = 0x2,
+    // The position's metadata is the first thing in the step's extra data
+    StepExtraMetadata = 0x4,
+    // The position's keyed data is in the step's extra data (after the metadata, if that is there as well)
+    StepKeyedData = 0x8,
+};
+
+struct PatternFileStep {
+    quint16_le row;
+    quint16_le column;
+    quint16_le subnoteCount;
+    quint16_le flags;
+    // The number of bytes of extra data for this step
+    quint32_le extraSize;
+};
+static_assert(sizeof(PatternFileStep) == 12, "The pattern file step record must not contain any padding");
+
+struct PatternFileSubnote {
+    quint8 midiNote;
+    qint8 midiChannel;
+    // The typed metadata fields which are set (see SubnoteMetadata::Field)
+    quint8 fields;
+    qint8 velocity;
+    qint16_le delay;
+    qint16_le duration;
+};
+static_assert(sizeof(PatternFileSubnote) == 8, "The pattern file subnote record must not contain any padding");
+
+static inline bool isValidNoteDestination(int noteDestination)
+{
+    return noteDestination >= PatternModel::SynthDestination && noteDestination <= PatternModel::ExternalDestination;
+}
+
+// The same range PlayGridManager::getNote() accepts (which includes the channels used to mark invalid notes)
+static inline bool isValidSubnoteRecord(const PatternFileSubnote &record)
+{
+    return record.midiNote <= 127 && record.midiChannel >= -1 && record.midiChannel <= 16
+        && (record.fields & ~quint8(SubnoteMetadata::VelocityField | SubnoteMetadata::DelayField | SubnoteMetadata::DurationField)) == 0
+        && (!(record.fields & SubnoteMetadata::VelocityField) || record.velocity >= 0);
+}
+
+static inline int paddedSize(int size)
+{
+    return (size + 3) & ~3;
+}
+
+static inline PatternFileSubnote subnoteRecord(const Note *note)
+{
+    PatternFileSubnote record;
+    record.midiNote = quint8(note->midiNote());
+    record.midiChannel = qint8(note->midiChannel());
+    record.fields = 0;
+    record.velocity = 0;
+    record.delay = 0;
+    record.duration = 0;
+    return record;
+}
+
+QByteArray PatternFile::serialize(const PatternModel *pattern)
+{
+    QByteArray result;
+    if (pattern) {
+        result = serialize(snapshot(pattern));
+    }
+    return result;
+}
+
+PatternFileSnapshot PatternFile::snapshot(const PatternModel *pattern)
+{
+    PatternFileSnapshot snapshot;
+    if (pattern) {
+        snapshot.width = pattern->width();
+        snapshot.height = pattern->height();
+        snapshot.noteDestination = int(pattern->noteDestination());
+        snapshot.midiChannel = pattern->midiChannel();
+        snapshot.defaultNoteDuration = pattern->defaultNoteDuration();
+        snapshot.noteLength = pattern->noteLength();
+        snapshot.availableBars = pattern->availableBars();
+        snapshot.activeBar = pattern->activeBar();
+        snapshot.bankOffset = pattern->bankOffset();
+        snapshot.bankLength = pattern->bankLength();
+        snapshot.gridModelStartNote = pattern->gridModelStartNote();
+        snapshot.gridModelEndNote = pattern->gridModelEndNote();
+        snapshot.enabled = pattern->enabled();
+        snapshot.layerData = pattern->layerData();
+        snapshot.contents = pattern->contents();
+    }
+    return snapshot;
+}
+
+QByteArray PatternFile::serialize(const PatternFileSnapshot &snapshot)
+{
+    QByteArray result;
+    const NotesModelContents &contents = snapshot.contents;
+    const QByteArray layerData{snapshot.layerData.toUtf8()};
+    QVector<PatternFileStep> steps;
+    QVector<PatternFileSubnote> subnotes;
+    QByteArray extraData;
+    for (int row = 0; row < snapshot.height; ++row) {
+        for (int column = 0; column < snapshot.width; ++column) {
+            const Note *note = contents.note(row, column);
+            const SubnoteMetadata metadata{contents.typedMetadata(row, column)};
+            const QVariantHash keyedData{contents.keyedData(row, column)};
+            const int firstSubnote{subnotes.count()};
+            quint16 flags{0};
+            if (note && note->midiNote() > 127) {
+                flags |= StepCompoundNote;
+                for (const Note *subnote : note->typedSubnotes()) {
+                    subnotes << subnoteRecord(subnote);
+                }
+                if (!metadata.isNull() && metadata.count() == note->subnoteCount() && !metadata.hasOtherData()) {
+                    flags |= StepSubnoteMetadata;
+                    for (int subnote = 0; subnote < metadata.count(); ++subnote) {
+                        PatternFileSubnote &record = subnotes[firstSubnote + subnote];
+                        record.fields = quint8(metadata.fields(subnote));
+                        record.velocity = qint8(metadata.velocity(subnote));
+                        record.delay = qint16(metadata.delay(subnote));
+                        record.duration = qint16(metadata.duration(subnote));
+                    }
+                }
+            } else if (note) {
+                subnotes << subnoteRecord(note);
+            }
+            QVariant extraMetadata;
+            if (!(flags & StepSubnoteMetadata)) {
+                extraMetadata = contents.metadata(row, column);
+                // An empty list is what a cleared position has, and is the same as no metadata
+                if (extraMetadata.isValid() && !(extraMetadata.type() == QVariant::List && extraMetadata.toList().isEmpty())) {
+                    flags |= StepExtraMetadata;
+                }
+            }
+            if (!keyedData.isEmpty()) {
+                flags |= StepKeyedData;
+            }
+            if (note || flags != 0) {
+                PatternFileStep step;
+                step.row = quint16(row);
+                step.column = quint16(column);
+                step.subnoteCount = quint16(subnotes.count() - firstSubnote);
+                step.flags = flags;
+                step.extraSize = 0;
+                if (flags & (StepExtraMetadata | StepKeyedData)) {
+                    QByteArray stepExtraData;
+                    QDataStream stream(&stepExtraData, QIODevice::WriteOnly);
+                    stream.setVersion(PATTERN_FILE_STREAM_VERSION);
+                    if (flags & StepExtraMetadata) {
+                        stream << extraMetadata;
+                    }
+                    if (flags & StepKeyedData) {
+                        stream << keyedData;
+                    }
+                    step.extraSize = quint32(stepExtraData.size());
+                    extraData += stepExtraData;
+                }
+                steps << step;
+            }
+        }
+    }
+
+    PatternFileHeader header;
+    memcpy(header.magic, patternFileMagic, sizeof(header.magic));
+    header.version = PATTERN_FILE_VERSION;
+    header.headerSize = quint32(sizeof(PatternFileHeader));
+    header.width = snapshot.width;
+    header.height = snapshot.height;
+    header.noteDestination = snapshot.noteDestination;
+    header.midiChannel = snapshot.midiChannel;
+    header.defaultNoteDuration = snapshot.defaultNoteDuration;
+    header.noteLength = snapshot.noteLength;
+    header.availableBars = snapshot.availableBars;
+    header.activeBar = snapshot.activeBar;
+    header.bankOffset = snapshot.bankOffset;
+    header.bankLength = snapshot.bankLength;
+    header.gridModelStartNote = snapshot.gridModelStartNote;
+    header.gridModelEndNote = snapshot.gridModelEndNote;
+    header.enabled = snapshot.enabled ? 1 : 0;
+    header.layerDataSize = quint32(layerData.size());
+    header.stepCount = quint32(steps.count());
+    header.subnoteCount = quint32(subnotes.count());
+    header.extraDataSize = quint32(extraData.size());
+
+    result.reserve(int(sizeof(PatternFileHeader)) + paddedSize(layerData.size()) + (steps.count() * int(sizeof(PatternFileStep))) + (subnotes.count() * int(sizeof(PatternFileSubnote))) + extraData.size());
+    result.append(reinterpret_cast<const char*>(&header), sizeof(PatternFileHeader));
+    result.append(layerData);
+    result.append(paddedSize(layerData.size()) - layerData.size(), '\0');
+    result.append(reinterpret_cast<const char*>(steps.constData()), steps.count() * int(sizeof(PatternFileStep)));
+    result.append(reinterpret_cast<const char*>(subnotes.constData()), subnotes.count() * int(sizeof(PatternFileSubnote)));
+    result.append(extraData);
+    return result;
+}
+
+bool PatternFile::parse(const char *data, qint64 size, PatternFileData &patternData)
+{
+    if (!data) {
+        return false;
+    }
+    if (size < qint64(sizeof(PatternFileHeader))) {
+        qWarning() << Q_FUNC_INFO << "The data is too short to be a pattern";
+        return false;
+    }
+    if (quintptr(data) % alignof(PatternFileStep) != 0 || quintptr(data) % alignof(PatternFileSubnote) != 0) {
+        // The records are read in place, which they need to be aligned for, so work from an aligned copy instead
+        if (size > std::numeric_limits<int>::max()) {
+            qWarning() << Q_FUNC_INFO << "The data is too large to be a pattern";
+            return false;
+        }
+        const QByteArray alignedData(data, int(size));
+        return parse(alignedData.constData(), size, patternData);
+    }
+    PatternFileHeader header;
+    memcpy(&header, data, sizeof(PatternFileHeader));
+    if (memcmp(header.magic, patternFileMagic, sizeof(header.magic)) != 0) {
+        qWarning() << Q_FUNC_INFO << "The data is not a pattern";
+        return false;
+    }
+    if (header.version == 0) {
+        qWarning() << Q_FUNC_INFO << "The pattern has no version, so it is not a valid pattern";
+        return false;
+    }
+    if (header.version > PATTERN_FILE_VERSION) {
+        qWarning() << Q_FUNC_INFO << "The pattern is version" << quint32(header.version) << "which is newer than the newest version we know how to read," << PATTERN_FILE_VERSION;
+        return false;
+    }
+    // The header size must keep the records which follow it aligned, as they are read in place
+    if (header.headerSize < quint32(sizeof(PatternFileHeader)) || header.headerSize % 4 != 0 || header.layerDataSize > quint32(std::numeric_limits<int>::max() - 3)) {
+        qWarning() << Q_FUNC_INFO << "The pattern's header is not valid";
+        return false;
+    }
+    const qint64 layerDataStart{qint64(header.headerSize)};
+    const qint64 stepsStart{layerDataStart + paddedSize(int(header.layerDataSize))};
+    const qint64 subnotesStart{stepsStart + (qint64(header.stepCount) * qint64(sizeof(PatternFileStep)))};
+    const qint64 extraDataStart{subnotesStart + (qint64(header.subnoteCount) * qint64(sizeof(PatternFileSubnote)))};
+    if (extraDataStart + qint64(header.extraDataSize) > size) {
+        qWarning() << Q_FUNC_INFO << "The pattern's sections do not fit in the data, so it is likely truncated";
+        return false;
+    }
+    const int width{header.width};
+    const int height{header.height};
+    if (width < 0 || height < 0 || width > 0xFFFF || height > 0xFFFF) {
+        qWarning() << Q_FUNC_INFO << "The pattern has an invalid size:" << width << "by" << height;
+        return false;
+    }
+    if (!isValidNoteDestination(header.noteDestination)) {
+        qWarning() << Q_FUNC_INFO << "The pattern has an invalid note destination:" << qint32(header.noteDestination);
+        return false;
+    }
+
+    const PatternFileStep *steps = reinterpret_cast<const PatternFileStep*>(data + stepsStart);
+    const PatternFileSubnote *subnoteRecords = reinterpret_cast<const PatternFileSubnote*>(data + subnotesStart);
+    quint32 nextSubnote{0};
+    qint64 nextExtraData{0};
+
+    // Everything is parsed into this, and only handed over once all of it has been checked, so a bad
+    // record anywhere leaves the caller's data untouched
+    PatternFileData parsedData;
+    parsedData.width = width;
+    parsedData.height = height;
+    parsedData.steps.reserve(int(header.stepCount));
+    for (quint32 stepIndex = 0; stepIndex < header.stepCount; ++stepIndex) {
+        const PatternFileStep &step = steps[stepIndex];
+        const int row{step.row};
+        const int column{step.column};
+        const quint32 subnoteCount{step.subnoteCount};
+        const quint16 flags{step.flags};
+        if (nextSubnote + subnoteCount > header.subnoteCount || nextExtraData + qint64(step.extraSize) > qint64(header.extraDataSize)) {
+            qWarning() << Q_FUNC_INFO << "Step" << stepIndex << "refers to more data than the pattern contains";
+            return false;
+        }
+        const PatternFileSubnote *stepSubnotes = subnoteRecords + nextSubnote;
+        const char *stepExtraData = data + extraDataStart + nextExtraData;
+        nextSubnote += subnoteCount;
+        nextExtraData += step.extraSize;
+        if (row >= height || column >= width) {
+            qWarning() << Q_FUNC_INFO << "Step" << stepIndex << "is outside the pattern, at" << row << column;
+            return false;
+        }
+        if (flags & ~quint16(StepCompoundNote | StepSubnoteMetadata | StepExtraMetadata | StepKeyedData)) {
+            qWarning() << Q_FUNC_INFO << "Step" << stepIndex << "has unknown flags:" << flags;
+            return false;
+        }
+        for (quint32 subnote = 0; subnote < subnoteCount; ++subnote) {
+            if (!isValidSubnoteRecord(stepSubnotes[subnote])) {
+                qWarning() << Q_FUNC_INFO << "Step" << stepIndex << "has an invalid subnote record at" << subnote;
+                return false;
+            }
+        }
+
+        PatternFileData::Step parsedStep;
+        parsedStep.row = row;
+        parsedStep.column = column;
+        parsedStep.compoundNote = (flags & StepCompoundNote);
+        // A plain note only ever has the one subnote record
+        const quint32 noteCount{parsedStep.compoundNote ? subnoteCount : qMin(subnoteCount, quint32(1))};
+        parsedStep.subnotes.resize(int(noteCount));
+        for (quint32 subnote = 0; subnote < noteCount; ++subnote) {
+            parsedStep.subnotes[int(subnote)].midiNote = stepSubnotes[subnote].midiNote;
+            parsedStep.subnotes[int(subnote)].midiChannel = stepSubnotes[subnote].midiChannel;
+        }
+        if (flags & StepSubnoteMetadata) {
+            parsedStep.subnoteMetadata = SubnoteMetadata(int(subnoteCount));
+            for (quint32 subnote = 0; subnote < subnoteCount; ++subnote) {
+                const PatternFileSubnote &record = stepSubnotes[subnote];
+                parsedStep.subnoteMetadata.setFields(int(subnote), record.fields, record.velocity, record.delay, record.duration);
+            }
+        }
+        if (flags & (StepExtraMetadata | StepKeyedData)) {
+            const QByteArray extraData{QByteArray::fromRawData(stepExtraData, int(step.extraSize))};
+            QDataStream stream(extraData);
+            stream.setVersion(PATTERN_FILE_STREAM_VERSION);
+            if (flags & StepExtraMetadata) {
+                stream >> parsedStep.metadata;
+            }
+            if (flags & StepKeyedData) {
+                stream >> parsedStep.keyedData;
+            }
+            if (stream.status() != QDataStream::Ok) {
+                qWarning() << Q_FUNC_INFO << "Step" << stepIndex << "has extra data which could not be read";
+                return false;
+            }
+        }
+        parsedData.steps << parsedStep;
+    }
+    patternData = parsedData;
+    patternData.noteDestination = header.noteDestination;
+    patternData.midiChannel = header.midiChannel;
+    patternData.defaultNoteDuration = header.defaultNoteDuration;
+    patternData.noteLength = header.noteLength;
+    patternData.availableBars = header.availableBars;
+    patternData.activeBar = header.activeBar;
+    patternData.bankOffset = header.bankOffset;
+    patternData.bankLength = header.bankLength;
+    patternData.gridModelStartNote = header.gridModelStartNote;
+    patternData.gridModelEndNote = header.gridModelEndNote;
+    patternData.enabled = (header.enabled != 0);
+    patternData.layerData = QString::fromUtf8(data + layerDataStart, int(header.layerDataSize));
+    return true;
+}
+
+// The json form of a note (see PlayGridManager::noteToJsonObject()), which is a compound note if it has subnotes
+static inline void parseJsonNote(const QJsonObject &noteObject, PatternFileData::Step &step)
+{
+    if (noteObject.contains("subnotes")) {
+        const QJsonArray subnotes{noteObject.value("subnotes").toArray()};
+        step.compoundNote = true;
+        step.subnotes.resize(subnotes.count());
+        for (int subnote = 0; subnote < subnotes.count(); ++subnote) {
+            const QJsonObject subnoteObject{subnotes.at(subnote).toObject()};
+            // A subnote which is not a note makes the whole compound note invalid, which is marked by an invalid note value
+            step.subnotes[subnote].midiNote = subnoteObject.contains("midiNote") ? subnoteObject.value("midiNote").toInt() : -1;
+            step.subnotes[subnote].midiChannel = subnoteObject.value("midiChannel").toInt();
+        }
+    } else if (noteObject.contains("midiNote")) {
+        step.subnotes.resize(1);
+        step.subnotes[0].midiNote = noteObject.value("midiNote").toInt();
+        step.subnotes[0].midiChannel = noteObject.value("midiChannel").toInt();
+    }
+}
+
+void PatternFile::parseJson(const QJsonObject &patternObject, PatternFileData &patternData)
+{
+    patternData = PatternFileData();
+    // The notes are stored as a string containing a json array of rows, each an array of positions
+    const QJsonDocument notesDoc{QJsonDocument::fromJson(patternObject.value("notes").toString().toUtf8())};
+    const QJsonArray rows{notesDoc.array()};
+    for (int row = 0; row < rows.count(); ++row) {
+        const QJsonArray columns{rows.at(row).toArray()};
+        for (int column = 0; column < columns.count(); ++column) {
+            const QJsonObject position{columns.at(column).toObject()};
+            PatternFileData::Step step;
+            step.row = row;
+            step.column = column;
+            parseJsonNote(position.value("note").toObject(), step);
+            const QVariant metadata{position.value("metadata").toVariant()};
+            step.subnoteMetadata = SubnoteMetadata::fromVariant(metadata);
+            // An empty list is what a cleared position has, and is the same as no metadata
+            if (step.subnoteMetadata.isNull() && !(metadata.type() == QVariant::List && metadata.toList().isEmpty())) {
+                step.metadata = metadata;
+            }
+            step.keyedData = position.value("keyeddata").toVariant().toHash();
+            if (!step.subnotes.isEmpty() || step.compoundNote || !step.subnoteMetadata.isNull() || step.metadata.isValid() || !step.keyedData.isEmpty()) {
+                patternData.steps << step;
+            }
+        }
+    }
+    patternData.height = patternObject.value("height").toInt();
+    patternData.width = patternObject.value("width").toInt();
+    patternData.midiChannel = patternObject.value("midiChannel").toInt();
+    patternData.noteLength = patternObject.value("noteLength").toInt();
+    patternData.availableBars = patternObject.value("availableBars").toInt();
+    patternData.activeBar = patternObject.value("activeBar").toInt();
+    patternData.bankOffset = patternObject.value("bankOffset").toInt();
+    patternData.bankLength = patternObject.value("bankLength").toInt();
+    // Not all of these have always been persisted, so anything missing gets the default from PatternFileData
+    if (patternObject.contains("enabled")) {
+        patternData.enabled = patternObject.value("enabled").toBool();
+    }
+    if (patternObject.contains("layerData")) {
+        patternData.layerData = patternObject.value("layerData").toString();
+    }
+    if (patternObject.contains("noteDestination") && isValidNoteDestination(patternObject.value("noteDestination").toInt())) {
+        patternData.noteDestination = patternObject.value("noteDestination").toInt();
+    }
+    if (patternObject.contains("gridModelStartNote")) {
+        patternData.gridModelStartNote = patternObject.value("gridModelStartNote").toInt();
+    }
+    if (patternObject.contains("gridModelEndNote")) {
+        patternData.gridModelEndNote = patternObject.value("gridModelEndNote").toInt();
+    }
+    if (patternObject.contains("defaultNoteDuration")) {
+        patternData.defaultNoteDuration = patternObject.value("defaultNoteDuration").toInt();
+    }
+}
+
+bool PatternFile::parseFile(const QString &fileName, PatternFileData &patternData)
+{
+    bool success{false};
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly)) {
+        if (fileName.endsWith(QLatin1String{PATTERN_FILE_SUFFIX})) {
+            const qint64 size{file.size()};
+            uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+            if (mapped) {
+                success = parse(reinterpret_cast<const char*>(mapped), size, patternData);
+                file.unmap(mapped);
+            } else {
+                // Not everything can be mapped, so fall back to just reading the whole thing in that case
+                const QByteArray data{file.readAll()};
+                success = parse(data.constData(), data.size(), patternData);
+            }
+        } else {
+            const QJsonDocument jsonDoc{QJsonDocument::fromJson(file.readAll())};
+            if (jsonDoc.isObject()) {
+                parseJson(jsonDoc.object(), patternData);
+                success = true;
+            } else {
+                qWarning() << Q_FUNC_INFO << fileName << "does not contain a pattern";
+            }
+        }
+        file.close();
+    } else {
+        qWarning() << Q_FUNC_INFO << "Failed to open" << fileName << "for reading:" << file.errorString();
+    }
+    return success;
+}
+
+void PatternFile::apply(PatternModel *pattern, const PatternFileData &patternData)
+{
+    if (!pattern) {
+        return;
+    }
+    PlayGridManager *playGridManager = pattern->playGridManager();
+    pattern->startLongOperation();
+    pattern->setHeight(0);
+    pattern->setHeight(patternData.height);
+    pattern->setWidth(patternData.width);
+    QVector<Note*> subnotes;
+    for (const PatternFileData::Step &step : patternData.steps) {
+        if (step.row >= patternData.height || step.column >= patternData.width) {
+            continue;
+        }
+        Note *note{nullptr};
+        if (step.compoundNote) {
+            subnotes.resize(step.subnotes.count());
+            for (int subnote = 0; subnote < step.subnotes.count(); ++subnote) {
+                subnotes[subnote] = qobject_cast<Note*>(playGridManager->getNote(step.subnotes[subnote].midiNote, step.subnotes[subnote].midiChannel));
+            }
+            note = playGridManager->getCompoundNote(subnotes);
+        } else if (!step.subnotes.isEmpty()) {
+            note = qobject_cast<Note*>(playGridManager->getNote(step.subnotes[0].midiNote, step.subnotes[0].midiChannel));
+        }
+        pattern->setNote(step.row, step.column, note);
+        if (!step.subnoteMetadata.isNull()) {
+            pattern->setTypedMetadata(step.row, step.column, step.subnoteMetadata);
+        } else if (step.metadata.isValid()) {
+            pattern->setMetadata(step.row, step.column, step.metadata);
+        }
+        for (QVariantHash::const_iterator keyedValue = step.keyedData.constBegin(); keyedValue != step.keyedData.constEnd(); ++keyedValue) {
+            pattern->setKeyedMetadata(step.row, step.column, keyedValue.key(), keyedValue.value());
+        }
+    }
+    pattern->setMidiChannel(patternData.midiChannel);
+    pattern->setNoteLength(patternData.noteLength);
+    pattern->setAvailableBars(patternData.availableBars);
+    pattern->setActiveBar(patternData.activeBar);
+    pattern->setBankOffset(patternData.bankOffset);
+    pattern->setBankLength(patternData.bankLength);
+    pattern->setEnabled(patternData.enabled);
+    pattern->setLayerData(patternData.layerData);
+    pattern->setNoteDestination(PatternModel::NoteDestination(patternData.noteDestination));
+    pattern->setGridModelStartNote(patternData.gridModelStartNote);
+    pattern->setGridModelEndNote(patternData.gridModelEndNote);
+    pattern->setDefaultNoteDuration(patternData.defaultNoteDuration);
+    pattern->endLongOperation();
+}
+
+bool PatternFile::deserialize(PatternModel *pattern, const char *data, qint64 size)
+{
+    PatternFileData patternData;
+    if (pattern && parse(data, size, patternData)) {
+        apply(pattern, patternData);
+        return true;
+    }
+    return false;
+}
+
+bool PatternFile::write(const PatternModel *pattern, const QString &fileName)
+{
+    return writeFile(fileName, serialize(pattern));
+}
+
+bool PatternFile::writeFile(const QString &fileName, const QByteArray &data)
+{
+    bool success{false};
+    // Written to a temporary file which then replaces the real one, so an interrupted save never leaves a broken file behind
+    QSaveFile file(fileName);
+    if (file.open(QIODevice::WriteOnly)) {
+        if (file.write(data) == data.size()) {
+            success = file.commit();
+        } else {
+            file.cancelWriting();
+        }
+        if (!success) {
+            qWarning() << Q_FUNC_INFO << "Failed to write" << fileName << ":" << file.errorString();
+        }
+    } else {
+        qWarning() << Q_FUNC_INFO << "Failed to open" << fileName << "for writing:" << file.errorString();
+    }
+    return success;
+}
+
+bool PatternFile::read(PatternModel *pattern, const QString &fileName)
+{
+    PatternFileData patternData;
+    if (pattern && parseFile(fileName, patternData)) {
+        apply(pattern, patternData);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PATTERNFILE_H
+#define PATTERNFILE_H
+
+#include "NotesModel.h"
+#include "SubnoteMetadata.h"
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+class PatternModel;
+
+// The version of the binary pattern format written by PatternFile (files with a newer version are refused)
+#define PATTERN_FILE_VERSION 1
+// The suffix used for pattern files in the binary format (the json ones use .pattern.json)
+#define PATTERN_FILE_SUFFIX ".pattern.bin"
+
+/**
+ * \brief The properties of a pattern which are stored in a pattern file
+ */
+struct PatternFileProperties {
+    int width{0};
+    int height{0};
+    int noteDestination{0};
+    int midiChannel{0};
+    int defaultNoteDuration{0};
+    int noteLength{0};
+    int availableBars{0};
+    int activeBar{0};
+    int bankOffset{0};
+    int bankLength{0};
+    int gridModelStartNote{48};
+    int gridModelEndNote{64};
+    bool enabled{true};
+    QString layerData;
+};
+
+/**
+ * \brief The contents and properties of a pattern, as plain data
+ *
+ * This is what reading a pattern file produces, before it is applied to a PatternModel. As it holds
+ * no Note instances (or any other QObject), it can be created on any thread, which is what allows
+ * SequenceModel to parse a sketch's pattern files in parallel.
+ */
+struct PatternFileData : public PatternFileProperties {
+    struct Subnote {
+        int midiNote{0};
+        int midiChannel{0};
+    };
+    /**
+     * \brief A position in the pattern which has anything in it
+     */
+    struct Step {
+        int row{0};
+        int column{0};
+        // Whether the position holds a compound note made up of the subnotes (otherwise it holds the
+        // note described by the single entry in subnotes, or no note at all if that is empty)
+        bool compoundNote{false};
+        QVector<Subnote> subnotes;
+        // The position's metadata, if it is in the list form (see SubnoteMetadata)
+        SubnoteMetadata subnoteMetadata;
+        // The position's metadata, if it is anything other than the list form
+        QVariant metadata;
+        QVariantHash keyedData;
+    };
+    QVector<Step> steps;
+};
+
+/**
+ * \brief An unchanging copy of everything about a pattern which is stored in a pattern file
+ *
+ * Taking a snapshot is cheap, as the contents are shared with the pattern until one of them changes,
+ * and once taken it can be serialized on any thread while the pattern carries on being edited (the
+ * notes it refers to are never changed once created). This is what allows SequenceModel to write
+ * sketches in the background.
+ */
+struct PatternFileSnapshot : public PatternFileProperties {
+    NotesModelContents contents;
+};
+
+/**
+ * \brief Reading and writing patterns in the binary pattern format
+ *
+ * The binary format holds the same things as the json representation of a pattern (see
+ * PlayGridManager::modelToJson()), laid out so that it can be read straight out of a memory mapped
+ * file in a single pass, without going through QJsonDocument. A file consists of:
+ *
+ * - A header, with the pattern's properties and the sizes of the sections which follow
+ * - The pattern's layer data, as utf8 (padded to a multiple of four bytes)
+ * - A step record for each position which has anything in it, in row-major order
+ * - The subnote records for those steps, in the same order (a step's subnotes follow on from the previous step's)
+ * - Extra data for the steps which need it (metadata which does not fit in the subnote records,
+ *   and keyed data), in QDataStream form
+ *
+ * All values are little endian. The json format remains the one used for importing and exporting.
+ *
+ * Reading is split in two: parsing a file into a PatternFileData, which is safe to do on any thread,
+ * and applying that to a pattern, which must happen on the pattern's thread (as it creates notes).
+ */
+class PatternFile {
+public:
+    /**
+     * \brief The binary representation of the given pattern
+     */
+    static QByteArray serialize(const PatternModel *pattern);
+    /**
+     * \brief Take a snapshot of the given pattern, for serializing it later (or elsewhere)
+     */
+    static PatternFileSnapshot snapshot(const PatternModel *pattern);
+    /**
+     * \brief The binary representation of a pattern snapshot
+     * @note This is safe to call on any thread
+     */
+    static QByteArray serialize(const PatternFileSnapshot &snapshot);
+    /**
+     * \brief Replace the contents and properties of the given pattern with those in the binary data
+     * @param pattern The pattern to load the data into
+     * @param data The binary representation of a pattern (see serialize())
+     * @param size The number of bytes of data
+     * @return True if the data was loaded, or false if it was not a valid pattern (in which case the pattern is left untouched)
+     */
+    static bool deserialize(PatternModel *pattern, const char *data, qint64 size);
+    /**
+     * \brief Parse the binary representation of a pattern
+     * @note This is safe to call on any thread
+     * @param data The binary representation of a pattern (see serialize())
+     * @param size The number of bytes of data
+     * @param patternData The data will be parsed into this
+     * Every step record is checked before anything is handed back, and any invalid record (or an invalid
+     * header value, such as an unknown note destination) makes the whole pattern invalid
+     * The records are read in place when data is aligned to at least 4 bytes (and copied out first otherwise)
+     * @return True if the data was parsed, or false if it was not a valid pattern (in which case patternData is left untouched)
+     */
+    static bool parse(const char *data, qint64 size, PatternFileData &patternData);
+    /**
+     * \brief Parse the json representation of a pattern (see PlayGridManager::modelToJson())
+     * Properties which have not always been saved are given their defaults if they are missing from the json
+     * @note This is safe to call on any thread
+     * @param patternObject The json representation of a pattern
+     * @param patternData The json will be parsed into this
+     */
+    static void parseJson(const QJsonObject &patternObject, PatternFileData &patternData);
+    /**
+     * \brief Parse a pattern file, in either the binary or the json format (decided by the file's suffix)
+     * A file in the binary format is memory mapped while it is read, if possible
+     * @note This is safe to call on any thread
+     * @return True if the file was successfully read and parsed
+     */
+    static bool parseFile(const QString &fileName, PatternFileData &patternData);
+    /**
+     * \brief Replace the contents and properties of the given pattern with the parsed data
+     * @param pattern The pattern to apply the data to
+     * @param patternData The data to apply (as parsed by one of the parse functions)
+     */
+    static void apply(PatternModel *pattern, const PatternFileData &patternData);
+
+    /**
+     * \brief Write the given pattern to a file in the binary format
+     * The file is replaced atomically, so if writing fails part way through, any previous file is left untouched
+     * @note This will overwrite anything that already exists in that location without warning
+     * @return True if the file was successfully written
+     */
+    static bool write(const PatternModel *pattern, const QString &fileName);
+    /**
+     * \brief Write some data to a file, replacing the file atomically
+     * The data is written to a temporary file, which replaces the real one once it has all been written
+     * @note This is safe to call on any thread
+     * @return True if the file was successfully written
+     */
+    static bool writeFile(const QString &fileName, const QByteArray &data);
+    /**
+     * \brief Load the given pattern from a file, in either the binary or the json format
+     * This is parseFile() followed by apply()
+     * @return True if the file was successfully read (if not, the pattern is left untouched)
+     */
+    static bool read(PatternModel *pattern, const QString &fileName);
+};
+
+#endif//PATTERNFILE_H
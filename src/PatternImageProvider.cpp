@@ -181,11 +181,9 @@ void PatternRunnable::run()
                 if (row < pattern->availableBars()) {
                     const Note *note = qobject_cast<const Note*>(pattern->getNote(row + bank * pattern->bankLength(), column));
                     if (note) {
-                        const QVariantList &subnotes = note->subnotes();
-                        for (const QVariant &subnoteVar : subnotes) {
-                            Note *subnote = subnoteVar.value<Note*>();
+                        for (const Note *subnote : note->typedSubnotes()) {
                             // This really shouldn't happen, but let's make sure anyway...
-                            if (subnote->octave() < 12) {
+                            if (subnote && subnote->octave() < 12) {
                                 img.setPixelColor((row * pattern->width() + column), height - subnote->octave() - 1, white);
                             }
                         }
@@ -21,14 +21,22 @@
 
 #include "PatternModel.h"
 #include "Note.h"
+#include "PatternFile.h"
+#include "PlaybackBatch.h"
+#include "PlaybackProfiler.h"
+#include "PlaybackTiming.h"
 #include "SegmentHandler.h"
 
-#include <QDateTime>
 #include <QDebug>
-#include <QFile>
+#include <QMap>
+#include <QPoint>
 #include <QPointer>
+#include <QSaveFile>
 #include <QTimer>
 
+#include <algorithm>
+#include <atomic>
+
 // Hackety hack - we don't need all the thing, just need some storage things (MidiBuffer and MidiNote specifically)
 #define JUCE_GLOBAL_MODULE_SETTINGS_INCLUDED 1
 #include <juce_audio_formats/juce_audio_formats.h>
@@ -242,13 +250,7 @@ public Q_SLOTS:
             MidiRouter::instance()->setZynthianChannels(q->channelIndex(), chainedSounds);
         }
     }
-    void mutedChanged() {
-        if (zlChannel) {
-            channelMuted = zlChannel->property("muted").toBool();
-        } else {
-            channelMuted = false;
-        }
-    }
+    void mutedChanged();
     void retrieveLayerData() {
         if (zlChannel) {
             QString jsonSnapshot;
@@ -260,6 +262,131 @@ public Q_SLOTS:
     void addRecordedNote(void* recordedNote);
 };
 
+/**
+ * \brief A compiled representation of a single subnote on a step, used by the playback code
+ *
+ * This is filled out by PatternModel::Private::compileStep() whenever the notes or metadata of
+ * a step changes, so that the playback code does not have to go through Note instances and the
+ * QVariant based metadata for every step it schedules.
+ */
+struct StepSubnote {
+    int midiNote{0};
+    int midiChannel{0};
+    int velocity{64};
+    int delay{0};
+    // A duration of 0 means the note should be auto-quantized to the pattern's note length
+    int duration{0};
+};
+/**
+ * \brief The compiled contents of a single step
+ */
+struct StepData {
+    QVector<StepSubnote> subnotes;
+    // The most negative delay of any subnote on the step (or 0 if none of them have a negative delay)
+    int earliestDelay{0};
+};
+
+/**
+ * \brief A single midi event, ready to be handed to SyncTimer during playback
+ */
+struct PlaybackEvent {
+    // The on-position delay of the event (in SyncTimer ticks)
+    int delay{0};
+    unsigned char message[3]{0, 0, 0};
+    // The position inside the buffer the event is scheduled in (this ensures off events come before on events)
+    unsigned char sampleNumber{0};
+};
+
+// The number of events we expect a single step to produce (that is, an on and an off
+// event for each subnote). A position's slot holds this many events for each of the
+// steps it looks at (see PlaybackSnapshot::lookahead), and anything beyond that goes
+// into the snapshot's overflow store.
+#define PlaybackEventsPerStep 16
+
+/**
+ * \brief An immutable snapshot of the data the playback code needs to schedule a pattern's notes
+ *
+ * Snapshots are built by PatternModel::Private::buildSnapshot() (usually on the UI thread, or on
+ * a worker thread when preparing for playback, see PlaybackSnapshotSource), and handed over to the
+ * timer thread by swapping an atomic pointer. Once published, a snapshot is never
+ * changed, which means the timer thread can read from it without locking or allocating. Retired
+ * snapshots are only deleted once the timer thread can no longer be looking at them (see
+ * PatternModel::Private::acquireSnapshot() for the reader side of that handshake).
+ *
+ * The events are stored in one preallocated block of fixed-size slots, one slot for each position
+ * in the active bank (so availableBars * width slots), sorted by their delay. A position which
+ * produces more events than fit in a slot has all its events stored in the overflow store instead.
+ */
+struct PlaybackSnapshot {
+    int width{16};
+    int availableBars{1};
+    int bankOffset{0};
+    int noteLength{3};
+    int overrideChannel{-1};
+    // The number of steps each position looks at (its own, and any following ones with notes that want playing before their step)
+    int lookahead{1};
+    // The number of events each slot can hold
+    int slotCapacity{0};
+    // The number of events in each position (index is the position inside the bank, so (row - bankOffset) * width + column)
+    QVector<int> eventCounts;
+    // The offset in the overflow store for positions which did not fit in their slot (or -1 for those which did)
+    QVector<int> overflowOffsets;
+    // The slots (the events for a position start at position * slotCapacity)
+    QVector<PlaybackEvent> slots;
+    QVector<PlaybackEvent> overflow;
+    /**
+     * \brief Fetch the events for the given position inside the bank
+     * @param position The position to fetch events for
+     * @param count This will be set to the number of events for that position
+     * @return A pointer to the first event (or nullptr if there are no events)
+     */
+    inline const PlaybackEvent *events(int position, int &count) const {
+        count = eventCounts.at(position);
+        if (count == 0) {
+            return nullptr;
+        }
+        const int overflowOffset{overflowOffsets.at(position)};
+        if (overflowOffset > -1) {
+            return overflow.constData() + overflowOffset;
+        }
+        return slots.constData() + (position * slotCapacity);
+    }
+};
+
+/**
+ * \brief Everything needed to build a pattern's playback snapshot
+ *
+ * This is plain data (the step table and the delay counts are implicitly shared copies of the
+ * pattern's own, so capturing it is cheap), and so once it has been captured on the pattern's
+ * thread, a snapshot can be built from it on any thread.
+ * @see PatternModel::Private::snapshotSource()
+ */
+struct PlaybackSnapshotSource {
+    QVector<StepData> stepTable;
+    QMap<int, int> negativeDelayCounts;
+    int width{16};
+    int availableBars{1};
+    int bankOffset{0};
+    int noteLength{3};
+    int overrideChannel{-1};
+    const PlaybackTiming *timing{nullptr};
+};
+
+/**
+ * \brief A pattern's playback snapshot, being built away from the pattern's own thread
+ * @see PatternModel::createPlaybackPreparation()
+ */
+class PatternPlaybackPreparation {
+public:
+    ~PatternPlaybackPreparation() {
+        delete snapshot;
+    }
+    PlaybackSnapshotSource source;
+    // The pattern's snapshotSourceVersion when the source was captured
+    quint64 sourceVersion{0};
+    PlaybackSnapshot *snapshot{nullptr};
+};
+
 #define NoteDataPoolSize 128
 struct alignas(32) NoteDataPoolEntry {
     NewNoteData *object{nullptr};
@@ -269,7 +396,9 @@ struct alignas(32) NoteDataPoolEntry {
 
 class PatternModel::Private {
 public:
-    Private() {
+    Private(PatternModel *q)
+        : q(q)
+    {
         playGridManager = PlayGridManager::instance();
         syncTimer = qobject_cast<SyncTimer*>(playGridManager->syncTimer());
 
@@ -281,21 +410,95 @@ public:
         }
         noteDataPoolReadHead = noteDataPoolWriteHead = noteDataPool;
 
-        beatSubdivision = syncTimer->getMultiplier();
-        beatSubdivision2 = beatSubdivision / 2;
-        beatSubdivision3 = beatSubdivision2 / 2;
-        beatSubdivision4 = beatSubdivision3 / 2;
-        beatSubdivision5 = beatSubdivision4 / 2;
-        beatSubdivision6 = beatSubdivision5 / 2;
+        timing = &PlaybackTiming::instance();
+        playbackBatch = playGridManager->playbackBatch();
+        playbackProfiler = playGridManager->playbackProfiler();
+
+        undoStepCloser.setInterval(0);
+        undoStepCloser.setSingleShot(true);
+        QObject::connect(&undoStepCloser, &QTimer::timeout, q, [this](){ closeUndoStep(); });
     }
     ~Private() {
         for (int i = 0; i < NoteDataPoolSize; ++i) {
             delete noteDataPool[i].object;
         }
+        delete playbackSnapshot.exchange(nullptr);
+        qDeleteAll(retiredSnapshots);
     }
+    PatternModel *q{nullptr};
     ZLPatternSynchronisationManager *zlSyncManager{nullptr};
     SegmentHandler *segmentHandler{nullptr};
-    QHash<QString, qint64> lastSavedTimes;
+    // The lastModified stamp the pattern had when it was last written to (or read from) each file
+    QHash<QString, quint64> lastSavedTimes;
+
+    // The pattern's contents from before each of the undo steps (most recent last), and the same
+    // for the steps which have been undone. These are snapshots, so they share everything with the
+    // pattern's current contents, except for the chunks of rows which have been changed since.
+    QList<NotesModelContents> undoHistory;
+    QList<NotesModelContents> redoHistory;
+    // An undo step is kept open until control returns to the event loop, so everything changed
+    // in one go ends up in the same step
+    bool undoStepOpen{false};
+    QTimer undoStepCloser;
+    // While this is above zero, changes are not recorded in the undo history (for changes which
+    // the user did not make, such as switching notes to a new midi channel)
+    int undoSuppression{0};
+    /**
+     * \brief Call this before changing the pattern's contents, to make the change undoable
+     * If there is no undo step currently open, this opens one, starting from the current contents
+     */
+    void recordUndoStep() {
+        if (undoSuppression == 0 && !undoStepOpen) {
+            undoHistory << q->contents();
+            while (undoHistory.count() > PATTERN_UNDO_HISTORY_LENGTH) {
+                undoHistory.removeFirst();
+            }
+            undoStepOpen = true;
+            undoStepCloser.start();
+        }
+    }
+    /**
+     * \brief Close the currently open undo step (if there is one)
+     * A step during which nothing actually changed is dropped, and anything else clears the redo history
+     */
+    void closeUndoStep() {
+        if (undoStepOpen) {
+            undoStepOpen = false;
+            undoStepCloser.stop();
+            if (undoHistory.last() == q->contents()) {
+                undoHistory.removeLast();
+            } else {
+                redoHistory.clear();
+                Q_EMIT q->undoHistoryChanged();
+            }
+        }
+    }
+    /**
+     * \brief Move the notes restored from the undo (or redo) history onto the pattern's midi channel
+     * The history is kept when the midi channel changes, so what it restores may be on an older channel
+     */
+    void moveRestoredNotesToMidiChannel() {
+        if (previouslyUpdatedMidiChannel > -1) {
+            bool needsMoving{false};
+            for (int row = 0; row < q->rowCount() && !needsMoving; ++row) {
+                for (int column = 0; column < q->columnCount(q->index(row, 0)) && !needsMoving; ++column) {
+                    const Note *note = qobject_cast<Note*>(q->getNote(row, column));
+                    if (note) {
+                        for (const Note *subnote : note->typedSubnotes()) {
+                            if (subnote && subnote->midiChannel() != previouslyUpdatedMidiChannel) {
+                                needsMoving = true;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            if (needsMoving) {
+                q->changeMidiChannel(previouslyUpdatedMidiChannel);
+                invalidatePosition();
+            }
+        }
+    }
     int width{16};
     PatternModel::NoteDestination noteDestination{PatternModel::SynthDestination};
     int midiChannel{15};
@@ -313,14 +516,36 @@ public:
     int playingColumn{0};
     int previouslyUpdatedMidiChannel{-1};
 
-    juce::MidiBuffer &getOrCreateBuffer(QHash<int, juce::MidiBuffer> &collection, int position);
-    void noteLengthDetails(int noteLength, quint64 &nextPosition, bool &relevantToUs, quint64 &noteDuration);
-    int beatSubdivision{0};
-    int beatSubdivision2{0};
-    int beatSubdivision3{0};
-    int beatSubdivision4{0};
-    int beatSubdivision5{0};
-    int beatSubdivision6{0};
+    const PlaybackTiming *timing{nullptr};
+    // The next tick which lands on one of our steps during playback, so we don't need to work out
+    // whether each tick is relevant to us from scratch. This is only ever touched by the timer thread.
+    struct NextRelevantTick {
+        quint64 tick{0};
+        quint64 step{0};
+        int ticksPerStep{0};
+    } nextRelevantTick;
+    /**
+     * \brief Check whether the given tick lands on one of our steps, and move the next relevant tick along if it does
+     * Playback jumping around (or the note length changing) is handled by working things out from scratch
+     * @param tick The timer tick being handled
+     * @param ticksPerStep The number of timer ticks between steps
+     * @param step If the tick lands on a step, this will be set to that step's position
+     * @return True if the tick lands on a step, false if not
+     */
+    inline bool advanceToTick(quint64 tick, int ticksPerStep, quint64 &step) {
+        if (nextRelevantTick.ticksPerStep != ticksPerStep || tick > nextRelevantTick.tick || nextRelevantTick.tick - tick >= quint64(ticksPerStep)) {
+            nextRelevantTick.ticksPerStep = ticksPerStep;
+            nextRelevantTick.step = (tick + ticksPerStep - 1) / ticksPerStep;
+            nextRelevantTick.tick = nextRelevantTick.step * ticksPerStep;
+        }
+        if (tick == nextRelevantTick.tick) {
+            step = nextRelevantTick.step;
+            nextRelevantTick.tick += ticksPerStep;
+            ++nextRelevantTick.step;
+            return true;
+        }
+        return false;
+    }
 
     bool recordingLive{false};
     QList<NewNoteData*> recordingLiveNotes;
@@ -328,41 +553,167 @@ public:
     NoteDataPoolEntry *noteDataPoolReadHead{nullptr};
     NoteDataPoolEntry *noteDataPoolWriteHead{nullptr};
 
-    // This bunch of lists is equivalent to the data found in each note, and is
-    // stored per-position (index in the outer is row * width + column). The
-    // must be cleared on any change of the notes (which should always be done
-    // through setNote and setMetadata to ensure this). If they are not cleared
-    // on changes, what ends up sent to SyncTimer during playback will not match
-    // what the model contains. So, remember your pattern hygiene and clean your
-    // buffers!
-    // The inner hash contains commands for the given position, with the key being
-    // the on-position delay (so that iterating over the hash gives the scheduling
-    // delay for that buffer, and the buffer).
-    QHash<int, QHash<int, juce::MidiBuffer> > positionBuffers;
-    // Handy variable in case we want to adjust how far ahead we're looking sometime
-    // in the future (right now it's one step ahead, but we could look further if we
-    // wanted to)
-    static const int lookaheadAmount{2};
+    // The compiled form of the pattern's contents, stored per-position (index is
+    // row * width + column). This is what the playback code reads from when it
+    // fills the position buffers below, and it is kept up to date by compileStep
+    // and compileAllSteps, which are in turn called by invalidatePosition.
+    QVector<StepData> stepTable;
     /**
-     * \brief Invalidates the position buffers relevant to the given position
-     * If you give -1 for the two position indicators, the entire list of buffers
-     * will be invalidated.
-     * This function is required to ensure that all buffers the position could
-     * have an impact on (including those which are before it) are invalidated.
+     * \brief Rebuild the compiled step data for the given position from the model's notes and metadata
+     * @param row The row of the position to compile
+     * @param column The column of the position to compile
+     */
+    void compileStep(int row, int column);
+    /**
+     * \brief Rebuild the compiled step data for the entire pattern
+     */
+    void compileAllSteps();
+    // The number of steps whose earliest delay is each of the negative delays in the
+    // pattern (so the first key is the most negative delay in the entire pattern).
+    // This is kept up to date by compileStep, and used to work out how many steps
+    // ahead we need to look to catch every note which wants playing before its step.
+    QMap<int, int> negativeDelayCounts;
+    /**
+     * \brief The number of steps a position needs to look at to include all notes which should be played from it
+     * This is always at least one (the position's own step), plus however many steps are needed to
+     * reach back to the pattern's most negative delay.
+     * @param source The pattern data the snapshot is being built from
+     * @param noteDuration The duration of a step at the pattern's current note length
+     */
+    static int lookaheadAmount(const PlaybackSnapshotSource &source, int noteDuration) {
+        int lookahead{1};
+        if (noteDuration > 0 && !source.negativeDelayCounts.isEmpty()) {
+            const int earliestDelay{-source.negativeDelayCounts.firstKey()};
+            lookahead += (earliestDelay + noteDuration - 1) / noteDuration;
+        }
+        // There's no point looking further ahead than the whole of the playable part of the pattern
+        return qMin(lookahead, source.availableBars * source.width);
+    }
+
+    // The snapshot currently used by the timer thread for playback. This must only
+    // ever be replaced using publishSnapshot, and only be read using acquireSnapshot.
+    std::atomic<PlaybackSnapshot*> playbackSnapshot{nullptr};
+    // The snapshot the timer thread most recently started reading from. Any retired
+    // snapshot which matches this cannot be deleted yet.
+    mutable std::atomic<PlaybackSnapshot*> snapshotInUse{nullptr};
+    // Snapshots which have been replaced, but which have not been deleted yet
+    QList<PlaybackSnapshot*> retiredSnapshots;
+    // Coalesces the snapshot publishing, so bulk changes only result in a single snapshot
+    QTimer *snapshotPublisher{nullptr};
+    // The per-tick batch our events are handed to during playback (owned by PlayGridManager)
+    PlaybackBatch *playbackBatch{nullptr};
+    // The profiler our advancement timings are recorded with (owned by PlayGridManager)
+    PlaybackProfiler *playbackProfiler{nullptr};
+    // This pattern's own advancement timings, recorded alongside the profiler's pattern stage
+    PlaybackHistogram playbackTimings;
+    // Whether the most recently published snapshot contains any events at all
+    bool snapshotHasEvents{false};
+    bool canProduceEvents{false};
+    /**
+     * \brief Update the pattern's canProduceEvents state, and emit the change signal if it changed
+     */
+    void updateCanProduceEvents() {
+        const bool newCanProduceEvents{snapshotHasEvents && isPlaying && !zlSyncManager->channelMuted
+            // Looped samples don't get any notes sent to them, so we don't need to play those
+            && noteDestination != PatternModel::SampleLoopedDestination
+            && (noteDestination == PatternModel::SampleSlicedDestination || noteDestination == PatternModel::SampleTriggerDestination
+                || (midiChannel > -1 && midiChannel < 15)
+                || playGridManager->currentMidiChannel() > -1
+            )
+        };
+        if (canProduceEvents != newCanProduceEvents) {
+            canProduceEvents = newCanProduceEvents;
+            Q_EMIT q->canProduceEventsChanged();
+        }
+    }
+    /**
+     * \brief Capture the pattern's current step table and playback settings, for building a snapshot from
+     * This must be called on the pattern's own thread
+     */
+    PlaybackSnapshotSource snapshotSource() const;
+    // Counts the changes which affect playback, so a snapshot built from an older source can be recognised as out of date
+    quint64 snapshotSourceVersion{0};
+    /**
+     * \brief Build a new snapshot from the given source
+     * This touches nothing but the source, and so it is safe to call from any thread
+     * @return A new snapshot, which the caller takes ownership of (usually by passing it to publishSnapshot)
+     */
+    static PlaybackSnapshot *buildSnapshot(const PlaybackSnapshotSource &source);
+    /**
+     * \brief Hand the given snapshot to the timer thread, replacing the current one
+     * This must only be called from the UI thread
+     * @param snapshot The snapshot to publish (ownership is taken over by the pattern)
+     */
+    void publishSnapshot(PlaybackSnapshot *snapshot);
+    /**
+     * \brief Gather the events for a single position inside the active bank
+     * @param source The pattern data the snapshot is being built from
+     * @param events The list the events will be appended to (they will be sorted by delay)
+     * @param position The position inside the active bank (so (row - bankOffset) * width + column)
+     * @param noteDuration The duration of a step at the pattern's current note length
+     * @param lookahead The number of steps to look at (see lookaheadAmount())
+     */
+    static void gatherPositionEvents(const PlaybackSnapshotSource &source, QVector<PlaybackEvent> &events, int position, int noteDuration, int lookahead);
+    /**
+     * \brief Fetch the snapshot the timer thread should use for playback
+     * This does not block, and does not allocate. The snapshot returned is guaranteed to stay valid
+     * until the next call to this function, which must happen on the same (the timer) thread.
+     * @return The current playback snapshot (or nullptr if none has been published yet)
+     */
+    const PlaybackSnapshot *acquireSnapshot() const {
+        PlaybackSnapshot *snapshot = playbackSnapshot.load();
+        while (true) {
+            snapshotInUse.store(snapshot);
+            PlaybackSnapshot *current = playbackSnapshot.load();
+            if (current == snapshot) {
+                break;
+            }
+            snapshot = current;
+        }
+        return snapshot;
+    }
+    /**
+     * \brief Marks the playback snapshot as needing a rebuild
+     * Use this when something which is not the notes themselves, but which affects playback, has changed
+     */
+    void invalidateSnapshot() {
+        ++snapshotSourceVersion;
+        if (snapshotPublisher) {
+            snapshotPublisher->start();
+        }
+    }
+    /**
+     * \brief Invalidates the playback data relevant to the given position
+     * If you give -1 for the two position indicators, the entire pattern will be invalidated.
+     * This recompiles the step data for the position (or all of them, if the whole pattern is
+     * invalidated), and schedules a new playback snapshot. Call it after changing the data, and
+     * remember your pattern hygiene: if it isn't called on changes, what ends up sent to SyncTimer
+     * during playback will not match what the model contains.
      * @param row The row of the position to invalidate
      * @param column The column of the position to invalidate
      */
    void invalidatePosition(int row = -1, int column = -1) {
         if (row == -1 || column == -1) {
-            positionBuffers.clear();
+            compileAllSteps();
         } else {
-            const int basePosition = (row * width) + column;
-            for (int subsequentNoteIndex = 0; subsequentNoteIndex < lookaheadAmount; ++subsequentNoteIndex) {
-                // We clear backwards, just because might as well (by subtracting the subsequentNoteIndex from our base position)
-                int ourPosition = (basePosition - subsequentNoteIndex) % (availableBars * width);
-                positionBuffers.remove(ourPosition);
-            }
+            compileStep(row, column);
+        }
+        invalidateSnapshot();
+    }
+    /**
+     * \brief The subnote metadata for the given position, for changing along with its subnotes
+     * If the position's metadata does not match the subnotes (or there is none), this returns
+     * metadata for the given number of subnotes, none of which have any metadata set.
+     * @param row The row of the position to fetch the metadata for
+     * @param column The column of the position to fetch the metadata for
+     * @param subnoteCount The number of subnotes on the position
+     */
+    SubnoteMetadata subnoteMetadata(int row, int column, int subnoteCount) const {
+        const SubnoteMetadata metadata{q->getTypedMetadata(row, column)};
+        if (metadata.isNull() || metadata.count() != subnoteCount) {
+            return SubnoteMetadata(subnoteCount);
         }
+        return metadata;
     }
 
     SyncTimer* syncTimer{nullptr};
@@ -427,10 +778,14 @@ public:
 
 PatternModel::PatternModel(SequenceModel* parent)
     : NotesModel(parent ? parent->playGridManager() : nullptr)
-    , d(new Private)
+    , d(new Private(this))
 {
     d->zlSyncManager = new ZLPatternSynchronisationManager(this);
     d->segmentHandler = SegmentHandler::instance();
+    d->snapshotPublisher = new QTimer(this);
+    d->snapshotPublisher->setInterval(0);
+    d->snapshotPublisher->setSingleShot(true);
+    connect(d->snapshotPublisher, &QTimer::timeout, this, [this](){ d->publishSnapshot(Private::buildSnapshot(d->snapshotSource())); });
 
     auto updateIsPlaying = [this](){
         bool isPlaying{false};
@@ -456,6 +811,11 @@ PatternModel::PatternModel(SequenceModel* parent)
         }
     });
     connect(this, &PatternModel::enabledChanged, this, updateIsPlaying);
+    auto updateCanProduceEvents = [this](){ d->updateCanProduceEvents(); };
+    connect(this, &PatternModel::isPlayingChanged, this, updateCanProduceEvents);
+    connect(this, &PatternModel::midiChannelChanged, this, updateCanProduceEvents);
+    connect(this, &PatternModel::noteDestinationChanged, this, updateCanProduceEvents);
+    connect(d->playGridManager, &PlayGridManager::currentMidiChannelChanged, this, updateCanProduceEvents);
 
     // We need to make sure that we support orphaned patterns (that is, a pattern that is not contained within a sequence)
     d->sequence = parent;
@@ -486,7 +846,9 @@ PatternModel::PatternModel(SequenceModel* parent)
         });
     }
     // This will force the creation of a whole bunch of rows with the desired width and whatnot...
+    ++d->undoSuppression;
     setHeight(16);
+    --d->undoSuppression;
 
     connect(this, &PatternModel::noteDestinationChanged, this, &NotesModel::registerChange);
     connect(this, &PatternModel::midiChannelChanged, this, &NotesModel::registerChange);
@@ -535,31 +897,48 @@ PatternModel::PatternModel(SequenceModel* parent)
             MidiRouter::instance()->setChannelDestination(d->midiChannel, routerDestination, actualChannel == d->midiChannel ? -1 : actualChannel);
         }
         if (d->previouslyUpdatedMidiChannel != d->midiChannel) {
-            startLongOperation();
+            // Work out what needs moving first, as there is nothing to do when the notes are already on the
+            // channel (such as when the pattern was just loaded), and that should not count as changing them
+            QVector<QPoint> movedPositions;
+            QVector<Note*> movedNotes;
             for (int row = 0; row < rowCount(); ++row) {
                 for (int column = 0; column < columnCount(createIndex(row, 0)); ++column) {
                     Note* oldCompound = qobject_cast<Note*>(getNote(row, column));
-                    QVariantList newSubnotes;
+                    QVector<Note*> newSubnotes;
                     if (oldCompound) {
-                        const QVariantList &oldSubnotes = oldCompound->subnotes();
+                        const QVector<Note*> &oldSubnotes = oldCompound->typedSubnotes();
                         if (oldSubnotes.count() > 0) {
-                            for (const QVariant &subnote :oldCompound->subnotes()) {
-                                Note *oldNote = subnote.value<Note*>();
+                            newSubnotes.reserve(oldSubnotes.count());
+                            for (const Note *oldNote : oldSubnotes) {
                                 if (oldNote) {
-                                    newSubnotes << QVariant::fromValue<QObject*>(playGridManager()->getNote(oldNote->midiNote(), d->midiChannel));
+                                    newSubnotes << qobject_cast<Note*>(playGridManager()->getNote(oldNote->midiNote(), d->midiChannel));
                                 } else {
                                     // This really shouldn't happen - spit out a warning and slap in something unknown so we keep the order intact
-                                    newSubnotes << QVariant::fromValue<QObject*>(playGridManager()->getNote(0, d->midiChannel));
+                                    newSubnotes << qobject_cast<Note*>(playGridManager()->getNote(0, d->midiChannel));
                                     qWarning() << "Failed to convert a subnote value which must be a Note object to a Note object - something clearly isn't right.";
                                 }
                             }
-                            setNote(row, column, playGridManager()->getCompoundNote(newSubnotes));
+                            Note *newCompound = playGridManager()->getCompoundNote(newSubnotes);
+                            if (newCompound != oldCompound) {
+                                movedPositions << QPoint(column, row);
+                                movedNotes << newCompound;
+                            }
                         }
                     }
                 }
             }
-            endLongOperation();
-            d->invalidatePosition();
+            if (!movedPositions.isEmpty()) {
+                startLongOperation();
+                // This is not a change the user made to the notes, so it is not an undo step. The notes
+                // in the undo history stay on the old channel, and are moved across when they are restored.
+                ++d->undoSuppression;
+                for (int index = 0; index < movedPositions.count(); ++index) {
+                    setNote(movedPositions[index].y(), movedPositions[index].x(), movedNotes[index]);
+                }
+                --d->undoSuppression;
+                endLongOperation();
+                d->invalidatePosition();
+            }
             d->previouslyUpdatedMidiChannel = d->midiChannel;
         }
     });
@@ -595,9 +974,8 @@ PatternModel::~PatternModel()
 void PatternModel::cloneOther(PatternModel *otherPattern)
 {
     if (otherPattern) {
-        clear();
-        setWidth(otherPattern->width());
-        setHeight(otherPattern->height());
+        startLongOperation();
+        d->recordUndoStep();
         setMidiChannel(otherPattern->midiChannel());
         setLayerData(otherPattern->layerData());
         setNoteLength(otherPattern->noteLength());
@@ -607,10 +985,9 @@ void PatternModel::cloneOther(PatternModel *otherPattern)
         setBankLength(otherPattern->bankLength());
         setEnabled(otherPattern->enabled());
 
-        // Now clone all the notes
-        for (int i = 0; i < rowCount(); ++i) {
-            setRowData(i, otherPattern->getRow(i), otherPattern->getRowMetadata(i));
-        }
+        // Now clone all the notes (the two patterns share them until either is changed)
+        setContents(otherPattern->contents());
+        endLongOperation();
     }
 }
 
@@ -620,8 +997,9 @@ int PatternModel::subnoteIndex(int row, int column, int midiNote) const
     if (row > -1 && row < height() && column > -1 && column < width()) {
         const Note* note = qobject_cast<Note*>(getNote(row, column));
         if (note) {
-            for (int i = 0; i < note->subnotes().count(); ++i) {
-                const Note* subnote = note->subnotes().at(i).value<Note*>();
+            const QVector<Note*> &subnotes = note->typedSubnotes();
+            for (int i = 0; i < subnotes.count(); ++i) {
+                const Note* subnote = subnotes[i];
                 if (subnote && subnote->midiNote() == midiNote) {
                     result = i;
                     break;
@@ -637,12 +1015,11 @@ int PatternModel::addSubnote(int row, int column, QObject* note)
     int newPosition{-1};
     if (row > -1 && row < height() && column > -1 && column < width() && note) {
         Note* oldCompound = qobject_cast<Note*>(getNote(row, column));
-        QVariantList subnotes;
-        QVariantList metadata;
+        QVector<Note*> subnotes;
         if (oldCompound) {
-            subnotes = oldCompound->subnotes();
-            metadata = getMetadata(row, column).toList();
+            subnotes = oldCompound->typedSubnotes();
         }
+        SubnoteMetadata metadata{d->subnoteMetadata(row, column, subnotes.count())};
         newPosition = subnotes.count();
 
         // Ensure the note is correct according to our midi channel settings
@@ -651,10 +1028,10 @@ int PatternModel::addSubnote(int row, int column, QObject* note)
             newNote = qobject_cast<Note*>(playGridManager()->getNote(newNote->midiNote(), d->midiChannel));
         }
 
-        subnotes.append(QVariant::fromValue<QObject*>(newNote));
-        metadata.append(QVariantHash());
+        subnotes.append(newNote);
+        metadata.append();
         setNote(row, column, playGridManager()->getCompoundNote(subnotes));
-        setMetadata(row, column, metadata);
+        setTypedMetadata(row, column, metadata);
     }
     return newPosition;
 }
@@ -663,14 +1040,13 @@ void PatternModel::insertSubnote(int row, int column, int subnoteIndex, QObject
 {
     if (row > -1 && row < height() && column > -1 && column < width() && note) {
         Note* oldCompound = qobject_cast<Note*>(getNote(row, column));
-        QVariantList subnotes;
-        QVariantList metadata;
+        QVector<Note*> subnotes;
         int actualPosition{0};
         if (oldCompound) {
-            subnotes = oldCompound->subnotes();
-            metadata = getMetadata(row, column).toList();
+            subnotes = oldCompound->typedSubnotes();
             actualPosition = qMin(subnoteIndex, subnotes.count());
         }
+        SubnoteMetadata metadata{d->subnoteMetadata(row, column, subnotes.count())};
 
         // Ensure the note is correct according to our midi channel settings
         Note *newNote = qobject_cast<Note*>(note);
@@ -678,10 +1054,10 @@ void PatternModel::insertSubnote(int row, int column, int subnoteIndex, QObject
             newNote = qobject_cast<Note*>(playGridManager()->getNote(newNote->midiNote(), d->midiChannel));
         }
 
-        subnotes.insert(actualPosition, QVariant::fromValue<QObject*>(newNote));
-        metadata.insert(actualPosition, QVariantHash());
+        subnotes.insert(actualPosition, newNote);
+        metadata.insert(actualPosition);
         setNote(row, column, playGridManager()->getCompoundNote(subnotes));
-        setMetadata(row, column, metadata);
+        setTypedMetadata(row, column, metadata);
     }
 }
 
@@ -691,13 +1067,11 @@ int PatternModel::insertSubnoteSorted(int row, int column, QObject* note)
     if (row > -1 && row < height() && column > -1 && column < width() && note) {
         Note *newNote = qobject_cast<Note*>(note);
         Note* oldCompound = qobject_cast<Note*>(getNote(row, column));
-        QVariantList subnotes;
-        QVariantList metadata;
+        QVector<Note*> subnotes;
         if (oldCompound) {
-            subnotes = oldCompound->subnotes();
-            metadata = getMetadata(row, column).toList();
+            subnotes = oldCompound->typedSubnotes();
             for (int i = 0; i < subnotes.count(); ++i) {
-                const Note* subnote = subnotes[i].value<Note*>();
+                const Note* subnote = subnotes[i];
                 if (subnote->midiNote() <= newNote->midiNote()) {
                     newPosition = i + 1;
                 } else {
@@ -706,15 +1080,17 @@ int PatternModel::insertSubnoteSorted(int row, int column, QObject* note)
             }
         }
 
+        SubnoteMetadata metadata{d->subnoteMetadata(row, column, subnotes.count())};
+
         // Ensure the note is correct according to our midi channel settings
         if (newNote->midiChannel() != d->midiChannel) {
             newNote = qobject_cast<Note*>(playGridManager()->getNote(newNote->midiNote(), d->midiChannel));
         }
 
-        subnotes.insert(newPosition, QVariant::fromValue<QObject*>(newNote));
-        metadata.insert(newPosition, QVariantHash());
+        subnotes.insert(newPosition, newNote);
+        metadata.insert(newPosition);
         setNote(row, column, playGridManager()->getCompoundNote(subnotes));
-        setMetadata(row, column, metadata);
+        setTypedMetadata(row, column, metadata);
     }
     return newPosition;
 }
@@ -723,46 +1099,30 @@ void PatternModel::removeSubnote(int row, int column, int subnote)
 {
     if (row > -1 && row < height() && column > -1 && column < width()) {
         Note* oldCompound = qobject_cast<Note*>(getNote(row, column));
-        QVariantList subnotes;
-        QVariantList metadata;
+        QVector<Note*> subnotes;
         if (oldCompound) {
-            subnotes = oldCompound->subnotes();
-            metadata = getMetadata(row, column).toList();
+            subnotes = oldCompound->typedSubnotes();
         }
+        SubnoteMetadata metadata{d->subnoteMetadata(row, column, subnotes.count())};
         if (subnote > -1 && subnote < subnotes.count()) {
             subnotes.removeAt(subnote);
             metadata.removeAt(subnote);
         }
         setNote(row, column, playGridManager()->getCompoundNote(subnotes));
-        setMetadata(row, column, metadata);
+        setTypedMetadata(row, column, metadata);
     }
 }
 
 void PatternModel::setSubnoteMetadata(int row, int column, int subnote, const QString& key, const QVariant& value)
 {
     if (row > -1 && row < height() && column > -1 && column < width()) {
-        const QVariant rawMeta(getMetadata(row, column).toList());
-        QVariantList metadata;
-        if (rawMeta.isValid() && rawMeta.canConvert<QVariantList>()) {
-            metadata = rawMeta.toList();
-        } else {
-            Note *note = qobject_cast<Note*>(getNote(row, column));
-            if (note) {
-                for (int i = 0; i < note->subnotes().count(); ++i) {
-                    metadata << QVariantHash();
-                }
-            }
-        }
-        if (subnote > -1 && subnote < metadata.count()) {
-            QVariantHash noteMetadata = metadata.at(subnote).toHash();
-            if (value.isValid()) {
-                noteMetadata[key] = value;
-            } else {
-                noteMetadata.remove(key);
-            }
-            metadata[subnote] = noteMetadata;
+        SubnoteMetadata metadata{getTypedMetadata(row, column)};
+        if (metadata.isNull()) {
+            const Note *note = qobject_cast<Note*>(getNote(row, column));
+            metadata = SubnoteMetadata(note ? note->subnoteCount() : 0);
         }
-        setMetadata(row, column, metadata);
+        metadata.setValue(subnote, key, value);
+        setTypedMetadata(row, column, metadata);
     }
 }
 
@@ -770,17 +1130,17 @@ QVariant PatternModel::subnoteMetadata(int row, int column, int subnote, const Q
 {
     QVariant result;
     if (row > -1 && row < height() && column > -1 && column < width()) {
-        const QVariantList metadata = getMetadata(row, column).toList();
+        const SubnoteMetadata metadata{getTypedMetadata(row, column)};
         if (subnote > -1 && subnote < metadata.count()) {
             if (key.isEmpty()) {
-                const QVariantHash rawMeta = metadata.at(subnote).toHash();
+                const QVariantHash rawMeta = metadata.hash(subnote);
                 QVariantMap qmlFriendlyMeta;
                 for (const QString &key : rawMeta.keys()) {
                     qmlFriendlyMeta[key] = rawMeta[key];
                 }
                 result.setValue(qmlFriendlyMeta);
             } else {
-                result.setValue(metadata.at(subnote).toHash().value(key));
+                result = metadata.value(subnote, key);
             }
         }
     }
@@ -789,14 +1149,162 @@ QVariant PatternModel::subnoteMetadata(int row, int column, int subnote, const Q
 
 void PatternModel::setNote(int row, int column, QObject* note)
 {
-    d->invalidatePosition(row, column);
+    d->recordUndoStep();
     NotesModel::setNote(row, column, note);
+    d->invalidatePosition(row, column);
 }
 
 void PatternModel::setMetadata(int row, int column, QVariant metadata)
 {
-    d->invalidatePosition(row, column);
+    d->recordUndoStep();
     NotesModel::setMetadata(row, column, metadata);
+    d->invalidatePosition(row, column);
+}
+
+void PatternModel::setTypedMetadata(int row, int column, const SubnoteMetadata &metadata)
+{
+    d->recordUndoStep();
+    NotesModel::setTypedMetadata(row, column, metadata);
+    d->invalidatePosition(row, column);
+}
+
+void PatternModel::setContents(const NotesModelContents &contents)
+{
+    d->recordUndoStep();
+    NotesModel::setContents(contents);
+    d->invalidatePosition();
+}
+
+void PatternModel::contentsAboutToChange()
+{
+    d->recordUndoStep();
+}
+
+void PatternModel::contentsChanged()
+{
+    d->invalidatePosition();
+}
+
+// The state of a position changed by a PatternTransaction, as it will be once the transaction is committed
+struct PatternTransactionPosition {
+    int row{0};
+    int column{0};
+    QVector<Note*> subnotes;
+    SubnoteMetadata metadata;
+};
+
+class PatternTransactionPrivate {
+public:
+    PatternTransactionPrivate(PatternModel *pattern)
+        : pattern(pattern)
+    {}
+    QPointer<PatternModel> pattern;
+    // The changed positions, ordered by row and then column (see positionKey())
+    QMap<qint64, PatternTransactionPosition> positions;
+
+    static inline qint64 positionKey(int row, int column) {
+        return (qint64(row) << 32) | quint32(column);
+    }
+    bool isValidPosition(int row, int column) const {
+        return pattern && row > -1 && row < pattern->height() && column > -1 && column < pattern->width();
+    }
+    // Fetch the transaction's version of the position, starting from what is in the pattern the first time it is needed
+    PatternTransactionPosition &position(int row, int column) {
+        const qint64 key{positionKey(row, column)};
+        QMap<qint64, PatternTransactionPosition>::iterator existing = positions.find(key);
+        if (existing == positions.end()) {
+            PatternTransactionPosition newPosition;
+            newPosition.row = row;
+            newPosition.column = column;
+            const Note *note = qobject_cast<const Note*>(pattern->getNote(row, column));
+            if (note) {
+                newPosition.subnotes = note->typedSubnotes();
+            }
+            newPosition.metadata = pattern->d->subnoteMetadata(row, column, newPosition.subnotes.count());
+            existing = positions.insert(key, newPosition);
+        }
+        return existing.value();
+    }
+};
+
+PatternTransaction::PatternTransaction(PatternModel *pattern)
+    : d(new PatternTransactionPrivate(pattern))
+{
+}
+
+PatternTransaction::~PatternTransaction()
+{
+    delete d;
+}
+
+int PatternTransaction::addSubnote(int row, int column, QObject *note)
+{
+    int newPosition{-1};
+    Note *newNote = qobject_cast<Note*>(note);
+    if (d->isValidPosition(row, column) && newNote) {
+        PatternTransactionPosition &position = d->position(row, column);
+        // Ensure the note is correct according to the pattern's midi channel settings
+        if (newNote->midiChannel() != d->pattern->d->midiChannel) {
+            newNote = qobject_cast<Note*>(d->pattern->playGridManager()->getNote(newNote->midiNote(), d->pattern->d->midiChannel));
+        }
+        newPosition = position.subnotes.count();
+        position.subnotes.append(newNote);
+        position.metadata.append();
+    }
+    return newPosition;
+}
+
+void PatternTransaction::removeSubnote(int row, int column, int subnote)
+{
+    if (d->isValidPosition(row, column)) {
+        PatternTransactionPosition &position = d->position(row, column);
+        if (subnote > -1 && subnote < position.subnotes.count()) {
+            position.subnotes.removeAt(subnote);
+            position.metadata.removeAt(subnote);
+        }
+    }
+}
+
+void PatternTransaction::setSubnoteMetadata(int row, int column, int subnote, const QString &key, const QVariant &value)
+{
+    if (d->isValidPosition(row, column)) {
+        d->position(row, column).metadata.setValue(subnote, key, value);
+    }
+}
+
+int PatternTransaction::commit()
+{
+    int changedPositions{0};
+    PatternModel *pattern = d->pattern;
+    if (pattern && d->positions.count() > 0) {
+        pattern->d->recordUndoStep();
+        pattern->beginPositionChanges();
+        for (const PatternTransactionPosition &position : qAsConst(d->positions)) {
+            // The pattern's size may have changed since the position was first touched
+            if (!d->isValidPosition(position.row, position.column)) {
+                continue;
+            }
+            QObject *compoundNote = pattern->playGridManager()->getCompoundNote(position.subnotes);
+            if (compoundNote != pattern->getNote(position.row, position.column) || position.metadata != pattern->getTypedMetadata(position.row, position.column)) {
+                // Set these on NotesModel directly, so the playback data is only compiled once below
+                pattern->NotesModel::setNote(position.row, position.column, compoundNote);
+                pattern->NotesModel::setTypedMetadata(position.row, position.column, position.metadata);
+                pattern->d->compileStep(position.row, position.column);
+                ++changedPositions;
+            }
+        }
+        pattern->endPositionChanges();
+        if (changedPositions > 0) {
+            pattern->d->invalidateSnapshot();
+        }
+    }
+    d->positions.clear();
+    return changedPositions;
+}
+
+void PatternTransaction::discard()
+{
+    d->positions.clear();
 }
 
 void PatternModel::resetPattern(bool clearNotes)
@@ -847,9 +1355,57 @@ void PatternModel::clearBank(int bank)
     endLongOperation();
 }
 
+void PatternModel::undo()
+{
+    d->closeUndoStep();
+    if (!d->undoHistory.isEmpty()) {
+        d->redoHistory << contents();
+        ++d->undoSuppression;
+        setContents(d->undoHistory.takeLast());
+        d->moveRestoredNotesToMidiChannel();
+        --d->undoSuppression;
+        Q_EMIT undoHistoryChanged();
+    }
+}
+
+void PatternModel::redo()
+{
+    d->closeUndoStep();
+    if (!d->redoHistory.isEmpty()) {
+        d->undoHistory << contents();
+        ++d->undoSuppression;
+        setContents(d->redoHistory.takeLast());
+        d->moveRestoredNotesToMidiChannel();
+        --d->undoSuppression;
+        Q_EMIT undoHistoryChanged();
+    }
+}
+
+void PatternModel::clearUndoHistory()
+{
+    d->undoStepOpen = false;
+    d->undoStepCloser.stop();
+    if (!d->undoHistory.isEmpty() || !d->redoHistory.isEmpty()) {
+        d->undoHistory.clear();
+        d->redoHistory.clear();
+        Q_EMIT undoHistoryChanged();
+    }
+}
+
+bool PatternModel::canUndo() const
+{
+    return !d->undoHistory.isEmpty();
+}
+
+bool PatternModel::canRedo() const
+{
+    return !d->redoHistory.isEmpty();
+}
+
 void PatternModel::setWidth(int width)
 {
     startLongOperation();
+    d->recordUndoStep();
     if (this->width() < width) {
         // Force these to exist if wider than current
         for (int row = 0; row < height(); ++row) {
@@ -867,24 +1423,58 @@ void PatternModel::setWidth(int width)
             setRowData(row, rowNotes, rowMetadata);
         }
     }
+    d->invalidatePosition();
     endLongOperation();
 }
 
 bool PatternModel::exportToFile(const QString &fileName) const
 {
     bool success{false};
-    QFile patternFile(fileName);
-    if (!d->lastSavedTimes.contains(fileName) || d->lastSavedTimes[fileName] < lastModified()) {
+    if (hasUnsavedChanges(fileName)) {
+        // Take the stamp before writing, so a change made while writing is not mistaken for having been saved
+        const quint64 savedTime{lastModified()};
+        QSaveFile patternFile(fileName);
         if (patternFile.open(QIODevice::WriteOnly)) {
             patternFile.write(playGridManager()->modelToJson(this).toUtf8());
-            patternFile.close();
+            if (patternFile.commit()) {
+                success = true;
+                d->lastSavedTimes[fileName] = savedTime;
+            }
+        }
+    }
+    return success;
+}
+
+bool PatternModel::exportToBinaryFile(const QString &fileName) const
+{
+    bool success{false};
+    if (hasUnsavedChanges(fileName)) {
+        const quint64 savedTime{lastModified()};
+        if (PatternFile::write(this, fileName)) {
             success = true;
-            d->lastSavedTimes[fileName] = QDateTime::currentMSecsSinceEpoch();
+            d->lastSavedTimes[fileName] = savedTime;
         }
     }
     return success;
 }
 
+bool PatternModel::hasUnsavedChanges(const QString &fileName) const
+{
+    const QHash<QString, quint64>::const_iterator savedTime = d->lastSavedTimes.constFind(fileName);
+    return savedTime == d->lastSavedTimes.constEnd() || savedTime.value() != lastModified();
+}
+
+void PatternModel::markAsSaved(const QString &fileName)
+{
+    flushChanges();
+    d->lastSavedTimes[fileName] = lastModified();
+}
+
+void PatternModel::markAsSaved(const QString &fileName, quint64 savedTime)
+{
+    d->lastSavedTimes[fileName] = savedTime;
+}
+
 QObject* PatternModel::sequence() const
 {
     return d->sequence;
@@ -962,6 +1552,7 @@ int PatternModel::width() const
 void PatternModel::setHeight(int height)
 {
     startLongOperation();
+    d->recordUndoStep();
     if (this->height() < height) {
         // Force these to exist if taller than current
         for (int i = this->height(); i < height; ++i) {
@@ -1054,6 +1645,7 @@ void PatternModel::setAvailableBars(int availableBars)
     int adjusted = qMin(qMax(1, availableBars), bankLength());
     if (d->availableBars != adjusted) {
         d->availableBars = adjusted;
+        d->invalidateSnapshot();
         Q_EMIT availableBarsChanged();
         // Ensure that we don't have an active bar that's outside our available range
         setActiveBar(qMin(d->activeBar, d->availableBars - 1));
@@ -1107,6 +1699,7 @@ void PatternModel::setBankOffset(int bankOffset)
 {
     if (d->bankOffset != bankOffset) {
         d->bankOffset = bankOffset;
+        d->invalidateSnapshot();
         Q_EMIT bankOffsetChanged();
     }
 }
@@ -1134,15 +1727,10 @@ int PatternModel::bankLength() const
 bool PatternModel::bankHasNotes(int bankIndex) const
 {
     bool hasNotes{false};
-    for (int row = 0; row < d->bankLength; ++row) {
-        for (int column = 0; column < d->width; ++column) {
-            Note* note = qobject_cast<Note*>(getNote(row + (bankIndex * d->bankLength), column));
-            if (note && note->subnotes().length() > 0) {
-                hasNotes = true;
-                break;
-            }
-        }
-        if (hasNotes) {
+    const int bankStart{bankIndex * d->bankLength};
+    for (int row = bankStart; row < bankStart + d->bankLength; ++row) {
+        if (rowSubnotePositionCount(row) > 0) {
+            hasNotes = true;
             break;
         }
     }
@@ -1151,20 +1739,7 @@ bool PatternModel::bankHasNotes(int bankIndex) const
 
 bool PatternModel::hasNotes() const
 {
-    bool hasNotes{false};
-    for (int row = 0; row < rowCount(); ++row) {
-        for (int column = 0; column < d->width; ++column) {
-            Note* note = qobject_cast<Note*>(getNote(row , column));
-            if (note && note->subnotes().length() > 0) {
-                hasNotes = true;
-                break;
-            }
-        }
-        if (hasNotes) {
-            break;
-        }
-    }
-    return hasNotes;
+    return subnotePositionCount() > 0;
 }
 
 bool PatternModel::currentBankHasNotes() const
@@ -1477,13 +2052,54 @@ bool PatternModel::isPlaying() const
     return d->isPlaying;
 }
 
+bool PatternModel::canProduceEvents() const
+{
+    return d->canProduceEvents;
+}
+
+PlaybackHistogram *PatternModel::playbackTimings() const
+{
+    return &d->playbackTimings;
+}
+
+bool PatternModel::needsPlaybackPreparation() const
+{
+    return d->playbackSnapshot.load() == nullptr || d->snapshotPublisher->isActive();
+}
+
+QSharedPointer<PatternPlaybackPreparation> PatternModel::createPlaybackPreparation()
+{
+    // The preparation covers anything which was waiting to be published, so don't also build that here
+    d->snapshotPublisher->stop();
+    QSharedPointer<PatternPlaybackPreparation> preparation{new PatternPlaybackPreparation};
+    preparation->source = d->snapshotSource();
+    preparation->sourceVersion = d->snapshotSourceVersion;
+    return preparation;
+}
+
+void PatternModel::preparePlayback(const QSharedPointer<PatternPlaybackPreparation> &preparation)
+{
+    delete preparation->snapshot;
+    preparation->snapshot = Private::buildSnapshot(preparation->source);
+}
+
+bool PatternModel::commitPreparedPlayback(const QSharedPointer<PatternPlaybackPreparation> &preparation)
+{
+    // If the pattern has changed since the preparation was made, that change has already scheduled a new snapshot
+    if (preparation->snapshot && preparation->sourceVersion == d->snapshotSourceVersion) {
+        d->publishSnapshot(preparation->snapshot);
+        preparation->snapshot = nullptr;
+        return true;
+    }
+    return false;
+}
+
 void PatternModel::setPositionOff(int row, int column) const
 {
     if (row > -1 && row < height() && column > -1 && column < width()) {
         const Note *note = qobject_cast<Note*>(getNote(row, column));
         if (note) {
-            for (const QVariant &subnoteVar : note->subnotes()) {
-                Note *subnote = subnoteVar.value<Note*>();
+            for (Note *subnote : note->typedSubnotes()) {
                 if (subnote) {
                     subnote->setOff();
                 }
@@ -1494,32 +2110,22 @@ void PatternModel::setPositionOff(int row, int column) const
 
 QObjectList PatternModel::setPositionOn(int row, int column) const
 {
-    static const QLatin1String velocityString{"velocity"};
     QObjectList onifiedNotes;
     if (row > -1 && row < height() && column > -1 && column < width()) {
         const Note *note = qobject_cast<Note*>(getNote(row, column));
         if (note) {
-            const QVariantList &subnotes = note->subnotes();
-            const QVariantList &meta = getMetadata(row, column).toList();
+            const QVector<Note*> &subnotes = note->typedSubnotes();
+            const SubnoteMetadata meta{getTypedMetadata(row, column)};
             if (meta.count() == subnotes.count()) {
                 for (int i = 0; i < subnotes.count(); ++i) {
-                    Note *subnote = subnotes[i].value<Note*>();
-                    const QVariantHash &metaHash = meta[i].toHash();
-                    if (metaHash.isEmpty() && subnote) {
-                        playGridManager()->scheduleNote(subnote->midiNote(), subnote->midiChannel(), true);
-                        onifiedNotes << subnote;
-                    } else if (subnote) {
-                        int velocity{64};
-                        if (metaHash.contains(velocityString)) {
-                            velocity = metaHash.value(velocityString).toInt();
-                        }
-                        playGridManager()->scheduleNote(subnote->midiNote(), subnote->midiChannel(), true, velocity);
+                    Note *subnote = subnotes[i];
+                    if (subnote) {
+                        playGridManager()->scheduleNote(subnote->midiNote(), subnote->midiChannel(), true, meta.velocity(i));
                         onifiedNotes << subnote;
                     }
                 }
             } else {
-                for (const QVariant &subnoteVar : subnotes) {
-                    Note *subnote = subnoteVar.value<Note*>();
+                for (Note *subnote : subnotes) {
                     if (subnote) {
                         playGridManager()->scheduleNote(subnote->midiNote(), subnote->midiChannel(), true);
                         onifiedNotes << subnote;
@@ -1531,98 +2137,222 @@ QObjectList PatternModel::setPositionOn(int row, int column) const
     return onifiedNotes;
 }
 
-void addNoteToBuffer(juce::MidiBuffer &buffer, const Note *theNote, unsigned char velocity, bool setOn, int overrideChannel) {
-    if ((overrideChannel > -1 ? overrideChannel : theNote->midiChannel()) >= -1 && (overrideChannel > -1 ? overrideChannel : theNote->midiChannel()) <= 15) {
-        unsigned char note[3];
+inline void addNoteToEvents(QVector<PlaybackEvent> &events, int delay, const StepSubnote &subnote, bool setOn, int overrideChannel) {
+    const int midiChannel{overrideChannel > -1 ? overrideChannel : subnote.midiChannel};
+    if (midiChannel >= -1 && midiChannel <= 15) {
+        PlaybackEvent event;
+        event.delay = delay;
         if (setOn) {
-            note[0] = 0x90 + (overrideChannel > -1 ? overrideChannel : theNote->midiChannel());
+            event.message[0] = 0x90 + midiChannel;
         } else {
-            note[0] = 0x80 + (overrideChannel > -1 ? overrideChannel : theNote->midiChannel());
+            event.message[0] = 0x80 + midiChannel;
+        }
+        event.message[1] = subnote.midiNote;
+        event.message[2] = subnote.velocity;
+        event.sampleNumber = setOn ? 1 : 0;
+        events << event;
+    }
+}
+
+void PatternModel::Private::compileStep(int row, int column)
+{
+    if (row < 0 || column < 0 || column >= width) {
+        return;
+    }
+    const int stepIndex{(row * width) + column};
+    if (stepTable.count() <= stepIndex) {
+        stepTable.resize(stepIndex + 1);
+    }
+    StepData step;
+    const Note *note = qobject_cast<const Note*>(q->getNote(row, column));
+    if (note) {
+        const QVector<Note*> &subnotes = note->typedSubnotes();
+        if (subnotes.count() > 0) {
+            const SubnoteMetadata meta{q->getTypedMetadata(row, column)};
+            // Metadata is only used if it matches the subnotes, otherwise we just use the defaults
+            const bool useMeta{meta.count() == subnotes.count()};
+            step.subnotes.reserve(subnotes.count());
+            for (int subnoteIndex = 0; subnoteIndex < subnotes.count(); ++subnoteIndex) {
+                const Note *subnote = subnotes[subnoteIndex];
+                if (subnote) {
+                    StepSubnote compiled;
+                    compiled.midiNote = subnote->midiNote();
+                    compiled.midiChannel = subnote->midiChannel();
+                    if (useMeta) {
+                        compiled.velocity = meta.velocity(subnoteIndex);
+                        compiled.delay = meta.delay(subnoteIndex);
+                        compiled.duration = qMax(0, meta.duration(subnoteIndex));
+                    }
+                    step.earliestDelay = qMin(step.earliestDelay, compiled.delay);
+                    step.subnotes << compiled;
+                }
+            }
+        } else if (note->midiNote() < 128) {
+            // A plain note set directly on the position, rather than as a subnote of a compound note
+            StepSubnote compiled;
+            compiled.midiNote = note->midiNote();
+            compiled.midiChannel = note->midiChannel();
+            step.subnotes << compiled;
+        }
+    }
+    // Keep the pattern's negative delays up to date with the step's new contents
+    const int previousEarliestDelay{stepTable.at(stepIndex).earliestDelay};
+    if (previousEarliestDelay < 0) {
+        QMap<int, int>::iterator previous = negativeDelayCounts.find(previousEarliestDelay);
+        if (previous != negativeDelayCounts.end() && --previous.value() < 1) {
+            negativeDelayCounts.erase(previous);
         }
-        note[1] = theNote->midiNote();
-        note[2] = velocity;
-        const int onOrOff = setOn ? 1 : 0;
-        buffer.addEvent(note, 3, onOrOff);
     }
+    if (step.earliestDelay < 0) {
+        ++negativeDelayCounts[step.earliestDelay];
+    }
+    stepTable[stepIndex] = step;
 }
 
-inline juce::MidiBuffer &PatternModel::Private::getOrCreateBuffer(QHash<int, juce::MidiBuffer> &collection, int position)
+void PatternModel::Private::compileAllSteps()
 {
+    const int height{q->height()};
+    stepTable.clear();
+    stepTable.resize(height * width);
+    negativeDelayCounts.clear();
+    for (int row = 0; row < height; ++row) {
+        for (int column = 0; column < width; ++column) {
+            compileStep(row, column);
+        }
+    }
+}
+
+void PatternModel::Private::gatherPositionEvents(const PlaybackSnapshotSource &source, QVector<PlaybackEvent> &events, int position, int noteDuration, int lookahead)
+{
+    const QVector<StepData> &stepTable = source.stepTable;
+    const PlaybackTiming *timing = source.timing;
+    const int width{source.width};
+    const int bankOffset{source.bankOffset};
+    const int availableBars{source.availableBars};
+    const int overrideChannel{source.overrideChannel};
     // Since PatternModel operates internally at 32ppqn, let's adjust things so that they match that assumption
     // We could probably make this follow the sequencer instead, but that would require changing some behaviours
-    const int realPosition{position * beatSubdivision6};
-    if (!collection.contains(realPosition)) {
-        collection[realPosition] = juce::MidiBuffer();
+    // (this is why the delays below are all multiplied by the timer ticks per 128th note)
+    const int positionCount{availableBars * width};
+    for (int subsequentNoteIndex = 0; subsequentNoteIndex < lookahead; ++subsequentNoteIndex) {
+        const int ourPosition = (position + subsequentNoteIndex) % positionCount;
+        const int stepIndex = (bankOffset * width) + ourPosition;
+        if (stepIndex < stepTable.count()) {
+            const StepData &step = stepTable.at(stepIndex);
+            // The first note we want to treat to all the things (except for the ones which want playing before this position,
+            // unless there's nowhere before this position to play them from)
+            if (subsequentNoteIndex == 0) {
+                for (const StepSubnote &subnote : step.subnotes) {
+                    if (subnote.delay >= 0 || lookahead == 1) {
+                        const int duration{subnote.duration > 0 ? subnote.duration : noteDuration};
+                        addNoteToEvents(events, subnote.delay * timing->beatSubdivision(6), subnote, true, overrideChannel);
+                        addNoteToEvents(events, (subnote.delay + duration) * timing->beatSubdivision(6), subnote, false, overrideChannel);
+                    }
+                }
+            // The lookahead notes only need handling if, and only if, the delay is negative (as in, position before that step),
+            // and then only from the position the delay reaches back into, so each note is only ever scheduled once
+            } else if (step.earliestDelay < 0) {
+                const int positionAdjustment = subsequentNoteIndex * noteDuration;
+                for (const StepSubnote &subnote : step.subnotes) {
+                    if (subnote.delay < 0) {
+                        const int stepsBack{qMin((-subnote.delay + noteDuration - 1) / noteDuration, lookahead - 1)};
+                        if (stepsBack == subsequentNoteIndex) {
+                            const int duration{subnote.duration > 0 ? subnote.duration : noteDuration};
+                            addNoteToEvents(events, (positionAdjustment + subnote.delay) * timing->beatSubdivision(6), subnote, true, overrideChannel);
+                            addNoteToEvents(events, (positionAdjustment + subnote.delay + duration) * timing->beatSubdivision(6), subnote, false, overrideChannel);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const PlaybackEvent &a, const PlaybackEvent &b) { return a.delay < b.delay; });
+}
+
+PlaybackSnapshotSource PatternModel::Private::snapshotSource() const
+{
+    PlaybackSnapshotSource source;
+    source.stepTable = stepTable;
+    source.negativeDelayCounts = negativeDelayCounts;
+    source.width = width;
+    source.availableBars = availableBars;
+    source.bankOffset = bankOffset;
+    source.noteLength = noteLength;
+    source.overrideChannel = (midiChannel == 15) ? playGridManager->currentMidiChannel() : -1;
+    source.timing = timing;
+    return source;
+}
+
+PlaybackSnapshot *PatternModel::Private::buildSnapshot(const PlaybackSnapshotSource &source)
+{
+    const PlaybackTiming *timing = source.timing;
+    PlaybackSnapshot *snapshot = new PlaybackSnapshot;
+    snapshot->width = source.width;
+    snapshot->availableBars = source.availableBars;
+    snapshot->bankOffset = source.bankOffset;
+    snapshot->noteLength = source.noteLength;
+    snapshot->overrideChannel = source.overrideChannel;
+    if (!timing->isValidNoteLength(source.noteLength)) {
+        qWarning() << Q_FUNC_INFO << "Incorrect note length in pattern, no notes will be played from this one until it is fixed:" << source.noteLength;
+    }
+    const int noteDuration{timing->isValidNoteLength(source.noteLength) ? timing->noteDuration(source.noteLength) : 0};
+    snapshot->lookahead = lookaheadAmount(source, noteDuration);
+    snapshot->slotCapacity = PlaybackEventsPerStep * snapshot->lookahead;
+    const int positionCount{source.availableBars * source.width};
+    snapshot->eventCounts.fill(0, positionCount);
+    snapshot->overflowOffsets.fill(-1, positionCount);
+    QVector<PlaybackEvent> events;
+    events.reserve(snapshot->slotCapacity);
+    for (int position = 0; position < positionCount; ++position) {
+        events.clear();
+        gatherPositionEvents(source, events, position, noteDuration, snapshot->lookahead);
+        if (events.isEmpty()) {
+            continue;
+        }
+        // Only allocate the slots once we know there's something to put in them, so empty patterns stay cheap
+        if (snapshot->slots.isEmpty()) {
+            snapshot->slots.resize(positionCount * snapshot->slotCapacity);
+        }
+        snapshot->eventCounts[position] = events.count();
+        if (events.count() > snapshot->slotCapacity) {
+            snapshot->overflowOffsets[position] = snapshot->overflow.count();
+            snapshot->overflow << events;
+        } else {
+            std::copy(events.constBegin(), events.constEnd(), snapshot->slots.begin() + (position * snapshot->slotCapacity));
+        }
     }
-    return collection[realPosition];
+    return snapshot;
 }
 
-inline void PatternModel::Private::noteLengthDetails(int noteLength, quint64 &nextPosition, bool &relevantToUs, quint64 &noteDuration)
+void PatternModel::Private::publishSnapshot(PlaybackSnapshot *snapshot)
 {
-    // Potentially it'd be tempting to try and optimise this manually to use bitwise operators,
-    // but GCC already does that for you at -O2, so don't bother :)
-    switch (noteLength) {
-    case 1:
-        if (nextPosition % beatSubdivision == 0) {
-            relevantToUs = true;
-            nextPosition = nextPosition / beatSubdivision;
-            noteDuration = 32;
-        } else {
-            relevantToUs = false;
-        }
-        break;
-    case 2:
-        if (nextPosition % beatSubdivision2 == 0) {
-            relevantToUs = true;
-            nextPosition = nextPosition / beatSubdivision2;
-            noteDuration = 16;
-        } else {
-            relevantToUs = false;
-        }
-        break;
-    case 3:
-        if (nextPosition % beatSubdivision3 == 0) {
-            relevantToUs = true;
-            nextPosition = nextPosition / beatSubdivision3;
-            noteDuration = 8;
-        } else {
-            relevantToUs = false;
-        }
-        break;
-    case 4:
-        if (nextPosition % beatSubdivision4 == 0) {
-            relevantToUs = true;
-            nextPosition = nextPosition / beatSubdivision4;
-            noteDuration = 4;
-        } else {
-            relevantToUs = false;
-        }
-        break;
-    case 5:
-        if (nextPosition % beatSubdivision5 == 0) {
-            relevantToUs = true;
-            nextPosition = nextPosition / beatSubdivision5;
-            noteDuration = 2;
-        } else {
-            relevantToUs = false;
+    // Anything which was waiting to be published is covered by this snapshot
+    snapshotPublisher->stop();
+    PlaybackSnapshot *replaced = playbackSnapshot.exchange(snapshot);
+    if (replaced) {
+        retiredSnapshots << replaced;
+    }
+    snapshotHasEvents = !snapshot->slots.isEmpty();
+    updateCanProduceEvents();
+    // Delete anything the timer thread is guaranteed to no longer be looking at (anything it is
+    // still using will get cleared out the next time around)
+    PlaybackSnapshot *inUse = snapshotInUse.load();
+    QMutableListIterator<PlaybackSnapshot*> iterator(retiredSnapshots);
+    while (iterator.hasNext()) {
+        PlaybackSnapshot *retired = iterator.next();
+        if (retired != inUse) {
+            delete retired;
+            iterator.remove();
         }
-        break;
-    case 6:
-        relevantToUs = true;
-        noteDuration = 1;
-        break;
-    default:
-        qWarning() << "Incorrect note length in pattern, no notes will be played from this one, ever";
-        break;
     }
 }
 
-void PatternModel::handleSequenceAdvancement(quint64 sequencePosition, int progressionLength) const
+quint64 PatternModel::handleSequenceAdvancement(quint64 sequencePosition, int progressionLength) const
 {
+    PlaybackProfilerScope profilerScope(d->playbackProfiler, PlaybackProfiler::PatternAdvancementStage, &d->playbackTimings);
     static const int initialProgression{0};
-    static const QLatin1String velocityString{"velocity"};
-    static const QLatin1String delayString{"delay"};
-    static const QLatin1String durationString{"duration"};
+    // Unless we know better, we want to be asked again on the next tick
+    quint64 nextDuePosition{sequencePosition + 1};
     if (!d->zlSyncManager->channelMuted
         && (isPlaying()
             // Play any note if the pattern is set to sliced or trigger destination, since then it's not sending things through the midi graph
@@ -1634,100 +2364,23 @@ void PatternModel::handleSequenceAdvancement(quint64 sequencePosition, int progr
             )
         )
     ) {
-        const int overrideChannel{(d->midiChannel == 15) ? d->playGridManager->currentMidiChannel() : -1};
+        const PlaybackSnapshot *snapshot = d->acquireSnapshot();
+        if (!snapshot || snapshot->slots.isEmpty() || !d->timing->isValidNoteLength(snapshot->noteLength)) {
+            return nextDuePosition;
+        }
         const quint64 playbackOffset{d->segmentHandler->songMode() ? d->segmentHandler->playfieldOffset(d->channelIndex, d->sequence->sceneIndex(), d->partIndex) : 0};
-        quint64 noteDuration{0};
-        bool relevantToUs{false};
+        const int ticksPerStep{d->timing->ticksPerStep(snapshot->noteLength)};
+        quint64 nextPosition{0};
         // Since this happens at the /end/ of the cycle in a beat, this should be used to schedule beats for the next
         // beat, not the current one. That is to say, prepare the next frame, not the current one (since those notes
         // have already been played).
         for (int progressionIncrement = initialProgression; progressionIncrement <= progressionLength; ++progressionIncrement) {
-            // check whether the sequencePosition + progressionIncrement matches our note length
-            quint64 nextPosition = sequencePosition - playbackOffset + progressionIncrement;
-            d->noteLengthDetails(d->noteLength, nextPosition, relevantToUs, noteDuration);
-
-            if (relevantToUs) {
+            // check whether the sequencePosition + progressionIncrement lands on one of our steps
+            if (d->advanceToTick(sequencePosition - playbackOffset + progressionIncrement, ticksPerStep, nextPosition)) {
                 // Get the next row/column combination, and schedule the previous one off, and the next one on
-                // squish nextPosition down to fit inside our available range (d->availableBars * d->width)
+                // squish nextPosition down to fit inside our available range (availableBars * width)
                 // start + (numberToBeWrapped - start) % (limit - start)
-                nextPosition = nextPosition % (d->availableBars * d->width);
-
-                if (!d->positionBuffers.contains(nextPosition + (d->bankOffset * d->width))) {
-                    QHash<int, juce::MidiBuffer> positionBuffers;
-                    // Do a lookup for any notes after this position that want playing before their step (currently
-                    // just looking ahead one step, we could probably afford to do a bunch, but one for now)
-                    for (int subsequentNoteIndex = 0; subsequentNoteIndex < d->lookaheadAmount; ++subsequentNoteIndex) {
-                        int ourPosition = (nextPosition + subsequentNoteIndex) % (d->availableBars * d->width);
-                        int row = (ourPosition / d->width) % d->availableBars;
-                        int column = ourPosition - (row * d->width);
-                        const Note *note = qobject_cast<const Note*>(getNote(row + d->bankOffset, column));
-                        if (note) {
-                            const QVariantList &subnotes = note->subnotes();
-                            const QVariantList &meta = getMetadata(row + d->bankOffset, column).toList();
-                            // The first note we want to treat to all the things
-                            if (subsequentNoteIndex == 0) {
-                                if (meta.count() == subnotes.count()) {
-                                    for (int subnoteIndex = 0; subnoteIndex < subnotes.count(); ++subnoteIndex) {
-                                        const Note *subnote = subnotes[subnoteIndex].value<Note*>();
-                                        const QVariantHash &metaHash = meta[subnoteIndex].toHash();
-                                        if (subnote) {
-                                            if (metaHash.isEmpty()) {
-                                                addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, 0), subnote, 64, true, overrideChannel);
-                                                addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, noteDuration), subnote, 64, false, overrideChannel);
-                                            } else {
-                                                const int velocity{metaHash.value(velocityString, 64).toInt()};
-                                                const int delay{metaHash.value(delayString, 0).toInt()};
-                                                int duration{metaHash.value(durationString, noteDuration).toInt()};
-                                                if (duration < 1) {
-                                                    duration = noteDuration;
-                                                }
-                                                addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, delay), subnote, velocity, true, overrideChannel);
-                                                addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, delay + duration), subnote, velocity, false, overrideChannel);
-                                            }
-                                        }
-                                    }
-                                } else if (subnotes.count() > 0) {
-                                    for (const QVariant &subnoteVar : subnotes) {
-                                        const Note *subnote = subnoteVar.value<Note*>();
-                                        if (subnote) {
-                                            addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, 0), subnote, 64, true, overrideChannel);
-                                            addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, noteDuration), subnote, 64, false, overrideChannel);
-                                        }
-                                    }
-                                } else {
-                                    addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, 0), note, 64, true, overrideChannel);
-                                    addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, noteDuration), note, 64, false, overrideChannel);
-                                }
-                            // The lookahead notes only need handling if, and only if, there is matching meta, and the delay is negative (as in, position before that step)
-                            } else {
-                                if (meta.count() == subnotes.count()) {
-                                    const int positionAdjustment = subsequentNoteIndex * noteDuration;
-                                    for (int subnoteIndex = 0; subnoteIndex < subnotes.count(); ++subnoteIndex) {
-                                        const Note *subnote = subnotes[subnoteIndex].value<Note*>();
-                                        const QVariantHash &metaHash = meta[subnoteIndex].toHash();
-                                        if (subnote) {
-                                            if (!metaHash.isEmpty() && metaHash.contains(delayString)) {
-                                                const int delay{metaHash.value(delayString, 0).toInt()};
-                                                if (delay < 0) {
-                                                    const int velocity{metaHash.value(velocityString, 64).toInt()};
-                                                    int duration{metaHash.value(durationString, noteDuration).toInt()};
-                                                    if (duration < 1) {
-                                                        duration = noteDuration;
-                                                    }
-//                                                     qDebug() << "Next position" << nextPosition << "with ourPosition" << ourPosition << "where delay" << delay << "is less than 0";
-//                                                     qDebug() << "With position adjustment" << positionAdjustment << "we end up with start" << positionAdjustment + delay << "and end" << positionAdjustment + delay + duration;
-                                                    addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, positionAdjustment + delay), subnote, velocity, true, overrideChannel);
-                                                    addNoteToBuffer(d->getOrCreateBuffer(positionBuffers, positionAdjustment + delay + duration), subnote, velocity, false, overrideChannel);
-                                                }
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    d->positionBuffers[nextPosition + (d->bankOffset * d->width)] = positionBuffers;
-                }
+                nextPosition = nextPosition % snapshot->eventCounts.count();
                 switch (d->noteDestination) {
                     case PatternModel::SampleLoopedDestination:
                         // If this channel is supposed to loop its sample, we are not supposed to be making patterny sounds
@@ -1742,17 +2395,25 @@ void PatternModel::handleSequenceAdvancement(quint64 sequencePosition, int progr
                     case PatternModel::SynthDestination:
                     default:
                     {
-                        const QHash<int, juce::MidiBuffer> &positionBuffers = d->positionBuffers[nextPosition + (d->bankOffset * d->width)];
-                        QHash<int, juce::MidiBuffer>::const_iterator position;
-                        for (position = positionBuffers.constBegin(); position != positionBuffers.constEnd(); ++position) {
-                            d->syncTimer->scheduleMidiBuffer(position.value(), qMax(0, progressionIncrement + position.key()));
+                        int eventCount{0};
+                        const PlaybackEvent *events = snapshot->events(nextPosition, eventCount);
+                        // Everything gets merged with the other patterns' events, and scheduled once the tick is done
+                        for (int eventIndex = 0; eventIndex < eventCount; ++eventIndex) {
+                            const PlaybackEvent &event = events[eventIndex];
+                            d->playbackBatch->addEvent(qMax(0, progressionIncrement + event.delay), event.message, event.sampleNumber);
                         }
                         break;
                     }
                 }
             }
         }
+        // In song mode, the pattern's offset can change underneath us during playback (the segments move
+        // it along), so we can only know when we are next due when playing the pattern on its own
+        if (!d->segmentHandler->songMode()) {
+            nextDuePosition = qMax(nextDuePosition, d->nextRelevantTick.tick - quint64(progressionLength));
+        }
     }
+    return nextDuePosition;
 }
 
 void PatternModel::updateSequencePosition(quint64 sequencePosition)
@@ -1764,12 +2425,8 @@ void PatternModel::updateSequencePosition(quint64 sequencePosition)
             || d->playGridManager->currentMidiChannel() > -1))
         || sequencePosition == 0
     ) {
-        bool relevantToUs{false};
-        quint64 nextPosition{sequencePosition};
-        quint64 noteDuration{0};
-        d->noteLengthDetails(d->noteLength, nextPosition, relevantToUs, noteDuration);
-
-        if (relevantToUs) {
+        quint64 nextPosition{0};
+        if (d->timing->stepForTick(d->noteLength, sequencePosition, nextPosition)) {
             nextPosition = nextPosition % (d->availableBars * d->width);
             int row = (nextPosition / d->width) % d->availableBars;
             int column = nextPosition - (row * d->width);
@@ -1842,14 +2499,25 @@ void PatternModel::handleMidiMessage(const unsigned char &byte1, const unsigned
     }
 }
 
+void ZLPatternSynchronisationManager::mutedChanged()
+{
+    if (zlChannel) {
+        channelMuted = zlChannel->property("muted").toBool();
+    } else {
+        channelMuted = false;
+    }
+    q->d->updateCanProduceEvents();
+}
+
 void ZLPatternSynchronisationManager::addRecordedNote(void *recordedNote)
 {
     NewNoteData *newNote = static_cast<NewNoteData*>(recordedNote);
 
-    bool relevantToUs{false}; // not relevant
-    quint64 nextPosition{0};
-    quint64 noteDuration{0};
-    q->d->noteLengthDetails(q->noteLength(), nextPosition, relevantToUs, noteDuration);
+    if (!q->d->timing->isValidNoteLength(q->noteLength())) {
+        delete newNote;
+        return;
+    }
+    const quint64 noteDuration{quint64(q->d->timing->noteDuration(q->noteLength()))};
     int deviationAllowance = qMax(1.0, ceil(noteDuration * 0.3));
 
     const int patternLength = q->width() * q->availableBars();
@@ -1881,10 +2549,12 @@ void ZLPatternSynchronisationManager::addRecordedNote(void *recordedNote)
     newNote->row = q->bankOffset() + row; // reset row to the internal actual row (otherwise we'd end up with the wrong one)
     newNote->column = column;
     int subnoteIndex{-1};
+    PatternTransaction transaction(q);
     Note *note = qobject_cast<Note*>(q->getNote(newNote->row, newNote->column));
     if (note) {
-        for (int i = 0; i < note->subnotes().count(); ++i) {
-            Note* subnote = note->subnotes().at(i).value<Note*>();
+        const QVector<Note*> &subnotes = note->typedSubnotes();
+        for (int i = 0; i < subnotes.count(); ++i) {
+            const Note* subnote = subnotes[i];
             if (subnote && subnote->midiNote() == newNote->midiNote) {
                 subnoteIndex = i;
                 break;
@@ -1893,7 +2563,7 @@ void ZLPatternSynchronisationManager::addRecordedNote(void *recordedNote)
     }
     // If we didn't find one there already, /then/ we can create one
     if (subnoteIndex == -1) {
-        subnoteIndex = q->addSubnote(newNote->row, newNote->column, q->playGridManager()->getNote(newNote->midiNote, q->midiChannel()));
+        subnoteIndex = transaction.addSubnote(newNote->row, newNote->column, q->playGridManager()->getNote(newNote->midiNote, q->midiChannel()));
         qDebug() << Q_FUNC_INFO << "Didn't find a subnote with this midi note to change values on, created a new subnote at subnote index" << subnoteIndex;
     } else {
         // Check whether this is what we already know about, and if it is, abort the changes
@@ -1907,9 +2577,10 @@ void ZLPatternSynchronisationManager::addRecordedNote(void *recordedNote)
     }
     if (subnoteIndex > -1) {
         // And then, finally, set the three values (always set them, because we might be changing an existing entry
-        q->setSubnoteMetadata(newNote->row, newNote->column, subnoteIndex, "velocity", newNote->velocity);
-        q->setSubnoteMetadata(newNote->row, newNote->column, subnoteIndex, "duration", newNote->duration);
-        q->setSubnoteMetadata(newNote->row, newNote->column, subnoteIndex, "delay", newNote->delay);
+        transaction.setSubnoteMetadata(newNote->row, newNote->column, subnoteIndex, "velocity", newNote->velocity);
+        transaction.setSubnoteMetadata(newNote->row, newNote->column, subnoteIndex, "duration", newNote->duration);
+        transaction.setSubnoteMetadata(newNote->row, newNote->column, subnoteIndex, "delay", newNote->delay);
+        transaction.commit();
         qDebug() << Q_FUNC_INFO << "Handled a recorded new note:" << newNote << newNote->timestamp << newNote->endTimestamp << newNote->step << newNote->row << newNote->column << newNote->midiNote << newNote->velocity << newNote->delay << newNote->duration << "with deviation allowance" << deviationAllowance;
     }
 
@@ -25,6 +25,13 @@
 #include "NotesModel.h"
 #include "SequenceModel.h"
 
+#include <QSharedPointer>
+
+class PatternPlaybackPreparation;
+class PlaybackHistogram;
+
+// The number of undo steps kept for each pattern
+#define PATTERN_UNDO_HISTORY_LENGTH 32
 /**
  * \brief A way to keep channel of the notes which make up a conceptual song pattern
  *
@@ -172,6 +179,16 @@ class PatternModel : public NotesModel
      * \brief Whether or not there are any notes defined on any step in any bank
      */
     Q_PROPERTY(bool hasNotes READ hasNotes NOTIFY hasNotesChanged)
+    /**
+     * \brief Whether there are any changes to the pattern's notes which can be undone
+     * @see undo()
+     */
+    Q_PROPERTY(bool canUndo READ canUndo NOTIFY undoHistoryChanged)
+    /**
+     * \brief Whether there are any undone changes to the pattern's notes which can be redone
+     * @see redo()
+     */
+    Q_PROPERTY(bool canRedo READ canRedo NOTIFY undoHistoryChanged)
     /**
      * \brief A toggle for setting the pattern to an enabled state (primarily used for playback purposes)
      * @default true
@@ -368,6 +385,20 @@ public:
      * @param metadata The piece of metadata you wish to set
      */
     Q_INVOKABLE void setMetadata(int row, int column, QVariant metadata) override;
+    /**
+     * \brief Set the typed subnote metadata for the given position
+     * @note Like setMetadata, use this rather than the NotesModel version, or playback will not match the pattern
+     * @param row The row of the position to set metadata for
+     * @param column The column of the position to set the metadata for
+     * @param metadata The new subnote metadata
+     */
+    void setTypedMetadata(int row, int column, const SubnoteMetadata &metadata) override;
+    /**
+     * \brief Replace the contents of the pattern's positions with those in the given snapshot
+     * This also updates the playback data for the entire pattern
+     * @see NotesModel::setContents()
+     */
+    void setContents(const NotesModelContents &contents) override;
 
     /**
      * \brief Resets all the model's content-related properties to their defaults
@@ -405,13 +436,68 @@ public:
      */
     Q_INVOKABLE void clearBank(int bank);
 
+    /**
+     * \brief Undo the most recent change to the pattern's notes and metadata
+     * Everything changed before control returns to the event loop is gathered into a single undo step,
+     * so for example a whole clearBank() call is undone in one go. Only the contents of the positions
+     * are covered by this, not the pattern's settings (such as note length or midi channel), and notes
+     * restored from before a change of midi channel are moved onto the pattern's current one.
+     * The history holds up to PATTERN_UNDO_HISTORY_LENGTH steps, and is cleared when a sketch is loaded.
+     */
+    Q_INVOKABLE void undo();
+    /**
+     * \brief Redo the most recently undone change to the pattern's notes and metadata
+     * Making any other change to the pattern clears the redo history
+     * @see undo()
+     */
+    Q_INVOKABLE void redo();
+    /**
+     * \brief Forget all the undo and redo steps for the pattern
+     */
+    Q_INVOKABLE void clearUndoHistory();
+    bool canUndo() const;
+    bool canRedo() const;
+    Q_SIGNAL void undoHistoryChanged();
+
     /**
      * \brief This will export a json representation of the pattern to a file with the given filename
+     * The file is only written if the pattern has changed since it was last written there (see hasUnsavedChanges()),
+     * and it is replaced atomically, so an interrupted write leaves the previous file in place
      * @note This will overwrite anything that already exists in that location without warning
      * @param fileName The file you wish to write the pattern's json representation to
-     * @return True if the file was successfully written, otherwise false
+     * @return True if the file was successfully written, otherwise false (including when there was nothing to write)
      */
     Q_INVOKABLE bool exportToFile(const QString &fileName) const;
+    /**
+     * \brief This will write the pattern to a file with the given filename, in the binary pattern format
+     * Like exportToFile(), this only writes the file if the pattern has changed since it was last written there
+     * @see PatternFile
+     * @param fileName The file you wish to write the pattern's binary representation to
+     * @return True if the file was successfully written, otherwise false (including when there was nothing to write)
+     */
+    Q_INVOKABLE bool exportToBinaryFile(const QString &fileName) const;
+    /**
+     * \brief Whether the pattern has changed since it was last written to (or read from) the given file
+     * This compares the pattern's lastModified stamp with the one it had when the file was written
+     * @param fileName The file to check against
+     * @return True if the pattern has never been written to that file, or has changed since it was
+     */
+    Q_INVOKABLE bool hasUnsavedChanges(const QString &fileName) const;
+    /**
+     * \brief Mark the pattern as being the same as what is stored in the given file
+     * Use this when the pattern has just been loaded from the file (or the file has been removed because
+     * the pattern is empty), so the pattern is not written again until something changes
+     * @param fileName The file which holds what the pattern currently contains
+     */
+    void markAsSaved(const QString &fileName);
+    /**
+     * \brief Mark the pattern as having been written to the given file as it was at the given lastModified stamp
+     * Use this for writes which finish after the pattern might have changed (such as when saving in the
+     * background), so any changes made since the snapshot was taken are still seen as unsaved
+     * @param fileName The file which was written
+     * @param savedTime The pattern's lastModified stamp when the data that was written was taken from it
+     */
+    void markAsSaved(const QString &fileName, quint64 savedTime);
 
     QObject* sequence() const;
     /**
@@ -563,6 +649,53 @@ public:
     bool isPlaying() const;
     Q_SIGNAL void isPlayingChanged();
 
+    /**
+     * \brief Whether the pattern is able to produce any events during playback at the moment
+     *
+     * This is true when the pattern is playing, its channel is not muted, it has somewhere to send
+     * its notes, and there are notes in its active bank. SequenceModel uses this to only visit the
+     * patterns which can actually produce events during playback.
+     */
+    bool canProduceEvents() const;
+    Q_SIGNAL void canProduceEventsChanged();
+
+    /**
+     * \brief The timings recorded for this pattern's handleSequenceAdvancement() while playback profiling is enabled
+     * @see PlayGridManager::playbackProfile()
+     */
+    PlaybackHistogram *playbackTimings() const;
+
+    /**
+     * \brief Whether the pattern has changes which have not yet made it into its playback data
+     * @see preparePlayback()
+     */
+    bool needsPlaybackPreparation() const;
+    /**
+     * \brief Capture what is needed to build the pattern's playback events away from the pattern's own thread
+     *
+     * This is quick (the pattern's step data is compiled as it is changed, and the capture shares that
+     * rather than copying it), and what it returns is plain data, which preparePlayback() can build the
+     * playback events from on any thread. PlayGridManager::preparePatternsForPlayback() uses this to
+     * build all the patterns' events in parallel.
+     * This takes over from any rebuild of the playback events which was already scheduled, so make sure
+     * to pass the preparation to commitPreparedPlayback() once it is done.
+     * This must be called from the pattern's own thread
+     */
+    QSharedPointer<PatternPlaybackPreparation> createPlaybackPreparation();
+    /**
+     * \brief Build the playback events for a preparation made by createPlaybackPreparation()
+     * This touches nothing but the preparation, and so is safe to call from any thread
+     */
+    static void preparePlayback(const QSharedPointer<PatternPlaybackPreparation> &preparation);
+    /**
+     * \brief Hand the playback events built by preparePlayback() to playback
+     * If the pattern has changed since the preparation was made, the prepared events are out of date,
+     * and are dropped (the change will already have scheduled a rebuild of its own).
+     * This must be called from the pattern's own thread
+     * @return True if the prepared events were handed to playback
+     */
+    bool commitPreparedPlayback(const QSharedPointer<PatternPlaybackPreparation> &preparation);
+
     Q_INVOKABLE void setPositionOff(int row, int column) const;
     Q_INVOKABLE QObjectList setPositionOn(int row, int column) const;
 
@@ -574,8 +707,9 @@ public:
      * the Pattern, to ensure the lowest possible latency)
      * @param sequencePosition The position in the sequence that should be considered (literally a count of ticks)
      * @param progressionLength The number of ticks until the next position (that is, how many ticks between this and the next call of the function)
+     * @return The next sequence position at which this pattern has anything to do (calling the function before then does nothing)
      */
-    void handleSequenceAdvancement(quint64 sequencePosition, int progressionLength) const;
+    quint64 handleSequenceAdvancement(quint64 sequencePosition, int progressionLength) const;
     /**
      * \brief Used by SequenceModel to update its patterns' positions to the actual sequence playback position during playback
      *
@@ -588,11 +722,62 @@ public:
     void handleSequenceStop();
 
     Q_SLOT void handleMidiMessage(const unsigned char &byte1, const unsigned char &byte2, const unsigned char &byte3, const double& timeStamp);
+protected:
+    void contentsAboutToChange() override;
+    void contentsChanged() override;
 private:
     friend class ZLPatternSynchronisationManager;
+    friend class PatternTransaction;
+    friend class PatternTransactionPrivate;
     class Private;
     Private *d;
 };
 Q_DECLARE_METATYPE(PatternModel::NoteDestination)
 
+class PatternTransactionPrivate;
+/**
+ * \brief A set of changes to the subnotes of a pattern, which are applied all at once
+ *
+ * Adding a subnote and setting its metadata through PatternModel changes the position, recompiles its
+ * playback data, and reports the change, every single time. A transaction instead collects the changes,
+ * and on commit() works out which positions actually ended up different, writes only those, recompiles
+ * their playback data once, and reports them to the model's users as a single change.
+ *
+ * While the transaction is open, the positions it has changed are read from the transaction, not the
+ * pattern, so later changes build on the earlier ones (e.g. setting metadata on a subnote just added).
+ * Changes which have not been committed when the transaction is destroyed are discarded.
+ */
+class PatternTransaction {
+public:
+    explicit PatternTransaction(PatternModel *pattern);
+    ~PatternTransaction();
+
+    /**
+     * \brief Add a subnote to the given position (see PatternModel::addSubnote())
+     * @return The index of the new subnote, or -1 if the position or note was not valid
+     */
+    int addSubnote(int row, int column, QObject *note);
+    /**
+     * \brief Remove a subnote from the given position (see PatternModel::removeSubnote())
+     */
+    void removeSubnote(int row, int column, int subnote);
+    /**
+     * \brief Set a piece of metadata on a subnote (see PatternModel::setSubnoteMetadata())
+     */
+    void setSubnoteMetadata(int row, int column, int subnote, const QString &key, const QVariant &value);
+
+    /**
+     * \brief Apply all the changes to the pattern
+     * @return The number of positions which changed
+     */
+    int commit();
+    /**
+     * \brief Throw away all the changes made since the transaction was created (or last committed)
+     */
+    void discard();
+private:
+    Q_DISABLE_COPY(PatternTransaction)
+    PatternTransactionPrivate *d;
+};
+
 #endif//PATTERNMODEL_H
@@ -22,7 +22,11 @@
 #include "PlayGridManager.h"
 #include "Note.h"
 #include "NotesModel.h"
+#include "PatternFile.h"
 #include "PatternModel.h"
+#include "PlaybackBatch.h"
+#include "PlaybackProfiler.h"
+#include "PlaybackTiming.h"
 #include "SegmentHandler.h"
 #include "SettingsContainer.h"
 
@@ -40,14 +44,21 @@
 #include <QDateTime>
 #include <QDir>
 #include <QDirIterator>
+#include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QFileSystemWatcher>
 #include <QList>
+#include <QPointer>
 #include <QQmlComponent>
+#include <QRunnable>
 #include <QStandardPaths>
+#include <QThreadPool>
 #include <QSettings>
 #include <QTimer>
+#include <QVector>
+
+#include <functional>
 
 static const QString midiNoteNames[128]{
     "C-1", "C#-1", "D-1", "D#-1", "E-1", "F-1", "F#-1", "G-1", "G#-1", "A-1", "A#-1", "B-1",
@@ -63,6 +74,64 @@ static const QString midiNoteNames[128]{
     "C9", "C#9", "D9", "D#9", "E9", "F9", "F#9", "G9"
 };
 
+/**
+ * \brief The patterns being prepared by a single call to PlayGridManager::preparePatternsForPlayback()
+ */
+struct PatternPreparationBatch {
+    QVector<QPointer<PatternModel>> patterns;
+    QVector<QSharedPointer<PatternPlaybackPreparation>> preparations;
+    QAtomicInt completed{0};
+    std::function<void()> finished;
+};
+
+// Called on the ui thread each time one of the batch's patterns has been prepared, and once all of
+// them are done, hands the results to the patterns which still exist and have not changed in the meantime
+static void handlePatternPrepared(PlayGridManager *playGridManager, const QSharedPointer<PatternPreparationBatch> &batch, int completed)
+{
+    const int patternCount{batch->patterns.count()};
+    if (completed < patternCount) {
+        Q_EMIT playGridManager->taskMessage(QString("Preparing patterns for playback (%1 of %2 done)").arg(completed).arg(patternCount));
+    } else {
+        for (int index = 0; index < patternCount; ++index) {
+            PatternModel *pattern = batch->patterns[index];
+            if (pattern) {
+                pattern->commitPreparedPlayback(batch->preparations[index]);
+            }
+        }
+        Q_EMIT playGridManager->taskMessage(QString("Done preparing %1 patterns for playback").arg(patternCount));
+        if (batch->finished) {
+            batch->finished();
+        }
+    }
+}
+
+/**
+ * \brief Builds a single pattern's playback events on one of the preparation pool's worker threads
+ * @see PlayGridManager::preparePatternsForPlayback()
+ */
+class PatternPreparationTask : public QRunnable {
+public:
+    PatternPreparationTask(PlayGridManager *playGridManager, const QSharedPointer<PatternPreparationBatch> &batch, int index)
+        : playGridManager(playGridManager)
+        , batch(batch)
+        , index(index)
+    {
+        setAutoDelete(true);
+    }
+    void run() override {
+        PatternModel::preparePlayback(batch->preparations[index]);
+        const int completed{batch->completed.fetchAndAddOrdered(1) + 1};
+        // Report back to the ui thread, rather than having it wait for us
+        PlayGridManager *playGridManager{this->playGridManager};
+        QSharedPointer<PatternPreparationBatch> batch{this->batch};
+        QMetaObject::invokeMethod(playGridManager, [playGridManager, batch, completed](){ handlePatternPrepared(playGridManager, batch, completed); }, Qt::QueuedConnection);
+    }
+private:
+    PlayGridManager *playGridManager{nullptr};
+    QSharedPointer<PatternPreparationBatch> batch;
+    int index{0};
+};
+
 PlayGridManager* timer_callback_ticker{nullptr};
 void timer_callback(int beat) {
     if (timer_callback_ticker) {
@@ -181,13 +250,6 @@ public:
             {"minigrid", 0}, // As these are sorted alphabetically, notesgrid for minigrid and
             {"playgrid", 1}, // stepsequencer for playgrid
         };
-
-        beatSubdivision = syncTimer->getMultiplier();
-        beatSubdivision2 = beatSubdivision / 2;
-        beatSubdivision3 = beatSubdivision2 / 2;
-        beatSubdivision4 = beatSubdivision3 / 2;
-        beatSubdivision5 = beatSubdivision4 / 2;
-        beatSubdivision6 = beatSubdivision5 / 2;
     }
     ~Private() {
     }
@@ -204,7 +266,33 @@ public:
     QHash<QString, SequenceModel*> sequenceModels;
     QHash<QString, PatternModel*> patternModels;
     QHash<QString, NotesModel*> notesModels;
-    QList<Note*> notes;
+    // The plain notes, indexed by [midiChannel + 1][midiNote]. The channels go from -1 through 16 (see getNote),
+    // and since this is on the midi input path, the lookup wants to stay as cheap as we can make it.
+    Note *plainNotes[18][128]{};
+    // The compound notes, indexed by their fake midi note (see getCompoundNote)
+    QHash<int, Note*> compoundNotes;
+    // The compound notes, indexed by their (ordered) list of subnotes
+    QHash<QVector<Note*>, Note*> compoundNotesBySubnotes;
+    // The models which want to know about changes to each note (see subscribeToNote)
+    QHash<Note*, QVector<NotesModel*>> noteSubscribers;
+    // Every note is connected to exactly once, when it is created, and changes are then passed on to the
+    // models which have subscribed to that note, so models do not need their own connections to each note
+    void connectNoteChanges(Note *note) {
+        const auto notify = [this,note](){ notifyNoteSubscribers(note); };
+        QObject::connect(note, &Note::nameChanged, q, notify);
+        QObject::connect(note, &Note::midiNoteChanged, q, notify);
+        QObject::connect(note, &Note::midiChannelChanged, q, notify);
+        QObject::connect(note, &Note::isPlayingChanged, q, notify);
+        QObject::connect(note, &Note::subnotesChanged, q, notify);
+    }
+    void notifyNoteSubscribers(Note *note) {
+        const QHash<Note*, QVector<NotesModel*>>::const_iterator subscribers = noteSubscribers.constFind(note);
+        if (subscribers != noteSubscribers.constEnd()) {
+            for (NotesModel *model : subscribers.value()) {
+                model->notifyNoteChanged(note);
+            }
+        }
+    }
     QHash<QString, SettingsContainer*> settingsContainers;
     QHash<QString, QObject*> namedInstances;
     QHash<Note*, int> noteStateMap;
@@ -229,12 +317,11 @@ public:
     MidiRouter* midiRouter{MidiRouter::instance()};
 
     SyncTimer *syncTimer{nullptr};
-    int beatSubdivision{0};
-    int beatSubdivision2{0};
-    int beatSubdivision3{0};
-    int beatSubdivision4{0};
-    int beatSubdivision5{0};
-    int beatSubdivision6{0};
+    PlaybackBatch playbackBatch;
+    PlaybackProfiler playbackProfiler;
+    // The worker threads used to compile patterns when preparing for playback
+    QThreadPool preparationPool;
+    const PlaybackTiming *timing{&PlaybackTiming::instance()};
     int metronomeBeat4th{0};
     int metronomeBeat8th{0};
     int metronomeBeat16th{0};
@@ -337,12 +424,16 @@ public:
         qDebug() << Q_FUNC_INFO << "We now have the following known grids:" << playgrids;
     }
 
-    Note *findExistingNote(int midiNote, int midiChannel) {
+    Note *findExistingNote(int midiNote, int midiChannel) const {
         Note *note{nullptr};
-        for (Note *aNote : qAsConst(notes)) {
-            if (aNote->midiNote() == midiNote && aNote->midiChannel() == midiChannel) {
-                note = aNote;
-                break;
+        if (-1 <= midiChannel && midiChannel <= 16) {
+            if (0 <= midiNote && midiNote <= 127) {
+                note = plainNotes[midiChannel + 1][midiNote];
+            } else if (midiNote > 127) {
+                Note *compoundNote = compoundNotes.value(midiNote);
+                if (compoundNote && compoundNote->midiChannel() == midiChannel) {
+                    note = compoundNote;
+                }
             }
         }
         return note;
@@ -396,6 +487,8 @@ PlayGridManager::PlayGridManager(QObject* parent)
 
 PlayGridManager::~PlayGridManager()
 {
+    // Make sure no preparation task can report back to us while we go away
+    d->preparationPool.waitForDone();
     delete d;
 }
 
@@ -563,64 +656,85 @@ QObject* PlayGridManager::getNote(int midiNote, int midiChannel)
     Note *note{nullptr};
     // The channel numbers here /are/ invalid - however, we need them to distinguish "invalid" notes while still having a Note to operate with
     if (0 <= midiNote && midiNote <= 127 && -1 <= midiChannel && midiChannel <= 16) {
-        for (Note *aNote : d->notes) {
-            if (aNote->midiNote() == midiNote && aNote->midiChannel() == midiChannel) {
-                note = aNote;
-                break;
-            }
-        }
-        if (!note) {
+        Note *&entry = d->plainNotes[midiChannel + 1][midiNote];
+        if (!entry) {
             static const QString note_int_to_str_map[12]{"C", "C#","D","D#","E","F","F#","G","G#","A","A#","B"};
-            note = new Note(this);
-            note->setName(note_int_to_str_map[midiNote % 12]);
-            note->setMidiNote(midiNote);
-            note->setMidiChannel(midiChannel);
-            QQmlEngine::setObjectOwnership(note, QQmlEngine::CppOwnership);
-            d->notes << note;
+            entry = new Note(this);
+            entry->setName(note_int_to_str_map[midiNote % 12]);
+            entry->setMidiNote(midiNote);
+            entry->setMidiChannel(midiChannel);
+            QQmlEngine::setObjectOwnership(entry, QQmlEngine::CppOwnership);
+            d->connectNoteChanges(entry);
         }
+        note = entry;
     }
     return note;
 }
 
 QObject* PlayGridManager::getCompoundNote(const QVariantList& notes)
 {
-    QObjectList actualNotes;
+    QVector<Note*> subnotes;
+    subnotes.reserve(notes.count());
     for (const QVariant &var : notes) {
-        actualNotes << var.value<QObject*>();
-    }
-    Note *note{nullptr};
-    // Make the compound note's fake note value...
-    int fake_midi_note = 128;
-    int index{1};
-    for (QObject *subnote : actualNotes) {
-        Note *actualSubnote = qobject_cast<Note*>(subnote);
-        if (actualSubnote) {
-            fake_midi_note = fake_midi_note + (index * (127 * actualSubnote->midiNote() + (actualSubnote->midiChannel() + 1)));
-        } else {
+        Note *actualSubnote = qobject_cast<Note*>(var.value<QObject*>());
+        if (!actualSubnote) {
             // BAD CODER! THIS IS NOT A NOTE!
-            fake_midi_note = -1;
-            break;
+            return nullptr;
         }
-        ++index;
+        subnotes << actualSubnote;
     }
-    if (fake_midi_note > 127) {
-        for (Note *aNote : d->notes) {
-            if (aNote->midiNote() == fake_midi_note) {
-                note = aNote;
-                break;
-            }
-        }
-        if (!note) {
-            note = new Note(this);
-            note->setMidiNote(fake_midi_note);
-            note->setSubnotes(notes);
-            QQmlEngine::setObjectOwnership(note, QQmlEngine::CppOwnership);
-            d->notes << note;
+    return getCompoundNote(subnotes);
+}
+
+Note *PlayGridManager::getCompoundNote(const QVector<Note*> &subnotes)
+{
+    // The subnotes are all interned (see getNote), so the list of subnote instances identifies the
+    // compound note exactly. The order is kept as given, since metadata is associated with subnotes
+    // by their position, and a reordered chord is thus not the same compound note.
+    if (subnotes.contains(nullptr)) {
+        return nullptr;
+    }
+    Note *note = d->compoundNotesBySubnotes.value(subnotes);
+    if (!note) {
+        // The compound note's fake midi note only needs to be unique, and above the range of plain notes
+        const int fake_midi_note = 128 + d->compoundNotes.count();
+        QVariantList notes;
+        notes.reserve(subnotes.count());
+        for (Note *subnote : subnotes) {
+            notes << QVariant::fromValue<QObject*>(subnote);
         }
+        note = new Note(this);
+        note->setMidiNote(fake_midi_note);
+        note->setSubnotes(notes);
+        QQmlEngine::setObjectOwnership(note, QQmlEngine::CppOwnership);
+        d->connectNoteChanges(note);
+        d->compoundNotes.insert(fake_midi_note, note);
+        d->compoundNotesBySubnotes.insert(subnotes, note);
     }
     return note;
 }
 
+void PlayGridManager::subscribeToNote(Note *note, NotesModel *model)
+{
+    if (note && model) {
+        QVector<NotesModel*> &subscribers = d->noteSubscribers[note];
+        if (!subscribers.contains(model)) {
+            subscribers << model;
+        }
+    }
+}
+
+void PlayGridManager::unsubscribeFromNote(Note *note, NotesModel *model)
+{
+    const QHash<Note*, QVector<NotesModel*>>::iterator subscribers = d->noteSubscribers.find(note);
+    if (subscribers != d->noteSubscribers.end()) {
+        subscribers.value().removeOne(model);
+        if (subscribers.value().isEmpty()) {
+            d->noteSubscribers.erase(subscribers);
+        }
+    }
+}
+
 QObject* PlayGridManager::getSettingsStore(const QString& name)
 {
     SettingsContainer *settings = d->settingsContainers.value(name);
@@ -671,10 +785,10 @@ QJsonObject PlayGridManager::noteToJsonObject(Note *note) const
     if (note) {
         jsonObject.insert("midiNote", note->midiNote());
         jsonObject.insert("midiChannel", note->midiChannel());
-        if (note->subnotes().count() > 0) {
+        if (note->subnoteCount() > 0) {
             QJsonArray subnoteArray;
-            for (const QVariant &subnote : note->subnotes()) {
-                subnoteArray << noteToJsonObject(subnote.value<Note*>());
+            for (Note *subnote : note->typedSubnotes()) {
+                subnoteArray << noteToJsonObject(subnote);
             }
             jsonObject.insert("subnotes", subnoteArray);
         }
@@ -687,12 +801,12 @@ Note *PlayGridManager::jsonObjectToNote(const QJsonObject &jsonObject)
     Note *note{nullptr};
     if (jsonObject.contains("subnotes")) {
         QJsonArray subnotes = jsonObject["subnotes"].toArray();
-        QVariantList subnotesList;
+        QVector<Note*> subnotesList;
+        subnotesList.reserve(subnotes.count());
         for (const QJsonValue &val : subnotes) {
-            Note *subnote = jsonObjectToNote(val.toObject());
-            subnotesList.append(QVariant::fromValue<QObject*>(subnote));
+            subnotesList << jsonObjectToNote(val.toObject());
         }
-        note = qobject_cast<Note*>(getCompoundNote(subnotesList));
+        note = getCompoundNote(subnotesList);
     } else if (jsonObject.contains("midiNote")) {
         note = qobject_cast<Note*>(getNote(jsonObject.value("midiNote").toInt(), jsonObject.value("midiChannel").toInt()));
     }
@@ -759,50 +873,10 @@ void PlayGridManager::setModelFromJson(QObject* model, const QString& json)
         actualModel->endLongOperation();
     } else if (jsonDoc.isObject()) {
         PatternModel *pattern = qobject_cast<PatternModel*>(model);
-        QJsonObject patternObject = jsonDoc.object();
         if (pattern) {
-            pattern->startLongOperation();
-            setModelFromJson(model, patternObject.value("notes").toString());
-            pattern->setHeight(patternObject.value("height").toInt());
-            pattern->setWidth(patternObject.value("width").toInt());
-            pattern->setMidiChannel(patternObject.value("midiChannel").toInt());
-            pattern->setNoteLength(patternObject.value("noteLength").toInt());
-            pattern->setAvailableBars(patternObject.value("availableBars").toInt());
-            pattern->setActiveBar(patternObject.value("activeBar").toInt());
-            pattern->setBankOffset(patternObject.value("bankOffset").toInt());
-            pattern->setBankLength(patternObject.value("bankLength").toInt());
-            // Because we've not always persisted this... probably wants to go away at some point in the near future
-            if (patternObject.contains("enabled")) {
-                pattern->setEnabled(patternObject.value("enabled").toBool());
-            } else {
-                pattern->setEnabled(true);
-            }
-            if (patternObject.contains("layerData")) {
-                pattern->setLayerData(patternObject.value("layerData").toString());
-            } else {
-                pattern->setLayerData("");
-            }
-            if (patternObject.contains("noteDestination")) {
-                pattern->setNoteDestination(PatternModel::NoteDestination(patternObject.value("noteDestination").toInt()));
-            } else {
-                pattern->setNoteDestination(PatternModel::SynthDestination);
-            }
-            if (patternObject.contains("gridModelStartNote")) {
-                pattern->setGridModelStartNote(patternObject.value("gridModelStartNote").toInt());
-            } else {
-                pattern->setGridModelStartNote(48);
-            }
-            if (patternObject.contains("gridModelEndNote")) {
-                pattern->setGridModelEndNote(patternObject.value("gridModelEndNote").toInt());
-            } else {
-                pattern->setGridModelEndNote(64);
-            }
-            if (patternObject.contains("defaultNoteDuration")) {
-                pattern->setDefaultNoteDuration(patternObject.value("defaultNoteDuration").toInt());
-            } else {
-                pattern->setDefaultNoteDuration(0);
-            }
-            pattern->endLongOperation();
+            PatternFileData patternData;
+            PatternFile::parseJson(jsonDoc.object(), patternData);
+            PatternFile::apply(pattern, patternData);
         }
     }
 }
@@ -884,15 +958,11 @@ void PlayGridManager::setNoteOff(QObject* note)
 void PlayGridManager::setNoteState(Note* note, int velocity, bool setOn)
 {
     if (note) {
-        QObjectList subnotes;
-        const QVariantList tempSubnotes = note->subnotes();
-        for (const QVariant &tempSubnote : tempSubnotes) {
-            subnotes << tempSubnote.value<QObject*>();
-        }
-        int subnoteCount = subnotes.count();
-        if (subnoteCount > 0) {
-            for (QObject *note : subnotes) {
-                setNoteState(qobject_cast<Note*>(note), velocity, setOn);
+        // Copied, as this is recursive (and notes are never changed once created, but let's be safe)
+        const QVector<Note*> subnotes = note->typedSubnotes();
+        if (subnotes.count() > 0) {
+            for (Note *subnote : subnotes) {
+                setNoteState(subnote, velocity, setOn);
             }
         } else {
             if (d->noteStateMap.contains(note)) {
@@ -1010,30 +1080,39 @@ void PlayGridManager::handleMetronomeTick(int beat)
     if (d->segmentHandler == nullptr) {
         d->segmentHandler = SegmentHandler::instance();
     }
-    d->segmentHandler->progressPlayback();
+    PlaybackProfilerScope tickScope(&d->playbackProfiler, PlaybackProfiler::TickStage);
+    {
+        PlaybackProfilerScope segmentScope(&d->playbackProfiler, PlaybackProfiler::SegmentProgressionStage);
+        d->segmentHandler->progressPlayback();
+    }
     Q_EMIT metronomeTick();
-    if (beat % d->beatSubdivision6 == 0) {
-        d->metronomeBeat128th = beat / d->beatSubdivision6;
+    {
+        // All the sequences have now added their events for this tick, so hand them over to SyncTimer
+        PlaybackProfilerScope submissionScope(&d->playbackProfiler, PlaybackProfiler::BatchSubmissionStage);
+        d->playbackBatch.submit();
+    }
+    if (beat % d->timing->beatSubdivision(6) == 0) {
+        d->metronomeBeat128th = beat / d->timing->beatSubdivision(6);
         Q_EMIT metronomeBeat128thChanged();
     }
-    if (beat % d->beatSubdivision5 == 0) {
-        d->metronomeBeat64th = beat / d->beatSubdivision5;
+    if (beat % d->timing->beatSubdivision(5) == 0) {
+        d->metronomeBeat64th = beat / d->timing->beatSubdivision(5);
         Q_EMIT metronomeBeat64thChanged();
     }
-    if (beat % d->beatSubdivision4 == 0) {
-        d->metronomeBeat32nd = beat / d->beatSubdivision4;
+    if (beat % d->timing->beatSubdivision(4) == 0) {
+        d->metronomeBeat32nd = beat / d->timing->beatSubdivision(4);
         Q_EMIT metronomeBeat32ndChanged();
     }
-    if (beat % d->beatSubdivision3 == 0) {
-        d->metronomeBeat16th = beat / d->beatSubdivision3;
+    if (beat % d->timing->beatSubdivision(3) == 0) {
+        d->metronomeBeat16th = beat / d->timing->beatSubdivision(3);
         Q_EMIT metronomeBeat16thChanged();
     }
-    if (beat % d->beatSubdivision2 == 0) {
-        d->metronomeBeat8th = beat / d->beatSubdivision2;
+    if (beat % d->timing->beatSubdivision(2) == 0) {
+        d->metronomeBeat8th = beat / d->timing->beatSubdivision(2);
         Q_EMIT metronomeBeat8thChanged();
     }
-    if (beat % d->beatSubdivision == 0) {
-        d->metronomeBeat4th = beat / d->beatSubdivision;
+    if (beat % d->timing->beatSubdivision(1) == 0) {
+        d->metronomeBeat4th = beat / d->timing->beatSubdivision(1);
         Q_EMIT metronomeBeat4thChanged();
     }
 }
@@ -1076,6 +1155,7 @@ void PlayGridManager::setSyncTimer(QObject* syncTimer)
             d->syncTimer->disconnect(this);
         }
         d->syncTimer = qobject_cast<SyncTimer*>(syncTimer);
+        d->playbackBatch.setSyncTimer(d->syncTimer);
         if (d->syncTimer) {
             d->syncTimer->addCallback(&timer_callback);
             connect(d->syncTimer, &SyncTimer::timerRunningChanged, this, &PlayGridManager::metronomeActiveChanged);
@@ -1089,6 +1169,124 @@ QObject* PlayGridManager::syncTimer()
     return d->syncTimer;
 }
 
+PlaybackBatch *PlayGridManager::playbackBatch() const
+{
+    return &d->playbackBatch;
+}
+
+int PlayGridManager::schedulerCallsLastTick() const
+{
+    return d->playbackBatch.schedulerCallsLastTick();
+}
+
+int PlayGridManager::schedulerCallsPeak() const
+{
+    return d->playbackBatch.schedulerCallsPeak();
+}
+
+void PlayGridManager::resetSchedulerCallsPeak()
+{
+    d->playbackBatch.resetSchedulerCallsPeak();
+}
+
+PlaybackProfiler *PlayGridManager::playbackProfiler() const
+{
+    return &d->playbackProfiler;
+}
+
+bool PlayGridManager::playbackProfilingEnabled() const
+{
+    return d->playbackProfiler.isEnabled();
+}
+
+void PlayGridManager::setPlaybackProfilingEnabled(bool playbackProfilingEnabled)
+{
+    if (d->playbackProfiler.isEnabled() != playbackProfilingEnabled) {
+        d->playbackProfiler.setEnabled(playbackProfilingEnabled);
+        Q_EMIT playbackProfilingEnabledChanged();
+    }
+}
+
+QVariantMap PlayGridManager::playbackProfile() const
+{
+    QVariantMap stages;
+    for (int stage = 0; stage < PlaybackProfiler::StageCount; ++stage) {
+        const PlaybackProfiler::Stage theStage{PlaybackProfiler::Stage(stage)};
+        stages[PlaybackProfiler::stageName(theStage)] = d->playbackProfiler.stage(theStage)->summary();
+    }
+    QVariantMap patterns;
+    for (QHash<QString, PatternModel*>::const_iterator patternEntry = d->patternModels.constBegin(); patternEntry != d->patternModels.constEnd(); ++patternEntry) {
+        PatternModel *pattern = patternEntry.value();
+        if (pattern && pattern->playbackTimings()->count() > 0) {
+            // Pattern names are not unique (clones share them, as can patterns in different sequences), but
+            // a position in a sequence is, and patterns outside of any sequence use the name we know them by
+            const SequenceModel *sequence = qobject_cast<const SequenceModel*>(pattern->sequence());
+            const QString key{sequence
+                ? QString("%1/%2").arg(sequence->objectName()).arg(sequence->indexOf(pattern))
+                : QString("orphaned/%1").arg(patternEntry.key())};
+            patterns[key] = pattern->playbackTimings()->summary();
+        }
+    }
+    QVariantMap profile;
+    profile["enabled"] = d->playbackProfiler.isEnabled();
+    profile["stages"] = stages;
+    profile["patterns"] = patterns;
+    return profile;
+}
+
+void PlayGridManager::resetPlaybackProfile()
+{
+    d->playbackProfiler.reset();
+    for (PatternModel *pattern : qAsConst(d->patternModels)) {
+        if (pattern) {
+            pattern->playbackTimings()->reset();
+        }
+    }
+}
+
+bool PlayGridManager::dumpPlaybackProfile(const QString &filename) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << Q_FUNC_INFO << "Could not open" << filename << "for writing the playback profile:" << file.errorString();
+        return false;
+    }
+    const QByteArray data{QJsonDocument::fromVariant(playbackProfile()).toJson()};
+    if (file.write(data) != data.size()) {
+        qWarning() << Q_FUNC_INFO << "Failed to write the playback profile to" << filename << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void PlayGridManager::preparePatternsForPlayback(const QList<SequenceModel*> &sequences, std::function<void()> finished)
+{
+    QSharedPointer<PatternPreparationBatch> batch{new PatternPreparationBatch};
+    batch->finished = finished;
+    for (SequenceModel *sequence : sequences) {
+        if (sequence) {
+            for (int patternIndex = 0; patternIndex < sequence->rowCount(); ++patternIndex) {
+                PatternModel *pattern = qobject_cast<PatternModel*>(sequence->get(patternIndex));
+                if (pattern && pattern->needsPlaybackPreparation()) {
+                    batch->patterns << pattern;
+                    // The workers only ever see this plain copy of the pattern's data, never the pattern itself
+                    batch->preparations << pattern->createPlaybackPreparation();
+                }
+            }
+        }
+    }
+    if (batch->patterns.isEmpty()) {
+        if (finished) {
+            finished();
+        }
+        return;
+    }
+    Q_EMIT taskMessage(QString("Preparing %1 patterns for playback").arg(batch->patterns.count()));
+    for (int index = 0; index < batch->patterns.count(); ++index) {
+        d->preparationPool.start(new PatternPreparationTask(this, batch, index));
+    }
+}
+
 void hookUpAndMaybeStartTimer(PlayGridManager* pgm, bool startTimer = false)
 {
     // If we've already registered ourselves to get a callback, don't do that again, it just gets silly
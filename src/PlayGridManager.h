@@ -26,10 +26,16 @@
 #include <QCoreApplication>
 #include <QVariantMap>
 #include <QJsonObject>
+#include <QVector>
+
+#include <functional>
 
 class SequenceModel;
 class QQmlEngine;
 class Note;
+class NotesModel;
+class PlaybackBatch;
+class PlaybackProfiler;
 class PlayGridManager : public QObject
 {
     Q_OBJECT
@@ -95,6 +101,13 @@ class PlayGridManager : public QObject
      */
     Q_PROPERTY(int currentMidiChannel READ currentMidiChannel WRITE setCurrentMidiChannel NOTIFY currentMidiChannelChanged)
 
+    /**
+     * \brief Whether the per-tick playback timings are being recorded
+     * @see playbackProfile()
+     * @default false
+     */
+    Q_PROPERTY(bool playbackProfilingEnabled READ playbackProfilingEnabled WRITE setPlaybackProfilingEnabled NOTIFY playbackProfilingEnabledChanged)
+
     Q_PROPERTY(QObject* syncTimer READ syncTimer WRITE setSyncTimer NOTIFY syncTimerChanged)
     Q_PROPERTY(bool metronomeActive READ metronomeActive NOTIFY metronomeActiveChanged)
     Q_PROPERTY(int metronomeBeat4th READ metronomeBeat4th NOTIFY metronomeBeat4thChanged)
@@ -181,6 +194,13 @@ public:
     Q_INVOKABLE QObject* getNotesModel(const QString &name);
     Q_INVOKABLE QObject* getNote(int midiNote, int midiChannel = 0);
     Q_INVOKABLE QObject* getCompoundNote(const QVariantList &notes);
+    /**
+     * \brief Get the compound note made up of the given subnotes, for use from C++
+     * This is the same as the QVariantList version, without needing the subnotes wrapped in QVariants
+     * @param subnotes The subnotes (all of which must be valid notes) of the compound note
+     * @return The compound note, or null if any of the subnotes were null
+     */
+    Note *getCompoundNote(const QVector<Note*> &subnotes);
     Q_INVOKABLE QObject* getSettingsStore(const QString &name);
     /**
      * \brief Get a named instance of some QML type (newly created, or the same instance)
@@ -314,6 +334,91 @@ public:
     void setSyncTimer(QObject *syncTimer);
     Q_SIGNAL void syncTimerChanged();
 
+    /**
+     * \brief The batch which collects the events scheduled by all patterns during a single metronome tick
+     * This is only for use by the playback code, and must only be used on the timer thread
+     * @return The per-tick playback batch
+     */
+    PlaybackBatch *playbackBatch() const;
+    /**
+     * \brief The number of calls made to SyncTimer's midi buffer scheduling during the most recent metronome tick
+     */
+    Q_INVOKABLE int schedulerCallsLastTick() const;
+    /**
+     * \brief The largest number of calls made to SyncTimer's midi buffer scheduling during any single metronome tick
+     * @see resetSchedulerCallsPeak()
+     */
+    Q_INVOKABLE int schedulerCallsPeak() const;
+    /**
+     * \brief Reset the peak number of scheduler calls per tick to zero
+     */
+    Q_INVOKABLE void resetSchedulerCallsPeak();
+
+    /**
+     * \brief Ask to be told about changes to the given note
+     *
+     * Rather than every model connecting to the signals of every note it contains (and notes are shared
+     * between all models), PlayGridManager connects to each note once, and passes changes to its name,
+     * midi note, midi channel, playing state and subnotes on to the models subscribed to that note, by
+     * calling NotesModel::notifyNoteChanged(). Subscribing more than once has no further effect.
+     * @param note The note to be told about
+     * @param model The model which wants to be told about it
+     */
+    void subscribeToNote(Note *note, NotesModel *model);
+    /**
+     * \brief Stop telling the given model about changes to the given note
+     * @param note The note the model no longer wants to be told about
+     * @param model The model which was subscribed to the note
+     */
+    void unsubscribeFromNote(Note *note, NotesModel *model);
+
+    /**
+     * \brief Build the playback events for all the patterns in the given sequences which need it
+     *
+     * The events are built in parallel, spread across all available cores, from plain copies of the
+     * patterns' data. This function does not wait for that to happen: progress is reported through
+     * taskMessage, and once everything is done, the results are handed to playback and the finished
+     * function is called (both on this thread). Start playback from there, so the first pass through
+     * each pattern does not have to wait for its playback events to be built.
+     * @note If none of the patterns need preparing, finished is called before this function returns
+     * @param sequences The sequences whose patterns should be prepared
+     * @param finished Called once all the patterns have been prepared
+     */
+    void preparePatternsForPlayback(const QList<SequenceModel*> &sequences, std::function<void()> finished = nullptr);
+
+    /**
+     * \brief The profiler used to record the per-tick playback timings
+     * This is only for use by the playback code
+     */
+    PlaybackProfiler *playbackProfiler() const;
+    bool playbackProfilingEnabled() const;
+    void setPlaybackProfilingEnabled(bool playbackProfilingEnabled);
+    Q_SIGNAL void playbackProfilingEnabledChanged();
+    /**
+     * \brief The playback timings recorded since profiling was last reset
+     *
+     * The map contains a "stages" map, with an entry for each stage of the metronome tick (tick,
+     * segmentProgression, sequenceAdvancement, patternAdvancement and batchSubmission), and a
+     * "patterns" map, with an entry for each pattern which has recorded any timings (keyed by the
+     * name of the pattern's sequence and the pattern's index in it, such as "T1/3", or for patterns
+     * which are not in a sequence, "orphaned/" followed by the name the pattern was fetched by). Each entry is a map of the count, and the min, max, mean, p50 and p99 durations,
+     * all in nanoseconds.
+     * @return The recorded timings
+     * @see playbackProfilingEnabled
+     */
+    Q_INVOKABLE QVariantMap playbackProfile() const;
+    /**
+     * \brief Clear all the recorded playback timings
+     */
+    Q_INVOKABLE void resetPlaybackProfile();
+    /**
+     * \brief Write the recorded playback timings to a file, as json
+     * @param filename The file to write the timings to (it will be overwritten if it exists)
+     * @return True if the file was written successfully, false if not
+     * @see playbackProfile()
+     */
+    Q_INVOKABLE bool dumpPlaybackProfile(const QString &filename) const;
+
     // Hook up the playgrid manager to the global timer, without actually starting it
     Q_INVOKABLE void hookUpTimer();
     // Hook up the playgrid to the global timer, and request that it be started
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PlaybackBatch.h"
+
+#include <algorithm>
+#include <atomic>
+
+// Hackety hack - we don't need all the thing, just need some storage things (MidiBuffer specifically)
+#define JUCE_GLOBAL_MODULE_SETTINGS_INCLUDED 1
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include <SyncTimer.h>
+
+// The number of events a batch can hold before it has to be submitted early
+#define PlaybackBatchCapacity 4096
+
+struct BatchedEvent {
+    quint64 delay{0};
+    // The order the event was added in, so sorting by delay keeps the patterns' own ordering intact
+    int order{0};
+    unsigned char message[3]{0, 0, 0};
+    unsigned char sampleNumber{0};
+};
+
+class PlaybackBatchPrivate {
+public:
+    PlaybackBatchPrivate() {
+        events = new BatchedEvent[PlaybackBatchCapacity];
+        // Each event is three bytes of message, plus juce's timestamp and size header, so sixteen bytes is plenty
+        buffer.ensureSize(PlaybackBatchCapacity * 16);
+    }
+    ~PlaybackBatchPrivate() {
+        delete[] events;
+    }
+    SyncTimer *syncTimer{nullptr};
+    BatchedEvent *events{nullptr};
+    int eventCount{0};
+    int schedulerCallsThisTick{0};
+    std::atomic<int> schedulerCallsLastTick{0};
+    std::atomic<int> schedulerCallsPeak{0};
+    juce::MidiBuffer buffer;
+
+    void scheduleEvents() {
+        if (syncTimer && eventCount > 0) {
+            std::sort(events, events + eventCount, [](const BatchedEvent &a, const BatchedEvent &b) {
+                return a.delay < b.delay || (a.delay == b.delay && a.order < b.order);
+            });
+            int eventIndex{0};
+            while (eventIndex < eventCount) {
+                const quint64 delay{events[eventIndex].delay};
+                buffer.clear();
+                for (; eventIndex < eventCount && events[eventIndex].delay == delay; ++eventIndex) {
+                    buffer.addEvent(events[eventIndex].message, 3, events[eventIndex].sampleNumber);
+                }
+                syncTimer->scheduleMidiBuffer(buffer, delay);
+                ++schedulerCallsThisTick;
+            }
+        }
+        eventCount = 0;
+    }
+};
+
+PlaybackBatch::PlaybackBatch()
+    : d(new PlaybackBatchPrivate)
+{
+}
+
+PlaybackBatch::~PlaybackBatch()
+{
+    delete d;
+}
+
+void PlaybackBatch::setSyncTimer(SyncTimer* syncTimer)
+{
+    d->syncTimer = syncTimer;
+}
+
+void PlaybackBatch::addEvent(quint64 delay, const unsigned char* message, int sampleNumber)
+{
+    if (d->eventCount == PlaybackBatchCapacity) {
+        d->scheduleEvents();
+    }
+    BatchedEvent &event = d->events[d->eventCount];
+    event.delay = delay;
+    event.order = d->eventCount;
+    event.message[0] = message[0];
+    event.message[1] = message[1];
+    event.message[2] = message[2];
+    event.sampleNumber = sampleNumber;
+    ++d->eventCount;
+}
+
+void PlaybackBatch::submit()
+{
+    d->scheduleEvents();
+    d->schedulerCallsLastTick.store(d->schedulerCallsThisTick);
+    if (d->schedulerCallsThisTick > d->schedulerCallsPeak.load()) {
+        d->schedulerCallsPeak.store(d->schedulerCallsThisTick);
+    }
+    d->schedulerCallsThisTick = 0;
+}
+
+int PlaybackBatch::schedulerCallsLastTick() const
+{
+    return d->schedulerCallsLastTick.load();
+}
+
+int PlaybackBatch::schedulerCallsPeak() const
+{
+    return d->schedulerCallsPeak.load();
+}
+
+void PlaybackBatch::resetSchedulerCallsPeak()
+{
+    d->schedulerCallsPeak.store(0);
+}
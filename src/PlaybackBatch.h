@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PLAYBACKBATCH_H
+#define PLAYBACKBATCH_H
+
+#include <QtGlobal>
+
+class SyncTimer;
+class PlaybackBatchPrivate;
+/**
+ * \brief Collects the midi events for a single tick of the sequencer, and hands them to SyncTimer together
+ *
+ * During a metronome tick, every pattern in every sequence adds the events it wants scheduled to the
+ * batch owned by PlayGridManager (see PlayGridManager::playbackBatch()). Once all sequences have been
+ * advanced, PlayGridManager submits the batch, which merges the events into buffers sorted by delay, and
+ * schedules a single buffer for each distinct delay (rather than one for each delay of each pattern).
+ *
+ * The batch is preallocated, and neither adding nor submitting events allocates memory. Other than the
+ * scheduler call counters, it must only be used from the timer thread.
+ */
+class PlaybackBatch {
+public:
+    explicit PlaybackBatch();
+    ~PlaybackBatch();
+
+    /**
+     * \brief Set the timer the batch should hand its events to
+     * @param syncTimer The timer to schedule events with
+     */
+    void setSyncTimer(SyncTimer *syncTimer);
+
+    /**
+     * \brief Add a three byte midi message to the batch
+     * If the batch is full, the events already in it are submitted to make room for the new one
+     * @param delay The delay (in SyncTimer ticks, counting from the current tick) of the message
+     * @param message The three bytes of the midi message
+     * @param sampleNumber The position of the message in its buffer (used to make off events go before on events)
+     */
+    void addEvent(quint64 delay, const unsigned char *message, int sampleNumber);
+    /**
+     * \brief Schedule all the events in the batch with SyncTimer, and clear the batch
+     * This also marks the end of the tick for the scheduler call counters
+     */
+    void submit();
+
+    /**
+     * \brief The number of calls made to SyncTimer::scheduleMidiBuffer during the most recently submitted tick
+     */
+    int schedulerCallsLastTick() const;
+    /**
+     * \brief The largest number of calls made to SyncTimer::scheduleMidiBuffer during any single tick
+     * @see resetSchedulerCallsPeak()
+     */
+    int schedulerCallsPeak() const;
+    /**
+     * \brief Reset the peak scheduler call count to zero
+     */
+    void resetSchedulerCallsPeak();
+private:
+    PlaybackBatchPrivate *d;
+};
+
+#endif//PLAYBACKBATCH_H
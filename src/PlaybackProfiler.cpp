@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PlaybackProfiler.h"
+
+#include <limits>
+
+PlaybackHistogram::PlaybackHistogram()
+{
+    reset();
+}
+
+void PlaybackHistogram::reset()
+{
+    for (int bucket = 0; bucket < PlaybackHistogramBucketCount; ++bucket) {
+        m_buckets[bucket].store(0);
+    }
+    m_count.store(0);
+    m_total.store(0);
+    m_minimum.store(std::numeric_limits<quint64>::max());
+    m_maximum.store(0);
+}
+
+quint64 PlaybackHistogram::count() const
+{
+    return m_count.load();
+}
+
+quint64 PlaybackHistogram::bucketLowerBound(int bucket)
+{
+    if (bucket < 8) {
+        return quint64(bucket);
+    }
+    const int exponent{(bucket / 8) + 2};
+    return quint64(8 + (bucket % 8)) << (exponent - 3);
+}
+
+quint64 PlaybackHistogram::percentile(double fraction, quint64 count) const
+{
+    // The value we report is the top of the bucket the percentile lands in, clamped to what was actually seen
+    const quint64 target{qMax(quint64(1), quint64(fraction * count + 0.5))};
+    quint64 seen{0};
+    for (int bucket = 0; bucket < PlaybackHistogramBucketCount; ++bucket) {
+        seen += m_buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            const quint64 top{bucket + 1 < PlaybackHistogramBucketCount ? bucketLowerBound(bucket + 1) - 1 : std::numeric_limits<quint64>::max()};
+            return qBound(m_minimum.load(std::memory_order_relaxed), top, m_maximum.load(std::memory_order_relaxed));
+        }
+    }
+    return m_maximum.load(std::memory_order_relaxed);
+}
+
+QVariantMap PlaybackHistogram::summary() const
+{
+    QVariantMap summary;
+    const quint64 count{m_count.load()};
+    summary["count"] = count;
+    if (count > 0) {
+        summary["min"] = m_minimum.load();
+        summary["max"] = m_maximum.load();
+        summary["mean"] = m_total.load() / count;
+        summary["p50"] = percentile(0.5, count);
+        summary["p99"] = percentile(0.99, count);
+    }
+    return summary;
+}
+
+PlaybackProfiler::PlaybackProfiler()
+{
+}
+
+void PlaybackProfiler::setEnabled(bool enabled)
+{
+    m_enabled.store(enabled);
+}
+
+QString PlaybackProfiler::stageName(Stage stage)
+{
+    switch (stage) {
+        case TickStage:
+            return QLatin1String("tick");
+        case SegmentProgressionStage:
+            return QLatin1String("segmentProgression");
+        case SequenceAdvancementStage:
+            return QLatin1String("sequenceAdvancement");
+        case PatternAdvancementStage:
+            return QLatin1String("patternAdvancement");
+        case BatchSubmissionStage:
+            return QLatin1String("batchSubmission");
+        case StageCount:
+        default:
+            break;
+    }
+    return QString();
+}
+
+void PlaybackProfiler::reset()
+{
+    for (int stage = 0; stage < StageCount; ++stage) {
+        m_stages[stage].reset();
+    }
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PLAYBACKPROFILER_H
+#define PLAYBACKPROFILER_H
+
+#include <QString>
+#include <QVariantMap>
+
+#include <atomic>
+#include <chrono>
+
+// The number of buckets in a PlaybackHistogram (eight per doubling, which covers up to around 17 seconds)
+#define PlaybackHistogramBucketCount 256
+
+/**
+ * \brief A lock-free histogram of durations, in nanoseconds
+ *
+ * Recording a value never blocks and never allocates, so this is safe to use from the timer thread.
+ * Each doubling of the duration is split into eight buckets, which means the percentiles reported by
+ * summary() are accurate to within an eighth of their value. Reading the summary while values are
+ * being recorded is fine, though the result may then be very slightly inconsistent.
+ */
+class PlaybackHistogram {
+public:
+    explicit PlaybackHistogram();
+
+    /**
+     * \brief Record a single duration
+     * @param nanoseconds The duration to record
+     */
+    inline void record(quint64 nanoseconds) {
+        m_buckets[bucketForValue(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_total.fetch_add(nanoseconds, std::memory_order_relaxed);
+        quint64 minimum{m_minimum.load(std::memory_order_relaxed)};
+        while (nanoseconds < minimum && !m_minimum.compare_exchange_weak(minimum, nanoseconds, std::memory_order_relaxed)) {}
+        quint64 maximum{m_maximum.load(std::memory_order_relaxed)};
+        while (nanoseconds > maximum && !m_maximum.compare_exchange_weak(maximum, nanoseconds, std::memory_order_relaxed)) {}
+    }
+    /**
+     * \brief Clear all the recorded values
+     */
+    void reset();
+    /**
+     * \brief The number of values recorded since the last reset
+     */
+    quint64 count() const;
+    /**
+     * \brief A summary of the recorded values
+     * @return A map containing the count, and the min, max, mean, p50 and p99 durations in nanoseconds
+     */
+    QVariantMap summary() const;
+private:
+    static inline int bucketForValue(quint64 value) {
+        if (value < 8) {
+            return int(value);
+        }
+        const int exponent{63 - int(qCountLeadingZeroBits(value))};
+        return qMin(((exponent - 2) * 8) + int((value >> (exponent - 3)) & 7), PlaybackHistogramBucketCount - 1);
+    }
+    static quint64 bucketLowerBound(int bucket);
+    quint64 percentile(double fraction, quint64 count) const;
+    std::atomic<quint32> m_buckets[PlaybackHistogramBucketCount];
+    std::atomic<quint64> m_count{0};
+    std::atomic<quint64> m_total{0};
+    std::atomic<quint64> m_minimum;
+    std::atomic<quint64> m_maximum{0};
+};
+
+/**
+ * \brief Timing instrumentation for the sequencer's per-tick playback work
+ *
+ * The profiler is always compiled in, but does nothing (beyond checking whether it is enabled) until
+ * it is switched on using setEnabled(). While enabled, each stage of the metronome tick records how
+ * long it took into its own histogram (see PlaybackProfilerScope). The profiler is owned by
+ * PlayGridManager, which also exposes the results to QML (see PlayGridManager::playbackProfile()).
+ */
+class PlaybackProfiler {
+public:
+    enum Stage {
+        // The entirety of PlayGridManager::handleMetronomeTick
+        TickStage = 0,
+        // SegmentHandler::progressPlayback
+        SegmentProgressionStage,
+        // A single call to SequenceModel::advanceSequence
+        SequenceAdvancementStage,
+        // A single call to PatternModel::handleSequenceAdvancement
+        PatternAdvancementStage,
+        // Submitting the tick's merged events to SyncTimer
+        BatchSubmissionStage,
+        StageCount
+    };
+    explicit PlaybackProfiler();
+
+    inline bool isEnabled() const {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+    void setEnabled(bool enabled);
+    /**
+     * \brief The histogram for the given stage
+     */
+    inline PlaybackHistogram *stage(Stage stage) {
+        return &m_stages[stage];
+    }
+    /**
+     * \brief A human readable name for the given stage
+     */
+    static QString stageName(Stage stage);
+    /**
+     * \brief Clear the stage histograms
+     */
+    void reset();
+    /**
+     * \brief The current time, in nanoseconds, from a monotonic clock
+     */
+    static inline quint64 timestamp() {
+        return quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+private:
+    std::atomic<bool> m_enabled{false};
+    PlaybackHistogram m_stages[StageCount];
+};
+
+/**
+ * \brief Records the time between its construction and destruction into a profiler stage
+ *
+ * If the profiler is not enabled when the scope is constructed, nothing at all is recorded, and the
+ * clock is not read. An optional second histogram can be given, which will receive the same duration
+ * (this is used to record per-pattern timings alongside the pattern stage).
+ */
+class PlaybackProfilerScope {
+public:
+    explicit PlaybackProfilerScope(PlaybackProfiler *profiler, PlaybackProfiler::Stage stage, PlaybackHistogram *additional = nullptr)
+        : m_stage(profiler && profiler->isEnabled() ? profiler->stage(stage) : nullptr)
+        , m_additional(additional)
+        , m_start(m_stage ? PlaybackProfiler::timestamp() : 0)
+    {}
+    ~PlaybackProfilerScope() {
+        if (m_stage) {
+            const quint64 elapsed{PlaybackProfiler::timestamp() - m_start};
+            m_stage->record(elapsed);
+            if (m_additional) {
+                m_additional->record(elapsed);
+            }
+        }
+    }
+private:
+    PlaybackHistogram *m_stage{nullptr};
+    PlaybackHistogram *m_additional{nullptr};
+    quint64 m_start{0};
+};
+
+#endif//PLAYBACKPROFILER_H
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PlaybackTiming.h"
+
+#include <libzl.h>
+#include <SyncTimer.h>
+
+const PlaybackTiming &PlaybackTiming::instance()
+{
+    static const PlaybackTiming instance{qobject_cast<SyncTimer*>(SyncTimer_instance())->getMultiplier()};
+    return instance;
+}
+
+PlaybackTiming::PlaybackTiming(int multiplier)
+{
+    m_beatSubdivisions[0] = 0;
+    m_ticksPerStep[0] = 0;
+    for (int noteLength = 1; noteLength <= NOTE_LENGTH_MAX; ++noteLength) {
+        m_beatSubdivisions[noteLength] = multiplier >> noteLengthDetailsTable[noteLength].subdivisionShift;
+        m_ticksPerStep[noteLength] = m_beatSubdivisions[noteLength];
+    }
+    // The shortest note length has always been played on every tick
+    m_ticksPerStep[NOTE_LENGTH_MAX] = 1;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PLAYBACKTIMING_H
+#define PLAYBACKTIMING_H
+
+#include <QtGlobal>
+
+// The largest note length a pattern can have (note lengths go from 1 through this)
+#define NOTE_LENGTH_MAX 6
+
+/**
+ * \brief The fixed timing details of one of the note lengths a pattern can have
+ *
+ * Patterns operate internally at 32ppqn. A note length of 1 means each step is a quarter note long,
+ * and each subsequent note length halves that, down to a 128th note for note length 6.
+ */
+struct NoteLengthDetails {
+    // How many times the number of timer ticks in a quarter note is halved to get the ticks in a step
+    int subdivisionShift;
+    // The duration of a step, in the pattern's internal 32ppqn
+    int noteDuration;
+};
+
+/**
+ * \brief The note length details, indexed by note length
+ * Index 0 is not a valid note length, and is only there to make indexing by note length simple
+ */
+static constexpr NoteLengthDetails noteLengthDetailsTable[NOTE_LENGTH_MAX + 1]{
+    {0, 0},
+    {0, 32},
+    {1, 16},
+    {2, 8},
+    {3, 4},
+    {4, 2},
+    {5, 1},
+};
+static_assert(noteLengthDetailsTable[NOTE_LENGTH_MAX].noteDuration == 1, "The shortest note length must be one 32ppqn tick long");
+
+/**
+ * \brief The timing table used during playback, combining the note length details with SyncTimer's multiplier
+ *
+ * This is shared by everything which needs to convert between timer ticks and pattern steps (see
+ * instance()). It does not change once created, so it is safe to use from any thread.
+ */
+class PlaybackTiming {
+public:
+    /**
+     * \brief The timing table for the global SyncTimer instance
+     */
+    static const PlaybackTiming &instance();
+    /**
+     * \brief Create a timing table for a timer with the given multiplier
+     * @param multiplier The number of timer ticks in a quarter note (see SyncTimer::getMultiplier())
+     */
+    explicit PlaybackTiming(int multiplier);
+
+    /**
+     * \brief Whether the given note length is one patterns know how to play
+     */
+    inline bool isValidNoteLength(int noteLength) const {
+        return noteLength > 0 && noteLength <= NOTE_LENGTH_MAX;
+    }
+    /**
+     * \brief The number of timer ticks in a note of the given subdivision
+     * @param subdivision 1 for quarter notes, 2 for eighth notes, and so on down to 6 for 128th notes
+     */
+    inline int beatSubdivision(int subdivision) const {
+        return m_beatSubdivisions[subdivision];
+    }
+    /**
+     * \brief The number of timer ticks between the steps of a pattern with the given note length
+     * @note Note length 6 advances one step on every tick, whatever the multiplier is
+     */
+    inline int ticksPerStep(int noteLength) const {
+        return m_ticksPerStep[noteLength];
+    }
+    /**
+     * \brief The duration of a step of a pattern with the given note length, in the pattern's internal 32ppqn
+     */
+    inline int noteDuration(int noteLength) const {
+        return noteLengthDetailsTable[noteLength].noteDuration;
+    }
+    /**
+     * \brief Find the step a timer tick lands on for the given note length
+     * @param noteLength The note length to find the step for
+     * @param tick The timer tick to convert
+     * @param step If the tick lands on a step, this will be set to that step's position
+     * @return True if the tick lands on a step, false if not (or if the note length is invalid)
+     */
+    inline bool stepForTick(int noteLength, quint64 tick, quint64 &step) const {
+        if (isValidNoteLength(noteLength)) {
+            const quint64 ticks{quint64(m_ticksPerStep[noteLength])};
+            if (tick % ticks == 0) {
+                step = tick / ticks;
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    int m_beatSubdivisions[NOTE_LENGTH_MAX + 1];
+    int m_ticksPerStep[NOTE_LENGTH_MAX + 1];
+};
+
+#endif//PLAYBACKTIMING_H
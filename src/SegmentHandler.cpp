@@ -32,6 +32,7 @@
 #include "TimerCommand.h"
 
 #include <QDebug>
+#include <QPointer>
 #include <QTimer>
 #include <QVariant>
 
@@ -97,6 +98,9 @@ public:
     quint64 playhead{0};
     QHash<quint64, QList<TimerCommand*> > playlist;
     QList<ClipAudioSource*> runningLoops;
+    // Identifies the most recent request to start playback, so one which was stopped (or replaced) while
+    // its patterns were being prepared does not go on to start the timer once they are done
+    int playbackPreparationId{0};
 
     inline void ensureTimerClipCommand(TimerCommand* command) {
         if (command->dataParameter == nullptr) {
@@ -316,14 +320,21 @@ public Q_SLOTS:
         setZLSelectedSketch(sketch);
     }
     void fetchSequenceModels() {
+        // Fetch the sequences without loading them, so any which have not been loaded yet can be loaded all in one go
+        QList<SequenceModel*> unloadedSequences;
         for (int i = 1; i < 11; ++i) {
-            SequenceModel *sequence = qobject_cast<SequenceModel*>(d->playGridManager->getSequenceModel(QString("T%1").arg(i)));
+            SequenceModel *sequence = qobject_cast<SequenceModel*>(d->playGridManager->getSequenceModel(QString("T%1").arg(i), false));
             if (sequence) {
                 d->sequenceModels << sequence;
+                // A sequence which has been loaded always has its full set of patterns
+                if (sequence->get(0) == nullptr && !sequence->isLoading()) {
+                    unloadedSequences << sequence;
+                }
             } else {
                 qWarning() << Q_FUNC_INFO << "Sequence" << i << "could not be fetched, and will be unavailable for playback management";
             }
         }
+        SequenceModel::loadSequences(unloadedSequences);
     }
     void updateSegments() {
         static const QLatin1String sampleLoopedType{"sample-loop"};
@@ -511,19 +522,36 @@ void SegmentHandler::startPlayback(quint64 startOffset, quint64 duration)
         d->syncTimer->scheduleTimerCommand(duration, stopCommand);
     }
     // Hook up the global sequences to playback
+    QList<SequenceModel*> sequences;
+    QList<QPointer<SequenceModel>> guardedSequences;
     for (int i = 1; i < 11; ++i) {
         SequenceModel *sequence = qobject_cast<SequenceModel*>(d->playGridManager->getSequenceModel(QString("T%1").arg(i)));
         if (sequence) {
-            sequence->prepareSequencePlayback();
+            sequences << sequence;
+            guardedSequences << sequence;
         } else {
             qDebug() << Q_FUNC_INFO << "Sequence" << i << "could not be fetched, and playback could not be prepared";
         }
     }
-    d->playGridManager->startMetronome();
+    // Prepare all the global sequences' patterns in one go, so the work is spread across as many cores as
+    // we can get, and only start the timer once they are ready
+    const int playbackPreparationId{++d->playbackPreparationId};
+    d->playGridManager->preparePatternsForPlayback(sequences, [this, playbackPreparationId, guardedSequences](){
+        if (playbackPreparationId == d->playbackPreparationId) {
+            for (SequenceModel *sequence : guardedSequences) {
+                if (sequence) {
+                    sequence->prepareSequencePlayback();
+                }
+            }
+            d->playGridManager->startMetronome();
+        }
+    });
 }
 
 void SegmentHandler::stopPlayback()
 {
+    // If we are still waiting for the patterns to be prepared, we should no longer start once they are
+    ++d->playbackPreparationId;
     // Disconnect the global sequences
     for (SequenceModel* sequence : qAsConst(d->sequenceModels)) {
         sequence->disconnectSequencePlayback();
@@ -21,8 +21,11 @@
 
 #include "SequenceModel.h"
 #include "Note.h"
+#include "PatternFile.h"
 #include "PatternModel.h"
+#include "PlaybackProfiler.h"
 #include "SegmentHandler.h"
+#include "SketchBundle.h"
 
 #include <libzl.h>
 #include <SyncTimer.h>
@@ -35,14 +38,552 @@
 #include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
 #include <QRegularExpression>
+#include <QRunnable>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
 #include <QTimer>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+
 #define CHANNEL_COUNT 10
 #define PART_COUNT 5
 #define PATTERN_COUNT (CHANNEL_COUNT * PART_COUNT)
 static const QStringList trackNames{"T1", "T2", "T3", "T4", "T5", "T6", "T7", "T8", "T9", "T10"};
 static const QStringList partNames{"a", "b", "c", "d", "e"};
+static const QLatin1String jsonPatternFileSuffix{".pattern.json"};
+
+// The name of the binary pattern file which goes with the given json pattern file name (and the other way around)
+static inline QString binaryPatternFileName(const QString &jsonFileName)
+{
+    return jsonFileName.left(jsonFileName.length() - jsonPatternFileSuffix.size()) + PATTERN_FILE_SUFFIX;
+}
+static inline QString jsonPatternFileName(const QString &binaryFileName)
+{
+    return binaryFileName.left(binaryFileName.length() - QLatin1String(PATTERN_FILE_SUFFIX).size()) + jsonPatternFileSuffix;
+}
+// Sketches can keep all their sequences in a single bundle, which lives in the sketch's sequences directory
+// (the parent of each sequence's own directory), and which holds each file by its path relative to that directory
+static inline QString sketchBundleDirectory(const QString &sequenceFilePath)
+{
+    const QString sequenceDirectory{sequenceFilePath.left(sequenceFilePath.lastIndexOf("/"))};
+    return sequenceDirectory.left(sequenceDirectory.lastIndexOf("/"));
+}
+static inline QString sketchBundleFileName(const QString &sequenceFilePath)
+{
+    return QString("%1/%2").arg(sketchBundleDirectory(sequenceFilePath)).arg(SKETCH_BUNDLE_FILE_NAME);
+}
+static inline QString sketchBundleEntryName(const QString &sequenceFilePath, const QString &fileName)
+{
+    return fileName.mid(sketchBundleDirectory(sequenceFilePath).length() + 1);
+}
+// What a file in the bundle is called when keeping track of what has been saved where (see PatternModel::markAsSaved())
+static inline QString sketchBundleEntryKey(const QString &sequenceFilePath, const QString &entryName)
+{
+    return QString("%1/%2").arg(sketchBundleFileName(sequenceFilePath)).arg(entryName);
+}
+static_assert(PATTERN_COUNT <= 64, "The sets of active patterns are stored as 64 bit masks, so there can be at most 64 patterns in a sequence");
+
+/**
+ * \brief A pattern file found while loading a sequence, and what was parsed out of it
+ */
+struct PatternLoadData {
+    // The pattern's file, or for a pattern in a sketch bundle, its key (see sketchBundleEntryKey())
+    QString fileName;
+    // For a pattern in a sketch bundle, the pattern's data (which lives in the bundle, and so is only valid while loading)
+    QByteArray bundledData;
+    int channelIndex{0};
+    int partIndex{0};
+    bool parsed{false};
+    // The file the data was actually parsed from (which is the json sibling if the binary file was broken)
+    QString parsedFileName;
+    PatternFileData data;
+};
+
+/**
+ * \brief Everything read from disk for a sequence while loading it, before it is applied to the sequence
+ */
+struct SequenceLoadData {
+    QString filePath;
+    // Whether the sequence's metadata file was found and read
+    bool hasSequenceData{false};
+    // The contents of the sequence's metadata file
+    QByteArray sequenceData;
+    int activePattern{0};
+    int bpm{0};
+    // The sequence's pattern files, sorted naturally by file name
+    QVector<PatternLoadData> patterns;
+    // The sketch bundle the sequence might be stored in (which is not set if there is no bundle). This is read
+    // into memory, so saves made while the sequence is loading cannot change it (see SequenceLoadStartTask)
+    QSharedPointer<SketchBundle> bundle;
+    // Whether the sequence was found in the bundle (otherwise it is read from its directory)
+    bool fromBundle{false};
+};
+
+// The pool used to read and parse sequences' files while loading them
+Q_GLOBAL_STATIC(QThreadPool, sequenceLoadingPool)
+
+/**
+ * \brief The sequences being loaded by a single call to SequenceModel::loadSequences()
+ */
+struct SequenceLoadBatch {
+    QVector<QPointer<SequenceModel>> sequences;
+    // The load each sequence was on when the batch was started, so a newer load replaces this one (see SequenceModel::Private::loadId)
+    QVector<int> loadIds;
+    QVector<SequenceLoadData> sequencesData;
+    PlayGridManager *playGridManager{nullptr};
+    QElapsedTimer elapsedTimer;
+    // The number of sequences which have had their pattern files found, and of pattern files which have been parsed
+    QAtomicInt scannedSequences{0};
+    QAtomicInt parsedPatterns{0};
+    int patternFileCount{0};
+    // Applies the results to the sequences, once everything has been parsed
+    std::function<void(SequenceLoadBatch&)> finished;
+};
+
+// Called on the ui thread each time one of the batch's sequences has been scanned, or one of its pattern files parsed
+static void handleSequenceLoadTaskDone(const QSharedPointer<SequenceLoadBatch> &batch, bool parsedPattern, int completed);
+
+// Reports a finished task back to the ui thread, rather than having it wait for us
+static void reportSequenceLoadTaskDone(const QSharedPointer<SequenceLoadBatch> &batch, bool parsedPattern)
+{
+    const int completed{(parsedPattern ? batch->parsedPatterns : batch->scannedSequences).fetchAndAddOrdered(1) + 1};
+    QMetaObject::invokeMethod(batch->playGridManager, [batch, parsedPattern, completed](){ handleSequenceLoadTaskDone(batch, parsedPattern, completed); }, Qt::QueuedConnection);
+}
+
+/**
+ * \brief Reads a sequence's metadata file and finds its pattern files, on one of the loading pool's worker threads
+ * @see SequenceModel::loadSequences()
+ */
+class SequenceScanTask : public QRunnable {
+public:
+    SequenceScanTask(const QSharedPointer<SequenceLoadBatch> &batch, SequenceLoadData *sequenceData)
+        : batch(batch)
+        , sequenceData(sequenceData)
+    {
+        setAutoDelete(true);
+    }
+    void run() override {
+        const QString &filePath = sequenceData->filePath;
+        const QString sequenceEntryName{sketchBundleEntryName(filePath, filePath)};
+        const SketchBundle *bundle = sequenceData->bundle.data();
+        // A sequence which is in the sketch's bundle is read from there, and otherwise from its directory (which
+        // is how sketches have always been stored, and so is what the bundle is migrated from)
+        sequenceData->fromBundle = bundle && bundle->contains(sequenceEntryName);
+        if (sequenceData->fromBundle) {
+            const QByteArray entry{bundle->entry(sequenceEntryName)};
+            // Hold on to a copy, as the entry's data goes away with the bundle
+            sequenceData->sequenceData = QByteArray(entry.constData(), entry.size());
+        } else {
+            QFile file(filePath);
+            if (file.exists()) {
+                if (file.open(QIODevice::ReadOnly)) {
+                    sequenceData->sequenceData = file.readAll();
+                    file.close();
+                }
+            }
+        }
+        const QJsonDocument jsonDoc = QJsonDocument::fromJson(sequenceData->sequenceData);
+        if (jsonDoc.isObject()) {
+            const QJsonObject obj = jsonDoc.object();
+            sequenceData->hasSequenceData = true;
+            sequenceData->activePattern = obj.value("activePattern").toInt();
+            sequenceData->bpm = obj.value("bpm").toInt();
+            const QString patternLocation{QString("%1/patterns").arg(filePath.left(filePath.lastIndexOf("/")))};
+            QStringList entries;
+            if (sequenceData->fromBundle) {
+                const QString patternEntryPrefix{sketchBundleEntryName(filePath, patternLocation) + "/"};
+                const QStringList entryNames{bundle->entryNames()};
+                for (const QString &entryName : entryNames) {
+                    if (entryName.startsWith(patternEntryPrefix) && (entryName.endsWith(jsonPatternFileSuffix) || entryName.endsWith(PATTERN_FILE_SUFFIX))) {
+                        entries << entryName;
+                    }
+                }
+            } else {
+                const QDir dir(patternLocation);
+                const QFileInfoList fileEntries = dir.entryInfoList({QString("*%1").arg(jsonPatternFileSuffix), QString("*%1").arg(PATTERN_FILE_SUFFIX)}, QDir::Files, QDir::NoSort);
+                for (const QFileInfo &fileEntry : fileEntries) {
+                    entries << fileEntry.absoluteFilePath();
+                }
+            }
+            // Where a pattern has been stored in both the binary and the json format, the binary one is the one we want
+            const QSet<QString> entrySet{entries.toSet()};
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [&entrySet](const QString &entry){
+                return entry.endsWith(jsonPatternFileSuffix) && entrySet.contains(binaryPatternFileName(entry));
+            }), entries.end());
+            QCollator collator;
+            collator.setNumericMode(true);
+            std::sort(entries.begin(), entries.end(), [&](const QString &file1, const QString &file2){ return collator.compare(file1, file2) < 0; });
+            // Now we have a list of all the entries in the patterns directory that has the pattern
+            // file suffix, sorted naturally (so 10 is at the end, not after 1, which is just silly)
+            // The filename for patterns is "pattern-t(trackIndex)-ch(channelIndex)-part(partLetter).pattern.json" (or .pattern.bin)
+            // where trackIndex is a number from 1 through 10, channelIndex is a number from 1 through 10, and partName is a single lower-case letter
+            const QRegularExpression patternFilenameRegexp("pattern-t(\\d\\d?)-ch(\\d\\d?)-part([a-z])\\.pattern\\.(json|bin)");
+            sequenceData->patterns.reserve(entries.count());
+            for (const QString &entry : qAsConst(entries)) {
+                const QString entryFileName{entry.mid(entry.lastIndexOf("/") + 1)};
+                const QRegularExpressionMatch match = patternFilenameRegexp.match(entryFileName);
+                if (!match.hasMatch()) {
+                    qWarning() << Q_FUNC_INFO << "This file is not recognised as a pattern file, skipping:" << entryFileName;
+                    continue;
+                }
+                PatternLoadData patternData;
+                if (sequenceData->fromBundle) {
+                    patternData.fileName = sketchBundleEntryKey(filePath, entry);
+                    patternData.bundledData = bundle->entry(entry);
+                } else {
+                    patternData.fileName = entry;
+                }
+                patternData.channelIndex = match.captured(2).toInt() - 1;
+                patternData.partIndex = partNames.indexOf(match.captured(3));
+                sequenceData->patterns << patternData;
+            }
+        }
+        reportSequenceLoadTaskDone(batch, false);
+    }
+private:
+    QSharedPointer<SequenceLoadBatch> batch;
+    SequenceLoadData *sequenceData{nullptr};
+};
+
+/**
+ * \brief Reads and parses a single pattern file, on one of the loading pool's worker threads
+ * @see SequenceModel::loadSequences()
+ */
+class PatternParseTask : public QRunnable {
+public:
+    PatternParseTask(const QSharedPointer<SequenceLoadBatch> &batch, PatternLoadData *patternData)
+        : batch(batch)
+        , patternData(patternData)
+    {
+        setAutoDelete(true);
+    }
+    void run() override {
+        patternData->parsedFileName = patternData->fileName;
+        if (!patternData->bundledData.isNull()) {
+            // Patterns in a sketch bundle have nothing to fall back on, as the bundle only ever holds one version of each
+            if (patternData->fileName.endsWith(PATTERN_FILE_SUFFIX)) {
+                patternData->parsed = PatternFile::parse(patternData->bundledData.constData(), patternData->bundledData.size(), patternData->data);
+            } else {
+                const QJsonDocument jsonDoc{QJsonDocument::fromJson(patternData->bundledData)};
+                patternData->parsed = jsonDoc.isObject();
+                if (patternData->parsed) {
+                    PatternFile::parseJson(jsonDoc.object(), patternData->data);
+                }
+            }
+            if (!patternData->parsed) {
+                qWarning() << Q_FUNC_INFO << "Failed to load the pattern from" << patternData->fileName;
+            }
+        } else {
+            patternData->parsed = PatternFile::parseFile(patternData->fileName, patternData->data);
+        }
+        if (!patternData->parsed && patternData->bundledData.isNull() && patternData->fileName.endsWith(PATTERN_FILE_SUFFIX)) {
+            // If the binary file is broken, see if there is a json version of the pattern to fall back on
+            patternData->parsedFileName = jsonPatternFileName(patternData->fileName);
+            qWarning() << Q_FUNC_INFO << "Failed to load the pattern from" << patternData->fileName << "- attempting to use" << patternData->parsedFileName << "instead";
+            patternData->parsed = QFile::exists(patternData->parsedFileName) && PatternFile::parseFile(patternData->parsedFileName, patternData->data);
+        }
+        reportSequenceLoadTaskDone(batch, true);
+    }
+private:
+    QSharedPointer<SequenceLoadBatch> batch;
+    PatternLoadData *patternData{nullptr};
+};
+
+/**
+ * \brief A sequence's changes, captured on the ui thread so they can be written to disk on another thread
+ * @see SequenceModel::saveInBackground()
+ */
+struct SequenceSaveData {
+    struct PatternSave {
+        QPointer<PatternModel> pattern;
+        // The pattern's file, or for a pattern saved into the sketch bundle, its key (see sketchBundleEntryKey())
+        QString fileName;
+        // The pattern's name in the sketch bundle, when saving into that
+        QString entryName;
+        // The same pattern in the format which is not being written, which is removed once the pattern is saved
+        QString staleFileName;
+        // The pattern's lastModified stamp when the snapshot was taken
+        quint64 lastModified{0};
+        // Empty patterns are stored as no file at all, so their file is removed rather than written
+        bool remove{false};
+        // The pattern's contents, and the data to write (which is serialized from the snapshot if it is not set)
+        PatternFileSnapshot snapshot;
+        QByteArray data;
+        bool saved{false};
+    };
+    QString sequenceFileName;
+    // What the sequence's own data is saved as (the file name, or its key in the sketch bundle)
+    QString sequenceDataKey;
+    QByteArray sequenceData;
+    // Whether the sequence's own data is different from what was last written (it is also written if the file is missing)
+    bool sequenceDataChanged{false};
+    bool exportOnly{false};
+    // When saving into the sketch bundle, the bundle's file, and the sequence's own data's name in it
+    QString bundleFileName;
+    QString sequenceEntryName;
+    // Whether the sequence was last stored in the other layout, which is cleared out once everything is written
+    bool migrate{false};
+    QVector<PatternSave> patterns;
+    // The results, filled in while writing
+    bool success{false};
+    bool sequenceDataSaved{false};
+    int writtenFileCount{0};
+    int removedFileCount{0};
+};
+
+// Removes a sequence's own files, once the sequence has been moved into the sketch bundle, and returns how many were removed
+static int removeSequenceFiles(const QString &sequenceFileName)
+{
+    int removedFileCount{0};
+    const QString sequenceLocation{sequenceFileName.left(sequenceFileName.lastIndexOf("/"))};
+    QDir patternLocation(sequenceLocation + "/patterns");
+    const QStringList patternFiles{patternLocation.entryList({QString("*%1").arg(jsonPatternFileSuffix), QString("*%1").arg(PATTERN_FILE_SUFFIX)}, QDir::Files)};
+    for (const QString &patternFile : patternFiles) {
+        if (patternLocation.remove(patternFile)) {
+            ++removedFileCount;
+        }
+    }
+    if (QFile::exists(sequenceFileName) && QFile::remove(sequenceFileName)) {
+        ++removedFileCount;
+    }
+    // These only go away if there is nothing else left in them
+    QDir().rmdir(patternLocation.path());
+    QDir().rmdir(sequenceLocation);
+    return removedFileCount;
+}
+
+// Removes all of a sequence's entries from the sketch bundle, once the sequence has been moved back out to its own files
+static bool removeSequenceFromBundle(const QString &sequenceFileName, int &removedFileCount)
+{
+    bool success{true};
+    SketchBundle bundle(sketchBundleFileName(sequenceFileName));
+    if (bundle.open()) {
+        const QString sequenceLocation{sequenceFileName.left(sequenceFileName.lastIndexOf("/"))};
+        const QString sequenceEntryPrefix{sketchBundleEntryName(sequenceFileName, sequenceLocation) + "/"};
+        QStringList removedEntries;
+        const QStringList entryNames{bundle.entryNames()};
+        for (const QString &entryName : entryNames) {
+            if (entryName.startsWith(sequenceEntryPrefix)) {
+                removedEntries << entryName;
+            }
+        }
+        bundle.close();
+        if (removedEntries.count() > 0) {
+            success = bundle.update(QHash<QString, QByteArray>(), removedEntries);
+            if (success) {
+                removedFileCount += removedEntries.count();
+            }
+        }
+    }
+    return success;
+}
+
+// Writes the captured data into the sketch bundle, as a single update of the bundle
+static void writeSequenceSaveDataToBundle(SequenceSaveData &saveData)
+{
+    QHash<QString, QByteArray> changedEntries;
+    QStringList removedEntries;
+    if (saveData.sequenceDataChanged) {
+        changedEntries.insert(saveData.sequenceEntryName, saveData.sequenceData);
+    }
+    for (SequenceSaveData::PatternSave &patternSave : saveData.patterns) {
+        if (patternSave.remove) {
+            removedEntries << patternSave.entryName;
+        } else {
+            if (patternSave.data.isNull()) {
+                patternSave.data = PatternFile::serialize(patternSave.snapshot);
+            }
+            changedEntries.insert(patternSave.entryName, patternSave.data);
+        }
+    }
+    saveData.success = true;
+    if (changedEntries.count() > 0 || removedEntries.count() > 0) {
+        const QDir bundleLocation(saveData.bundleFileName.left(saveData.bundleFileName.lastIndexOf("/")));
+        SketchBundle bundle(saveData.bundleFileName);
+        saveData.success = (bundleLocation.exists() || bundleLocation.mkpath(bundleLocation.path())) && bundle.update(changedEntries, removedEntries);
+    }
+    saveData.sequenceDataSaved = saveData.success;
+    if (saveData.success) {
+        for (SequenceSaveData::PatternSave &patternSave : saveData.patterns) {
+            patternSave.saved = true;
+        }
+        saveData.writtenFileCount += changedEntries.count();
+        saveData.removedFileCount += removedEntries.count();
+        if (saveData.migrate) {
+            saveData.removedFileCount += removeSequenceFiles(saveData.sequenceFileName);
+        }
+    } else {
+        qWarning() << Q_FUNC_INFO << "Failed to write the sequence to the sketch bundle" << saveData.bundleFileName;
+    }
+}
+
+// Writes the captured data to disk, and is safe to call from any thread
+static void writeSequenceSaveData(SequenceSaveData &saveData)
+{
+    if (!saveData.bundleFileName.isEmpty()) {
+        writeSequenceSaveDataToBundle(saveData);
+        return;
+    }
+    const QString saveToPath{saveData.sequenceFileName};
+    QDir sequenceLocation(saveToPath.left(saveToPath.lastIndexOf("/")));
+    QDir patternLocation(saveToPath.left(saveToPath.lastIndexOf("/")) + "/patterns");
+    if (sequenceLocation.exists() || sequenceLocation.mkpath(sequenceLocation.path())) {
+        saveData.sequenceDataSaved = true;
+        if (saveData.sequenceDataChanged || !QFile::exists(saveToPath)) {
+            saveData.sequenceDataSaved = PatternFile::writeFile(saveToPath, saveData.sequenceData);
+            if (saveData.sequenceDataSaved) {
+                ++saveData.writtenFileCount;
+            }
+        }
+        if (saveData.sequenceDataSaved) {
+            saveData.success = true;
+            if (patternLocation.exists() || patternLocation.mkpath(patternLocation.path())) {
+                for (SequenceSaveData::PatternSave &patternSave : saveData.patterns) {
+                    if (patternSave.remove) {
+                        if (QFile::exists(patternSave.fileName) && QFile::remove(patternSave.fileName)) {
+                            ++saveData.removedFileCount;
+                        }
+                        patternSave.saved = !QFile::exists(patternSave.fileName);
+                    } else {
+                        if (patternSave.data.isNull()) {
+                            patternSave.data = PatternFile::serialize(patternSave.snapshot);
+                        }
+                        patternSave.saved = PatternFile::writeFile(patternSave.fileName, patternSave.data);
+                        if (patternSave.saved) {
+                            ++saveData.writtenFileCount;
+                        }
+                    }
+                    if (patternSave.saved) {
+                        if (QFile::exists(patternSave.staleFileName) && QFile::remove(patternSave.staleFileName)) {
+                            ++saveData.removedFileCount;
+                        }
+                    } else {
+                        qWarning() << Q_FUNC_INFO << "Failed to save a pattern to" << patternSave.fileName;
+                        saveData.success = false;
+                    }
+                }
+            }
+        } else {
+            qWarning() << Q_FUNC_INFO << "Failed to write the sequence to" << saveToPath;
+        }
+    }
+    if (saveData.success && saveData.migrate && !removeSequenceFromBundle(saveToPath, saveData.removedFileCount)) {
+        qWarning() << Q_FUNC_INFO << "Failed to remove the sequence from the sketch bundle" << sketchBundleFileName(saveToPath);
+        saveData.success = false;
+    }
+}
+
+// Sequences are saved one after the other, in the order the saves were started, so an older save
+// can never overwrite the files written by a newer one (loads also start here, see SequenceLoadStartTask)
+class SequenceSavingPool : public QThreadPool {
+public:
+    SequenceSavingPool() {
+        setMaxThreadCount(1);
+    }
+};
+Q_GLOBAL_STATIC(SequenceSavingPool, sequenceSavingPool)
+
+/**
+ * \brief Gets a batch of sequences loading, on the saving pool's worker thread
+ * Running it there means anything already being written to the files we are about to read is done
+ * first, and nothing else is written while it reads the sketch bundles into memory. Once those are
+ * read, saves can go ahead without changing what the load sees, and this starts finding the sequences'
+ * pattern files on the loading pool.
+ * @see SequenceModel::loadSequences()
+ */
+class SequenceLoadStartTask : public QRunnable {
+public:
+    SequenceLoadStartTask(const QSharedPointer<SequenceLoadBatch> &batch)
+        : batch(batch)
+    {
+        setAutoDelete(true);
+    }
+    void run() override {
+        // Each sketch bundle is opened once, and shared by all the sequences stored in it
+        QHash<QString, QSharedPointer<SketchBundle>> bundles;
+        SequenceLoadData *sequencesData = batch->sequencesData.data();
+        const int sequenceCount{batch->sequencesData.count()};
+        for (int sequenceIndex = 0; sequenceIndex < sequenceCount; ++sequenceIndex) {
+            SequenceLoadData &sequenceData = sequencesData[sequenceIndex];
+            if (!sequenceData.filePath.isEmpty()) {
+                const QString bundleFileName{sketchBundleFileName(sequenceData.filePath)};
+                if (!bundles.contains(bundleFileName)) {
+                    QSharedPointer<SketchBundle> bundle{new SketchBundle(bundleFileName)};
+                    bundles.insert(bundleFileName, bundle->open(SketchBundle::InMemoryRead) ? bundle : QSharedPointer<SketchBundle>());
+                }
+                sequenceData.bundle = bundles.value(bundleFileName);
+            }
+        }
+        for (int sequenceIndex = 0; sequenceIndex < sequenceCount; ++sequenceIndex) {
+            sequenceLoadingPool()->start(new SequenceScanTask(batch, &sequencesData[sequenceIndex]));
+        }
+    }
+private:
+    QSharedPointer<SequenceLoadBatch> batch;
+};
+
+static void handleSequenceLoadTaskDone(const QSharedPointer<SequenceLoadBatch> &batch, bool parsedPattern, int completed)
+{
+    PlayGridManager *playGridManager = batch->playGridManager;
+    const int sequenceCount{batch->sequencesData.count()};
+    if (!parsedPattern) {
+        if (completed < sequenceCount) {
+            Q_EMIT playGridManager->taskMessage(QString("Finding patterns (%1 of %2 sequences done)").arg(completed).arg(sequenceCount));
+        } else {
+            // All the pattern files have been found, so now read and parse them all
+            QVector<PatternLoadData*> patterns;
+            for (SequenceLoadData &sequenceData : batch->sequencesData) {
+                for (PatternLoadData &patternData : sequenceData.patterns) {
+                    patterns << &patternData;
+                }
+            }
+            batch->patternFileCount = patterns.count();
+            if (patterns.isEmpty()) {
+                batch->finished(*batch);
+            } else {
+                Q_EMIT playGridManager->taskMessage(QString("Loading %1 patterns").arg(patterns.count()));
+                for (PatternLoadData *patternData : qAsConst(patterns)) {
+                    sequenceLoadingPool()->start(new PatternParseTask(batch, patternData));
+                }
+            }
+        }
+    } else if (completed < batch->patternFileCount) {
+        Q_EMIT playGridManager->taskMessage(QString("Loading patterns (%1 of %2 done)").arg(completed).arg(batch->patternFileCount));
+    } else {
+        batch->finished(*batch);
+    }
+}
+
+/**
+ * \brief Writes a sequence's captured changes to disk, on the saving pool's worker thread
+ * @see SequenceModel::saveInBackground()
+ */
+class SequenceSaveTask : public QRunnable {
+public:
+    SequenceSaveTask(SequenceModel *sequence, QSharedPointer<SequenceSaveData> saveData, std::function<void()> finished)
+        : sequence(sequence)
+        , saveData(saveData)
+        , finished(finished)
+    {
+        setAutoDelete(true);
+    }
+    void run() override {
+        writeSequenceSaveData(*saveData);
+        // Hand the results back to the sequence's thread (this is dropped if the sequence has gone away in the meantime)
+        QMetaObject::invokeMethod(sequence, finished, Qt::QueuedConnection);
+    }
+private:
+    SequenceModel *sequence{nullptr};
+    QSharedPointer<SequenceSaveData> saveData;
+    std::function<void()> finished;
+};
 
 class ZLSequenceSynchronisationManager : public QObject {
 Q_OBJECT
@@ -140,6 +681,7 @@ public Q_SLOTS:
         } else {
             soloChannel = -1;
         }
+        Q_EMIT soloChannelChanged();
     }
     void currentMidiChannelChanged() {
         if (zlSong) {
@@ -153,6 +695,8 @@ public Q_SLOTS:
             }
         }
     }
+Q_SIGNALS:
+    void soloChannelChanged();
 };
 
 class SequenceModel::Private {
@@ -165,11 +709,12 @@ public:
     PlayGridManager *playGridManager{nullptr};
     SyncTimer *syncTimer{nullptr};
     SegmentHandler *segmentHandler{nullptr};
+    PlaybackProfiler *playbackProfiler{nullptr};
     QObject *song{nullptr};
     int soloPattern{-1};
     PatternModel *soloPatternObject{nullptr};
     QList<PatternModel*> patternModels;
-    PatternModel* patternModelIterator[PATTERN_COUNT];
+    PatternModel* patternModelIterator[PATTERN_COUNT]{};
     int bpm{0};
     int activePattern{0};
     QString filePath;
@@ -181,6 +726,16 @@ public:
     int sceneIndex{-1};
     bool shouldMakeSounds{true};
     bool isLoading{false};
+    // Identifies the most recent load of the sequence, so only that one is applied (see SequenceModel::loadSequences())
+    int loadId{0};
+    // Identifies the most recent startSequencePlayback() call (see there)
+    int playbackPreparationId{0};
+    // What was last written to (or read from) the sequence's metadata file, and which file that was
+    QString savedSequenceFile;
+    QByteArray savedSequenceData;
+    bool useSketchBundle{false};
+    // Whether the sequence is currently stored in the sketch bundle (rather than in its own files)
+    bool storedInBundle{false};
 
     void ensureFilePath(const QString &explicitFile) {
         if (!explicitFile.isEmpty()) {
@@ -208,11 +763,221 @@ public:
         return QString("%1/session/sequences/%2").arg(QString(qgetenv("ZYNTHIAN_MY_DATA_DIR"))).arg(safe);
     }
 
+    /**
+     * \brief Add the pattern for the given channel and part to the sequence, cleared of all its contents
+     * @note The pattern is left in a long operation, so end that once done with it
+     * @return The pattern which was added
+     */
+    PatternModel *insertClearedPattern(const QString &trackName, int channelIndex, int partIndex) {
+        PatternModel *model = qobject_cast<PatternModel*>(playGridManager->getPatternModel(QString("%1-%2%3").arg(trackName).arg(QString::number(channelIndex + 1)).arg(partNames.value(partIndex)), q));
+        model->startLongOperation();
+        model->resetPattern(true);
+        model->setChannelIndex(channelIndex);
+        model->setPartIndex(partIndex);
+        q->insertPattern(model);
+        return model;
+    }
+
+    /**
+     * \brief Apply what was read from disk while loading to the sequence and its patterns
+     * @see SequenceModel::loadSequences()
+     * @return The number of patterns which were loaded from files
+     */
+    int applyLoadData(const SequenceLoadData &sequenceData) {
+        int loadedPatternCount{0};
+        const QString trackName{trackNames.contains(q->objectName()) ? q->objectName() : ""};
+        if (sequenceData.hasSequenceData) {
+            int actualIndex{0};
+            for (const PatternLoadData &patternData : sequenceData.patterns) {
+                while (actualIndex < (patternData.channelIndex * PART_COUNT) + patternData.partIndex) {
+                    // then we're missing some patterns, which is not great and we should deal with that so we don't end up with holes in the model...
+                    PatternModel *model = insertClearedPattern(trackName, actualIndex / PART_COUNT, actualIndex % PART_COUNT);
+                    model->clearUndoHistory();
+                    model->endLongOperation();
+                    ++actualIndex;
+                }
+                PatternModel *model = insertClearedPattern(trackName, patternData.channelIndex, patternData.partIndex);
+                if (patternData.parsed) {
+                    PatternFile::apply(model, patternData.data);
+                }
+                model->clearUndoHistory();
+                model->endLongOperation();
+                if (patternData.parsed) {
+                    // What is on disk is what we just loaded, so there is no need to write it back until it changes
+                    model->markAsSaved(patternData.parsedFileName);
+                }
+                ++loadedPatternCount;
+                ++actualIndex;
+            }
+            // Then set the values on the sequence
+            q->setActivePattern(sequenceData.activePattern);
+            q->setBpm(sequenceData.bpm);
+        }
+        savedSequenceFile = sequenceData.fromBundle ? sketchBundleEntryKey(sequenceData.filePath, sketchBundleEntryName(sequenceData.filePath, sequenceData.filePath)) : sequenceData.filePath;
+        savedSequenceData = sequenceData.sequenceData;
+        storedInBundle = sequenceData.fromBundle;
+        if (storedInBundle) {
+            // Keep the sequence where it is, unless asked to move it out again
+            q->setUseSketchBundle(true);
+        }
+        // This ensures that when we're first creating ourselves a sequence, we end up with some models in it
+        for (int i = patternModels.count(); i < PATTERN_COUNT; ++i) {
+            PatternModel *model = insertClearedPattern(trackName, i / PART_COUNT, i % PART_COUNT);
+            model->clearUndoHistory();
+            model->endLongOperation();
+        }
+        if (q->activePattern() == -1) {
+            q->setActivePattern(0);
+        }
+        q->setIsDirty(false);
+        qDebug() << q << "Loaded" << loadedPatternCount << "patterns and filled in" << PATTERN_COUNT - loadedPatternCount;
+        return loadedPatternCount;
+    }
+
+    /**
+     * \brief Capture everything which needs writing to save the sequence to the given location
+     * This only takes snapshots of the patterns which have changed since they were last saved there,
+     * so it is quick enough to do on the ui thread, and the result can then be written anywhere.
+     */
+    SequenceSaveData prepareSave(const QString &saveToPath, bool exportOnly) {
+        SequenceSaveData saveData;
+        saveData.sequenceFileName = saveToPath;
+        saveData.sequenceDataKey = saveToPath;
+        saveData.exportOnly = exportOnly;
+        // Exports are always written as separate files, so they can be picked up by anything which reads those
+        const bool saveToBundle{useSketchBundle && !exportOnly};
+        if (saveToBundle) {
+            saveData.bundleFileName = sketchBundleFileName(saveToPath);
+            saveData.sequenceEntryName = sketchBundleEntryName(saveToPath, saveToPath);
+            saveData.sequenceDataKey = sketchBundleEntryKey(saveToPath, saveData.sequenceEntryName);
+        }
+        // When moving between the layouts, everything is written, whether or not it was saved in the new layout at some point
+        saveData.migrate = !exportOnly && saveToBundle != storedInBundle;
+
+        QJsonObject sequenceObject;
+        sequenceObject["activePattern"] = q->activePattern();
+        sequenceObject["bpm"] = q->bpm();
+        QJsonDocument jsonDoc;
+        jsonDoc.setObject(sequenceObject);
+        saveData.sequenceData = jsonDoc.toJson();
+        // Only write the sequence's own file if what it holds has actually changed
+        saveData.sequenceDataChanged = exportOnly || saveData.migrate || saveData.sequenceDataKey != savedSequenceFile || saveData.sequenceData != savedSequenceData;
+
+        const QString patternLocation{saveToPath.left(saveToPath.lastIndexOf("/")) + "/patterns"};
+        // The filename for patterns is "pattern-t(trackIndex)-ch(channelIndex)-part(partLetter).pattern.json"
+        const QString sequenceNameForFiles = QString(q->objectName().toLower()).replace(" ", "-");
+        for (int i = 0; i < PATTERN_COUNT; ++i) {
+            PatternModel *pattern = patternModelIterator[i];
+            if (pattern) {
+                QString patternIdentifier = QString::number(i + 1);
+                if (pattern->channelIndex() > -1 && pattern->partIndex() > -1) {
+                    patternIdentifier = QString("ch%1-part%2").arg(QString::number(pattern->channelIndex() + 1)).arg(partNames[pattern->partIndex()]);
+                }
+                const QString jsonFileName = QString("%1/pattern-%2-%3%4").arg(patternLocation).arg(sequenceNameForFiles).arg(patternIdentifier).arg(jsonPatternFileSuffix);
+                const QString binaryFileName = binaryPatternFileName(jsonFileName);
+                // Sketches are saved in the binary format, and exported in the json format. Whichever
+                // is written, any file in the other format is removed, as it would otherwise be out of date.
+                const QString entryName{saveToBundle ? sketchBundleEntryName(saveToPath, binaryFileName) : QString()};
+                const QString patternFileName{saveToBundle ? sketchBundleEntryKey(saveToPath, entryName) : exportOnly ? jsonFileName : binaryFileName};
+                // Patterns which have not changed since they were last saved (or loaded) are already on disk as they are.
+                // A change made since control last returned to the event loop may not have updated lastModified yet,
+                // so that is done first, or the change would be missed here.
+                pattern->flushChanges();
+                if (!saveData.migrate && !pattern->hasUnsavedChanges(patternFileName)) {
+                    continue;
+                }
+                SequenceSaveData::PatternSave patternSave;
+                patternSave.pattern = pattern;
+                patternSave.fileName = patternFileName;
+                patternSave.entryName = entryName;
+                patternSave.staleFileName = exportOnly ? binaryFileName : jsonFileName;
+                patternSave.lastModified = pattern->lastModified();
+                patternSave.remove = !pattern->hasNotes();
+                if (!patternSave.remove) {
+                    if (exportOnly) {
+                        patternSave.data = playGridManager->modelToJson(pattern).toUtf8();
+                    } else {
+                        patternSave.snapshot = PatternFile::snapshot(pattern);
+                    }
+                }
+                saveData.patterns << patternSave;
+            }
+        }
+        return saveData;
+    }
+
+    /**
+     * \brief Update the sequence and its patterns with the results of writing the data captured by prepareSave()
+     */
+    void finishSave(const SequenceSaveData &saveData) {
+        for (const SequenceSaveData::PatternSave &patternSave : saveData.patterns) {
+            if (patternSave.saved && patternSave.pattern) {
+                patternSave.pattern->markAsSaved(patternSave.fileName, patternSave.lastModified);
+            }
+        }
+        if (saveData.sequenceDataSaved && !saveData.exportOnly) {
+            savedSequenceFile = saveData.sequenceDataKey;
+            savedSequenceData = saveData.sequenceData;
+        }
+        if (saveData.success && saveData.migrate) {
+            storedInBundle = !saveData.bundleFileName.isEmpty();
+        }
+        if (saveData.writtenFileCount > 0 || saveData.removedFileCount > 0) {
+            qDebug() << q << "Saved to" << saveData.sequenceFileName << "- wrote" << saveData.writtenFileCount << "files and removed" << saveData.removedFileCount;
+        }
+        Q_EMIT q->saveFinished(saveData.success);
+    }
+
     void updatePatternIterator() {
         int actualCount = patternModels.count();
         for (int i = 0; i < PATTERN_COUNT; ++i) {
             patternModelIterator[i] = (i < actualCount) ? patternModels[i] : nullptr;
         }
+        updateActivePatterns();
+    }
+
+    // The patterns which are able to produce events (bit n is set if the pattern at position n can),
+    // which are the ones advanceSequence will visit
+    std::atomic<quint64> activePatterns{0};
+    // The patterns which are playing (or recording), which are the ones updatePatternPositions will visit
+    std::atomic<quint64> playingPatterns{0};
+    // The sequence position at which each pattern next has anything to do, so advanceSequence can skip the
+    // patterns which have nothing due. This is only ever touched by the timer thread, and starts over
+    // whenever dueTicksVersion changes (or playback jumps back), as the patterns then need looking at afresh.
+    quint64 nextDueTicks[PATTERN_COUNT]{};
+    quint64 lastAdvancedTick{0};
+    quint32 seenDueTicksVersion{0};
+    std::atomic<quint32> dueTicksVersion{0};
+    /**
+     * \brief Make the timer thread look at every pattern again on the next tick
+     * Call this (on the UI thread) whenever something changes which affects when the patterns are due
+     */
+    void invalidateDueTicks() {
+        ++dueTicksVersion;
+    }
+    /**
+     * \brief Update the sets of active and playing patterns
+     * This is called on the UI thread whenever something changes which might affect the sets,
+     * and the sets are then read on the timer thread during playback.
+     */
+    void updateActivePatterns() {
+        quint64 active{0};
+        quint64 playing{0};
+        for (int i = 0; i < PATTERN_COUNT; ++i) {
+            const PatternModel *pattern = patternModelIterator[i];
+            if (pattern) {
+                const quint64 patternBit{quint64(1) << i};
+                if (pattern->isPlaying() || pattern->recordLive()) {
+                    playing |= patternBit;
+                }
+                if (pattern->canProduceEvents() && (zlSyncManager->soloChannel == -1 || zlSyncManager->soloChannel == pattern->channelIndex())) {
+                    active |= patternBit;
+                }
+            }
+        }
+        activePatterns.store(active);
+        playingPatterns.store(playing);
+        invalidateDueTicks();
     }
 };
 
@@ -221,7 +986,9 @@ SequenceModel::SequenceModel(PlayGridManager* parent)
     , d(new Private(this))
 {
     d->playGridManager = parent;
+    d->playbackProfiler = parent ? parent->playbackProfiler() : nullptr;
     d->zlSyncManager = new ZLSequenceSynchronisationManager(this);
+    connect(d->zlSyncManager, &ZLSequenceSynchronisationManager::soloChannelChanged, this, [this](){ d->updateActivePatterns(); });
     d->syncTimer = qobject_cast<SyncTimer*>(SyncTimer_instance());
     d->segmentHandler = SegmentHandler::instance();
     connect(d->syncTimer, &SyncTimer::timerRunningChanged, this, [this](){
@@ -233,7 +1000,7 @@ SequenceModel::SequenceModel(PlayGridManager* parent)
     QTimer *saveThrottle = new QTimer(this);
     saveThrottle->setSingleShot(true);
     saveThrottle->setInterval(1000);
-    connect(saveThrottle, &QTimer::timeout, this, [this](){ if (isDirty()) { save(); } });
+    connect(saveThrottle, &QTimer::timeout, this, [this](){ if (isDirty()) { saveInBackground(); } });
     connect(this, &SequenceModel::isDirtyChanged, saveThrottle, QOverload<>::of(&QTimer::start));
     connect(this, &SequenceModel::countChanged, this, [this](){
         d->updatePatternIterator();
@@ -242,6 +1009,10 @@ SequenceModel::SequenceModel(PlayGridManager* parent)
 
 SequenceModel::~SequenceModel()
 {
+    // Background saves read the patterns' notes, so make sure none are still running before those go away
+    if (!sequenceSavingPool.isDestroyed()) {
+        sequenceSavingPool()->waitForDone();
+    }
     delete d;
 }
 
@@ -344,6 +1115,11 @@ void SequenceModel::insertPattern(PatternModel* pattern, int row)
     connect(pattern, &PatternModel::playingColumnChanged, this, updatePattern);
     connect(pattern, &PatternModel::layerDataChanged, this, updatePattern);
     connect(pattern, &NotesModel::lastModifiedChanged, this, &SequenceModel::setDirty);
+    auto updateActivePatterns = [this](){ d->updateActivePatterns(); };
+    connect(pattern, &PatternModel::canProduceEventsChanged, this, updateActivePatterns);
+    connect(pattern, &PatternModel::isPlayingChanged, this, updateActivePatterns);
+    connect(pattern, &PatternModel::recordLiveChanged, this, updateActivePatterns);
+    connect(pattern, &PatternModel::noteLengthChanged, this, [this](){ d->invalidateDueTicks(); });
     int insertionRow = d->patternModels.count();
     if (row > -1) {
         // If we've been requested to add in a specific location, do so
@@ -456,6 +1232,19 @@ void SequenceModel::setIsDirty(bool isDirty)
     }
 }
 
+bool SequenceModel::useSketchBundle() const
+{
+    return d->useSketchBundle;
+}
+
+void SequenceModel::setUseSketchBundle(bool useSketchBundle)
+{
+    if (d->useSketchBundle != useSketchBundle) {
+        d->useSketchBundle = useSketchBundle;
+        Q_EMIT useSketchBundleChanged();
+    }
+}
+
 bool SequenceModel::isLoading() const
 {
     return d->isLoading;
@@ -489,139 +1278,72 @@ void SequenceModel::setShouldMakeSounds(bool shouldMakeSounds)
 
 void SequenceModel::load(const QString &fileName)
 {
-    QElapsedTimer elapsedTimer;
-    elapsedTimer.start();
-    int loadedPatternCount{0};
-    d->isLoading = true;
-    Q_EMIT isLoadingChanged();
-    beginResetModel();
-    QString data;
     d->ensureFilePath(fileName);
-    QFile file(d->filePath);
+    loadSequences({this});
+}
 
-    // Clear our the existing model...
-    QList<PatternModel*> oldModels = d->patternModels;
-    for (PatternModel *model : d->patternModels) {
-        model->disconnect(this);
-        model->startLongOperation();
+void SequenceModel::loadSequences(const QList<SequenceModel*> &sequences)
+{
+    if (sequences.isEmpty()) {
+        return;
     }
-    d->patternModels.clear();
-
-    if (file.exists()) {
-        if (file.open(QIODevice::ReadOnly)) {
-            data = QString::fromUtf8(file.readAll());
-            file.close();
-        }
-    }
-    const QString trackName{trackNames.contains(objectName()) ? objectName() : ""};
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(data.toUtf8());
-    if (jsonDoc.isObject()) {
-        // First, load the patterns from disk
-        QDir dir(QString("%1/patterns").arg(d->filePath.left(d->filePath.lastIndexOf("/"))));
-        QFileInfoList entries = dir.entryInfoList({"*.pattern.json"}, QDir::Files, QDir::NoSort);
-        QCollator collator;
-        collator.setNumericMode(true);
-        std::sort(entries.begin(), entries.end(), [&](const QFileInfo &file1, const QFileInfo &file2){ return collator.compare(file1.absoluteFilePath(), file2.absoluteFilePath()) < 0; });
-        // Now we have a list of all the entries in the patterns directory that has the pattern
-        // file suffix, sorted naturally (so 10 is at the end, not after 1, which is just silly)
-        int actualIndex{0};
-        // The filename for patterns is "pattern-t(trackIndex)-ch(channelIndex)-part(partLetter).pattern.json"
-        // where trackIndex is a number from 1 through 10, channelIndex is a number from 1 through 10, and partName is a single lower-case letter
-        QRegularExpression patternFilenameRegexp("pattern-t(\\d\\d?)-ch(\\d\\d?)-part([a-z])\\.pattern\\.json");
-        for (const QFileInfo &entry : entries) {
-            // The filename for patterns is "sequencename-(channelIndex)(partName).pattern.json"
-            const QString absolutePath{entry.absoluteFilePath()};
-            QRegularExpressionMatch match = patternFilenameRegexp.match(entry.fileName());
-            if (!match.hasMatch()) {
-                qWarning() << Q_FUNC_INFO << "This file is not recognised as a pattern file, skipping:" << entry.fileName();
+    QSharedPointer<SequenceLoadBatch> batch{new SequenceLoadBatch};
+    batch->elapsedTimer.start();
+    batch->playGridManager = sequences.first()->playGridManager();
+    batch->sequencesData.resize(sequences.count());
+    for (int sequenceIndex = 0; sequenceIndex < sequences.count(); ++sequenceIndex) {
+        SequenceModel *sequence = sequences[sequenceIndex];
+        // If the sequence is already being loaded, this load replaces that one
+        ++sequence->d->loadId;
+        batch->sequences << sequence;
+        batch->loadIds << sequence->d->loadId;
+        if (!sequence->d->isLoading) {
+            sequence->d->isLoading = true;
+            Q_EMIT sequence->isLoadingChanged();
+        }
+        sequence->d->ensureFilePath(QString());
+        batch->sequencesData[sequenceIndex].filePath = sequence->d->filePath;
+    }
+    // Once everything has been read and parsed (which does not touch the sequences or patterns), this
+    // applies the results to the sequences and their patterns, back on the ui thread
+    batch->finished = [](SequenceLoadBatch &batch) {
+        int loadedPatternCount{0};
+        int loadedSequenceCount{0};
+        for (int sequenceIndex = 0; sequenceIndex < batch.sequences.count(); ++sequenceIndex) {
+            SequenceModel *sequence = batch.sequences[sequenceIndex];
+            // Sequences which have gone away, or which have been asked to load again since, are left alone
+            if (!sequence || sequence->d->loadId != batch.loadIds[sequenceIndex]) {
                 continue;
             }
-            const int trackIndex{match.captured(1).toInt() - 1};
-            const int channelIndex{match.captured(2).toInt() - 1};
-            const QString partName{match.captured(3)};
-            const int partIndex = partNames.indexOf(partName);
-            Q_UNUSED(trackIndex)
-//             qDebug() << "Loading pattern track" << trackIndex + 1 << "channel" << channelIndex + 1 << "part" << partName << "for sequence" << this << "from file" << absolutePath;
-            while (actualIndex < (channelIndex * PART_COUNT) + partIndex) {
-                // then we're missing some patterns, which is not great and we should deal with that so we don't end up with holes in the model...
-                const int intermediaryChannelIndex = actualIndex / PART_COUNT;
-                const QString &intermediaryPartName = partNames[actualIndex - (intermediaryChannelIndex * PART_COUNT)];
-                PatternModel *model = qobject_cast<PatternModel*>(playGridManager()->getPatternModel(QString("%1-%2%3").arg(trackName).arg(QString::number(intermediaryChannelIndex + 1)).arg(intermediaryPartName), this));
+            sequence->beginResetModel();
+            // Clear our the existing model...
+            const QList<PatternModel*> oldModels{sequence->d->patternModels};
+            for (PatternModel *model : oldModels) {
+                model->disconnect(sequence);
                 model->startLongOperation();
-                model->resetPattern(true);
-                model->setChannelIndex(intermediaryChannelIndex);
-                model->setPartIndex(actualIndex % PART_COUNT);
-                insertPattern(model);
-                model->endLongOperation();
-//                 qWarning() << "Sequence missing patterns prior to that, added:" << model;
-                ++actualIndex;
             }
-            PatternModel *model = qobject_cast<PatternModel*>(playGridManager()->getPatternModel(QString("%1-%2%3").arg(trackName).arg(QString::number(channelIndex + 1)).arg(partName), this));
-            model->startLongOperation();
-            model->resetPattern(true);
-            model->setChannelIndex(channelIndex);
-            model->setPartIndex(partIndex);
-            insertPattern(model);
-            if (entry.exists()) {
-                QFile patternFile{absolutePath};
-                if (patternFile.open(QIODevice::ReadOnly)) {
-                    QString patternData = QString::fromUtf8(patternFile.readAll());
-                    patternFile.close();
-                    playGridManager()->setModelFromJson(model, patternData);
-                }
+            sequence->d->patternModels.clear();
+            loadedPatternCount += sequence->d->applyLoadData(batch.sequencesData[sequenceIndex]);
+            sequence->endResetModel();
+            // Unlock the patterns, in case...
+            for (PatternModel *model : oldModels) {
+                model->endLongOperation();
             }
-            model->endLongOperation();
-            ++loadedPatternCount;
-//             qWarning() << "Loaded and added:" << model;
-            ++actualIndex;
-        }
-        // Then set the values on the sequence
-        QJsonObject obj = jsonDoc.object();
-        setActivePattern(obj.value("activePattern").toInt());
-        setBpm(obj.value("bpm").toInt());
-    }
-    // This ensures that when we're first creating ourselves a sequence, we end up with some models in it
-    if (d->patternModels.count() < PATTERN_COUNT) {
-        for (int i = d->patternModels.count(); i < PATTERN_COUNT; ++i) {
-            const int intermediaryChannelIndex = i / PART_COUNT;
-            const QString &intermediaryPartName = partNames[i % PART_COUNT];
-            PatternModel *model = qobject_cast<PatternModel*>(playGridManager()->getPatternModel(QString("%1-%2%3").arg(trackName).arg(QString::number(intermediaryChannelIndex + 1)).arg(intermediaryPartName), this));
-            model->startLongOperation();
-            model->resetPattern(true);
-            model->setChannelIndex(intermediaryChannelIndex);
-            model->setPartIndex(i % PART_COUNT);
-            insertPattern(model);
-            model->endLongOperation();
-//             qDebug() << "Added missing model" << intermediaryChannelIndex << intermediaryPartName << "to" << objectName() << model->channelIndex() << model->partIndex();
+            sequence->d->isLoading = false;
+            Q_EMIT sequence->isLoadingChanged();
+            Q_EMIT sequence->countChanged();
+            ++loadedSequenceCount;
         }
-    }
-    if (activePattern() == -1) {
-        setActivePattern(0);
-    }
-    setIsDirty(false);
-    endResetModel();
-    d->isLoading = false;
-    // Unlock the patterns, in case...
-    for (PatternModel *model : oldModels) {
-        model->endLongOperation();
-    }
-    Q_EMIT isLoadingChanged();
-    Q_EMIT countChanged();
-    qDebug() << this << "Loaded" << loadedPatternCount << "patterns and filled in" << PATTERN_COUNT - loadedPatternCount << "in" << elapsedTimer.elapsed() << "milliseconds";
+        const QString message{QString("Loaded %1 patterns for %2 sequences in %3 milliseconds").arg(loadedPatternCount).arg(loadedSequenceCount).arg(batch.elapsedTimer.elapsed())};
+        Q_EMIT batch.playGridManager->taskMessage(message);
+        qDebug() << Q_FUNC_INFO << message;
+    };
+    Q_EMIT batch->playGridManager->taskMessage(QString("Finding patterns for %1 sequences").arg(sequences.count()));
+    sequenceSavingPool()->start(new SequenceLoadStartTask(batch));
 }
 
 bool SequenceModel::save(const QString &fileName, bool exportOnly)
 {
-    bool success = false;
-
-    QJsonObject sequenceObject;
-    sequenceObject["activePattern"] = activePattern();
-    sequenceObject["bpm"] = bpm();
-
-    QJsonDocument jsonDoc;
-    jsonDoc.setObject(sequenceObject);
-    QString data = jsonDoc.toJson();
-
     QString saveToPath;
     if (exportOnly) {
         saveToPath = fileName;
@@ -629,39 +1351,31 @@ bool SequenceModel::save(const QString &fileName, bool exportOnly)
         d->ensureFilePath(fileName);
         saveToPath = d->filePath;
     }
-    QDir sequenceLocation(saveToPath.left(saveToPath.lastIndexOf("/")));
-    QDir patternLocation(saveToPath.left(saveToPath.lastIndexOf("/")) + "/patterns");
-    if (sequenceLocation.exists() || sequenceLocation.mkpath(sequenceLocation.path())) {
-        QFile dataFile(saveToPath);
-        if (dataFile.open(QIODevice::WriteOnly) && dataFile.write(data.toUtf8())) {
-            dataFile.close();
-            if (patternLocation.exists() || patternLocation.mkpath(patternLocation.path())) {
-                int i{0};
-                // The filename for patterns is "pattern-t(trackIndex)-ch(channelIndex)-part(partLetter).pattern.json"
-                const QString sequenceNameForFiles = QString(objectName().toLower()).replace(" ", "-");
-                for (int i = 0; i < PATTERN_COUNT; ++i) {
-                    PatternModel *pattern = d->patternModelIterator[i];
-                    if (pattern) {
-                        QString patternIdentifier = QString::number(i + 1);
-                        if (pattern->channelIndex() > -1 && pattern->partIndex() > -1) {
-                            patternIdentifier = QString("ch%1-part%2").arg(QString::number(pattern->channelIndex() + 1)).arg(partNames[pattern->partIndex()]);
-                        }
-                        QString fileName = QString("%1/pattern-%2-%3.pattern.json").arg(patternLocation.path()).arg(sequenceNameForFiles).arg(patternIdentifier);
-                        QFile patternFile(fileName);
-                        if (pattern->hasNotes()) {
-                            pattern->exportToFile(fileName);
-                        } else if (patternFile.exists()) {
-                            patternFile.remove();
-                        }
-                        ++i;
-                    }
-                }
-            }
-            success = true;
-        }
+    if (d->isLoading && !exportOnly) {
+        // What is in the sequence now is about to be replaced, and must not be written over what is being loaded
+        qWarning() << Q_FUNC_INFO << "Not saving" << objectName() << "while it is being loaded";
+        return false;
     }
+    // Let any saves which are already under way finish first, so they cannot overwrite what is written here
+    sequenceSavingPool()->waitForDone();
+    SequenceSaveData saveData{d->prepareSave(saveToPath, exportOnly)};
     setIsDirty(false);
-    return success;
+    writeSequenceSaveData(saveData);
+    d->finishSave(saveData);
+    return saveData.success;
+}
+
+void SequenceModel::saveInBackground()
+{
+    if (d->isLoading) {
+        // What is in the sequence now is about to be replaced by what is on disk, so there is nothing to save
+        return;
+    }
+    d->ensureFilePath(QString());
+    QSharedPointer<SequenceSaveData> saveData{new SequenceSaveData(d->prepareSave(d->filePath, false))};
+    // Anything which changes from here on is not in the snapshot, and so makes the sequence dirty again
+    setIsDirty(false);
+    sequenceSavingPool()->start(new SequenceSaveTask(this, saveData, [this, saveData](){ d->finishSave(*saveData); }));
 }
 
 void SequenceModel::clear()
@@ -701,10 +1415,10 @@ void SequenceModel::setSong(QObject* song)
             const QString sequenceNameForFiles = QString(objectName().toLower()).replace(" ", "-");
             setFilePath(QString("%1/sequences/%2/metadata.sequence.json").arg(sketchpadFolder).arg(sequenceNameForFiles));
         }
+        // This finishes in the background, and reports when it is done
         load();
         Q_EMIT songChanged();
         d->zlSyncManager->setZlSong(song);
-        d->playGridManager->taskMessage(QString("Done loading patterns for %1").arg(objectName()));
     }
 }
 
@@ -788,12 +1502,21 @@ void SequenceModel::prepareSequencePlayback()
 
 void SequenceModel::startSequencePlayback()
 {
-    prepareSequencePlayback();
-    playGridManager()->startMetronome();
+    // Make sure the patterns' playback data is ready before the timer starts asking for it (unless
+    // playback is stopped, or started again, while we wait)
+    const int playbackPreparationId{++d->playbackPreparationId};
+    QPointer<SequenceModel> sequence{this};
+    playGridManager()->preparePatternsForPlayback({this}, [sequence, playbackPreparationId](){
+        if (sequence && sequence->d->playbackPreparationId == playbackPreparationId) {
+            sequence->prepareSequencePlayback();
+            sequence->playGridManager()->startMetronome();
+        }
+    });
 }
 
 void SequenceModel::disconnectSequencePlayback()
 {
+    ++d->playbackPreparationId;
     if (d->isPlaying) {
         disconnect(playGridManager(), &PlayGridManager::metronomeTick, this, &SequenceModel::advanceSequence);
         disconnect(playGridManager(), &PlayGridManager::metronomeTick, this, &SequenceModel::updatePatternPositions);
@@ -835,6 +1558,7 @@ void SequenceModel::resetSequence()
 
 void SequenceModel::advanceSequence()
 {
+    PlaybackProfilerScope profilerScope(d->playbackProfiler, PlaybackProfiler::SequenceAdvancementStage);
     if (d->shouldMakeSounds || d->segmentHandler->songMode()) {
         // The timer schedules ahead internally for sequence advancement type things,
         // so the sequenceProgressionLength thing is only for prefilling at this point.
@@ -846,10 +1570,21 @@ void SequenceModel::advanceSequence()
                 pattern->handleSequenceAdvancement(cumulativeBeat, sequenceProgressionLength);
             }
         } else {
-            for (int i = 0; i < PATTERN_COUNT; ++i) {
+            const quint32 dueTicksVersion{d->dueTicksVersion.load()};
+            if (d->seenDueTicksVersion != dueTicksVersion || cumulativeBeat < d->lastAdvancedTick) {
+                std::fill(std::begin(d->nextDueTicks), std::end(d->nextDueTicks), 0);
+                d->seenDueTicksVersion = dueTicksVersion;
+            }
+            d->lastAdvancedTick = cumulativeBeat;
+            // Only visit the patterns which can actually produce events (solo channel filtering is included in that set),
+            // and of those, only the ones which have something due on this tick
+            quint64 activePatterns{d->activePatterns.load()};
+            while (activePatterns) {
+                const int i = qCountTrailingZeroBits(activePatterns);
+                activePatterns &= activePatterns - 1;
                 const PatternModel *pattern = d->patternModelIterator[i];
-                if (pattern && (d->zlSyncManager->soloChannel == -1 || d->zlSyncManager->soloChannel == pattern->channelIndex())) {
-                    pattern->handleSequenceAdvancement(cumulativeBeat, sequenceProgressionLength);
+                if (pattern && d->nextDueTicks[i] <= cumulativeBeat) {
+                    d->nextDueTicks[i] = pattern->handleSequenceAdvancement(cumulativeBeat, sequenceProgressionLength);
                 }
             }
         }
@@ -865,11 +1600,22 @@ void SequenceModel::updatePatternPositions()
             if (pattern) {
                 pattern->updateSequencePosition(sequencePosition);
             }
-        } else {
+        } else if (sequencePosition == 0) {
+            // At the start of playback, every pattern wants its position resetting
             for (int i = 0; i < PATTERN_COUNT; ++i) {
-                const PatternModel *pattern = d->patternModelIterator[i];
+                PatternModel *pattern = d->patternModelIterator[i];
+                if (pattern) {
+                    pattern->updateSequencePosition(sequencePosition);
+                }
+            }
+        } else {
+            quint64 playingPatterns{d->playingPatterns.load()};
+            while (playingPatterns) {
+                const int i = qCountTrailingZeroBits(playingPatterns);
+                playingPatterns &= playingPatterns - 1;
+                PatternModel *pattern = d->patternModelIterator[i];
                 if (pattern) {
-                    d->patternModelIterator[i]->updateSequencePosition(sequencePosition);
+                    pattern->updateSequencePosition(sequencePosition);
                 }
             }
         }
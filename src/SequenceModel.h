@@ -100,6 +100,17 @@ class SequenceModel : public QAbstractListModel
      * @default True
      */
     Q_PROPERTY(bool shouldMakeSounds READ shouldMakeSounds WRITE setShouldMakeSounds NOTIFY shouldMakeSoundsChanged)
+    /**
+     * \brief Whether the sequence is saved into its sketch's bundle, rather than as a directory of files
+     *
+     * The bundle (see SketchBundle) is a single file in the sketch's sequences directory, which holds
+     * all the sketch's sequences and their patterns. When this changes, the next save moves the sequence
+     * over to the other layout, and removes what was left of it in the old one.
+     * @note Loading prefers a sequence's data in the bundle, if there is any, and sets this to true when it finds it
+     * @note Exporting a sequence always writes a directory of files
+     * @default false
+     */
+    Q_PROPERTY(bool useSketchBundle READ useSketchBundle WRITE setUseSketchBundle NOTIFY useSketchBundleChanged)
 
     /**
      * \brief Whether there are unsaved changes in the sequence
@@ -210,13 +221,31 @@ public:
     Q_INVOKABLE void setShouldMakeSounds(bool shouldMakeSounds);
     Q_SIGNAL void shouldMakeSoundsChanged();
 
+    bool useSketchBundle() const;
+    void setUseSketchBundle(bool useSketchBundle);
+    Q_SIGNAL void useSketchBundleChanged();
+
     /**
      * \brief Load the data for this Sequence (and all Patterns contained within it) from the location indicated by filePath if none is given
+     * This returns straight away, and the sequence is loaded in the background (see loadSequences())
      * @note Not setting filePath prior to loading will cause a default to be generated
      * @note Passing a filename to this function will reset the filePath property to that name
      * @param fileName An optional filename to be used to perform the operation in place of the automatically chosen one (pass the metadata.seq.json location)
      */
     Q_INVOKABLE void load(const QString &fileName = QString());
+    /**
+     * \brief Load the data for all the given sequences in one go
+     *
+     * This does the same as calling load() on each of the sequences, except that reading and parsing
+     * the files is done for all of them at the same time, spread across a pool of worker threads. This
+     * returns straight away, and once everything has been parsed, the results are applied to the
+     * sequences and their patterns on the ui thread. Progress is reported through PlayGridManager::taskMessage,
+     * and each sequence's isLoading is true until all of them are done. Until then, the sequences keep
+     * their old contents, which are not saved (see save()), and loading a sequence again replaces any
+     * load of it which is still under way.
+     * @param sequences The sequences to load (from their filePath, see load())
+     */
+    static void loadSequences(const QList<SequenceModel*> &sequences);
     /**
      * \brief Save the data for this Sequence (and all Patterns contained within it) to the location indicated by filePath if none is given
      * @note Not setting filePath prior to saving will cause a default to be generated
@@ -224,9 +253,24 @@ public:
      * @note Any file in the location WILL be overwritten if it already exists
      * @param fileName An optional filename to be used to perform the operation in place of the automatically chosen one (pass the metadata.seq.json location)
      * @param exportOnly If set to true, this will make this function only export the information, and not actually touch the internal state of the sequence
-     * @return True if successful, false if not
+     * @return True if successful, false if not (which includes the sequence being loaded, unless exporting)
      */
     Q_INVOKABLE bool save(const QString &fileName = QString(), bool exportOnly = false);
+    /**
+     * \brief Save the data for this Sequence (and all Patterns contained within it) to filePath, without blocking
+     *
+     * This takes a snapshot of the sequence and of the patterns which have changed since they were last
+     * saved (which is quick, as the snapshots share the patterns' contents rather than copying them),
+     * and then serializes and writes those on a worker thread. saveFinished is emitted once that is done.
+     * Saves are written one after the other, in the order they were started, and save() waits for any
+     * which are still under way before it starts writing.
+     */
+    Q_INVOKABLE void saveInBackground();
+    /**
+     * \brief Emitted whenever saving the sequence has finished (both for save() and saveInBackground())
+     * @param success Whether everything was written successfully
+     */
+    Q_SIGNAL void saveFinished(bool success);
 
     /**
      * \brief Clear all patterns of all notes
@@ -277,6 +321,7 @@ public:
     Q_INVOKABLE void prepareSequencePlayback();
     /**
      * \brief Prepares the sequence for playback, and starts the global timer
+     * The timer is started once the sequence's patterns are ready for playback (which may be after this returns)
      * @see prepareSequencePlayback()
      * @see resetSequence()
      */
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SketchBundle.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QPair>
+#include <QVector>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+#include <unistd.h>
+
+// The chunks are given this much room to grow, relative to their size (in quarters)...
+#define SKETCH_BUNDLE_CHUNK_HEADROOM_QUARTERS 1
+// ...and their space is rounded up to a multiple of this many bytes
+#define SKETCH_BUNDLE_CHUNK_ALIGNMENT 256
+// Every chunk (and the index) starts at an offset which is a multiple of this many bytes, so that the
+// records in them can be read in place (the file is mapped at a page boundary, so this carries over to memory)
+#define SKETCH_BUNDLE_OFFSET_ALIGNMENT 8
+// Once the space in the file which is not used by anything is more than the used space plus this many bytes, the bundle is rewritten
+#define SKETCH_BUNDLE_COMPACTION_SLACK (64 * 1024)
+
+static const char sketchBundleMagic[4]{'Z', 'B', 'S', 'B'};
+
+struct SketchBundleHeader {
+    char magic[4];
+    quint32_le version;
+    // The size of the header, so later versions can add to it without breaking older readers
+    quint32_le headerSize;
+    quint32_le entryCount;
+    quint64_le indexOffset;
+    quint64_le indexSize;
+};
+static_assert(sizeof(SketchBundleHeader) == 32, "The sketch bundle header must not contain any padding");
+
+// Each index entry is followed by the chunk's name, as nameSize bytes of utf8
+struct SketchBundleIndexEntry {
+    quint64_le offset;
+    quint32_le size;
+    quint32_le capacity;
+    quint32_le nameSize;
+    quint32_le reserved;
+};
+static_assert(sizeof(SketchBundleIndexEntry) == 24, "The sketch bundle index entry must not contain any padding");
+
+struct SketchBundleChunk {
+    qint64 offset{0};
+    qint64 size{0};
+    qint64 capacity{0};
+};
+
+static inline qint64 chunkCapacity(qint64 size)
+{
+    const qint64 capacity{size + ((size * SKETCH_BUNDLE_CHUNK_HEADROOM_QUARTERS) / 4)};
+    return qMax(qint64(SKETCH_BUNDLE_CHUNK_ALIGNMENT), (capacity + SKETCH_BUNDLE_CHUNK_ALIGNMENT - 1) & ~qint64(SKETCH_BUNDLE_CHUNK_ALIGNMENT - 1));
+}
+
+static inline qint64 alignedOffset(qint64 offset)
+{
+    return (offset + SKETCH_BUNDLE_OFFSET_ALIGNMENT - 1) & ~qint64(SKETCH_BUNDLE_OFFSET_ALIGNMENT - 1);
+}
+
+// Read and check the header at the start of the given data (which must be at least the size of the header)
+static bool readHeader(const char *data, qint64 fileSize, SketchBundleHeader &header)
+{
+    memcpy(&header, data, sizeof(SketchBundleHeader));
+    if (memcmp(header.magic, sketchBundleMagic, sizeof(header.magic)) != 0) {
+        qWarning() << Q_FUNC_INFO << "The file is not a sketch bundle";
+        return false;
+    }
+    if (header.version > SKETCH_BUNDLE_VERSION) {
+        qWarning() << Q_FUNC_INFO << "The sketch bundle is version" << quint32(header.version) << "which is newer than the newest version we know how to read," << SKETCH_BUNDLE_VERSION;
+        return false;
+    }
+    if (header.headerSize < quint32(sizeof(SketchBundleHeader)) || quint64(header.indexOffset) < quint64(header.headerSize) || quint64(header.indexOffset) + quint64(header.indexSize) > quint64(fileSize)) {
+        qWarning() << Q_FUNC_INFO << "The sketch bundle's header is not valid, or the file is truncated";
+        return false;
+    }
+    return true;
+}
+
+// Read the index (as located by the header), checking that every chunk is inside the file
+static bool readIndex(const char *index, qint64 indexSize, quint32 entryCount, qint64 fileSize, QHash<QString, SketchBundleChunk> &chunks)
+{
+    chunks.clear();
+    chunks.reserve(int(entryCount));
+    qint64 position{0};
+    for (quint32 entryIndex = 0; entryIndex < entryCount; ++entryIndex) {
+        if (position + qint64(sizeof(SketchBundleIndexEntry)) > indexSize) {
+            qWarning() << Q_FUNC_INFO << "The sketch bundle's index is truncated";
+            return false;
+        }
+        SketchBundleIndexEntry entry;
+        memcpy(&entry, index + position, sizeof(SketchBundleIndexEntry));
+        position += sizeof(SketchBundleIndexEntry);
+        const qint64 nameSize{entry.nameSize};
+        const qint64 offset{qint64(quint64(entry.offset))};
+        if (position + nameSize > indexSize || entry.size > entry.capacity || offset < qint64(sizeof(SketchBundleHeader)) || offset + qint64(entry.capacity) > fileSize) {
+            qWarning() << Q_FUNC_INFO << "The sketch bundle's index has an invalid entry at position" << entryIndex;
+            return false;
+        }
+        SketchBundleChunk chunk;
+        chunk.offset = offset;
+        chunk.size = entry.size;
+        chunk.capacity = entry.capacity;
+        chunks.insert(QString::fromUtf8(index + position, int(nameSize)), chunk);
+        position += nameSize;
+    }
+    return true;
+}
+
+static QByteArray serializeIndex(const QHash<QString, SketchBundleChunk> &chunks)
+{
+    QByteArray index;
+    for (QHash<QString, SketchBundleChunk>::const_iterator chunk = chunks.constBegin(); chunk != chunks.constEnd(); ++chunk) {
+        const QByteArray name{chunk.key().toUtf8()};
+        SketchBundleIndexEntry entry;
+        entry.offset = quint64(chunk.value().offset);
+        entry.size = quint32(chunk.value().size);
+        entry.capacity = quint32(chunk.value().capacity);
+        entry.nameSize = quint32(name.size());
+        entry.reserved = 0;
+        index.append(reinterpret_cast<const char*>(&entry), sizeof(SketchBundleIndexEntry));
+        index.append(name);
+    }
+    return index;
+}
+
+static inline SketchBundleHeader makeHeader(int entryCount, qint64 indexOffset, qint64 indexSize)
+{
+    SketchBundleHeader header;
+    memcpy(header.magic, sketchBundleMagic, sizeof(header.magic));
+    header.version = SKETCH_BUNDLE_VERSION;
+    header.headerSize = quint32(sizeof(SketchBundleHeader));
+    header.entryCount = quint32(entryCount);
+    header.indexOffset = quint64(indexOffset);
+    header.indexSize = quint64(indexSize);
+    return header;
+}
+
+// Make sure everything written to the file so far is on the storage, before anything which refers to it is written
+static inline bool syncFile(QFile &file)
+{
+    return file.flush() && ::fsync(file.handle()) == 0;
+}
+
+/**
+ * \brief Keeps track of which parts of a bundle file are in use, and hands out the space which is not
+ * Reserve everything which is in use, call findFreeSpace(), and then allocate() the space for new data.
+ */
+class SketchBundleSpace {
+public:
+    explicit SketchBundleSpace(qint64 fileSize)
+        : fileEnd(fileSize)
+    {}
+    void reserve(qint64 offset, qint64 size) {
+        if (size > 0) {
+            used << qMakePair(offset, offset + size);
+        }
+    }
+    // Works out the gaps between the reserved areas (including any unused space at the end of the file)
+    void findFreeSpace() {
+        std::sort(used.begin(), used.end());
+        qint64 position{0};
+        for (const QPair<qint64, qint64> &area : qAsConst(used)) {
+            if (area.first > position) {
+                gaps << qMakePair(position, area.first);
+            }
+            position = qMax(position, area.second);
+        }
+        if (fileEnd > position) {
+            gaps << qMakePair(position, fileEnd);
+        }
+    }
+    // The (aligned) offset of a newly allocated area of the given size, which is in one of the gaps if there is
+    // one big enough, and otherwise at the end of the file (which the gap at the end, if any, is extended into)
+    qint64 allocate(qint64 size) {
+        for (QPair<qint64, qint64> &gap : gaps) {
+            const qint64 offset{alignedOffset(gap.first)};
+            if (gap.second - offset >= size) {
+                gap.first = offset + size;
+                return offset;
+            }
+        }
+        qint64 offset{fileEnd};
+        if (!gaps.isEmpty() && gaps.last().second == fileEnd) {
+            offset = gaps.takeLast().first;
+        }
+        offset = alignedOffset(offset);
+        fileEnd = offset + size;
+        return offset;
+    }
+    // The size of the file, once everything allocated has been written
+    qint64 end() const {
+        return fileEnd;
+    }
+private:
+    qint64 fileEnd{0};
+    QVector<QPair<qint64, qint64>> used;
+    QVector<QPair<qint64, qint64>> gaps;
+};
+
+class SketchBundle::Private {
+public:
+    Private() {}
+    QString fileName;
+    QFile file;
+    uchar *mapped{nullptr};
+    // Used when the file cannot be mapped
+    QByteArray fileData;
+    const char *data{nullptr};
+    qint64 dataSize{0};
+    QHash<QString, SketchBundleChunk> chunks;
+
+    /**
+     * \brief Write all the given chunks to a fresh bundle, replacing the file in one go
+     */
+    bool rewrite(const QHash<QString, QByteArray> &entries) {
+        QHash<QString, SketchBundleChunk> newChunks;
+        QByteArray contents;
+        contents.append(QByteArray(sizeof(SketchBundleHeader), '\0'));
+        for (QHash<QString, QByteArray>::const_iterator entry = entries.constBegin(); entry != entries.constEnd(); ++entry) {
+            contents.append(QByteArray(int(alignedOffset(contents.size()) - contents.size()), '\0'));
+            SketchBundleChunk chunk;
+            chunk.offset = contents.size();
+            chunk.size = entry.value().size();
+            chunk.capacity = chunkCapacity(chunk.size);
+            contents.append(entry.value());
+            contents.append(QByteArray(int(chunk.capacity - chunk.size), '\0'));
+            newChunks.insert(entry.key(), chunk);
+        }
+        const QByteArray index{serializeIndex(newChunks)};
+        contents.append(QByteArray(int(alignedOffset(contents.size()) - contents.size()), '\0'));
+        const SketchBundleHeader header{makeHeader(newChunks.count(), contents.size(), index.size())};
+        contents.append(index);
+        memcpy(contents.data(), &header, sizeof(SketchBundleHeader));
+        QSaveFile saveFile(fileName);
+        if (saveFile.open(QIODevice::WriteOnly) && saveFile.write(contents) == contents.size() && saveFile.commit()) {
+            return true;
+        }
+        qWarning() << Q_FUNC_INFO << "Failed to write the sketch bundle" << fileName << ":" << saveFile.errorString();
+        return false;
+    }
+};
+
+SketchBundle::SketchBundle(const QString &fileName)
+    : d(new Private)
+{
+    d->fileName = fileName;
+}
+
+SketchBundle::~SketchBundle()
+{
+    close();
+    delete d;
+}
+
+QString SketchBundle::fileName() const
+{
+    return d->fileName;
+}
+
+bool SketchBundle::open(ReadMode mode)
+{
+    close();
+    d->file.setFileName(d->fileName);
+    if (!d->file.exists() || !d->file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const qint64 size{d->file.size()};
+    if (size >= qint64(sizeof(SketchBundleHeader))) {
+        if (mode == MappedRead) {
+            d->mapped = d->file.map(0, size);
+        }
+        if (d->mapped) {
+            d->data = reinterpret_cast<const char*>(d->mapped);
+            d->dataSize = size;
+        } else {
+            // Either we were asked to, or the file could not be mapped (not everything can be), so just read the whole thing
+            d->fileData = d->file.readAll();
+            d->data = d->fileData.constData();
+            d->dataSize = d->fileData.size();
+        }
+        SketchBundleHeader header;
+        // A short read leaves too little for the header, so check that before reading it
+        if (d->dataSize >= qint64(sizeof(SketchBundleHeader)) && readHeader(d->data, d->dataSize, header) && readIndex(d->data + quint64(header.indexOffset), qint64(quint64(header.indexSize)), header.entryCount, d->dataSize, d->chunks)) {
+            return true;
+        }
+    } else {
+        qWarning() << Q_FUNC_INFO << d->fileName << "is too short to be a sketch bundle";
+    }
+    close();
+    return false;
+}
+
+void SketchBundle::close()
+{
+    if (d->mapped) {
+        d->file.unmap(d->mapped);
+        d->mapped = nullptr;
+    }
+    if (d->file.isOpen()) {
+        d->file.close();
+    }
+    d->fileData.clear();
+    d->data = nullptr;
+    d->dataSize = 0;
+    d->chunks.clear();
+}
+
+bool SketchBundle::isOpen() const
+{
+    return d->data != nullptr;
+}
+
+QStringList SketchBundle::entryNames() const
+{
+    return d->chunks.keys();
+}
+
+bool SketchBundle::contains(const QString &name) const
+{
+    return d->chunks.contains(name);
+}
+
+QByteArray SketchBundle::entry(const QString &name) const
+{
+    QByteArray data;
+    const QHash<QString, SketchBundleChunk>::const_iterator chunk = d->chunks.constFind(name);
+    if (d->data && chunk != d->chunks.constEnd()) {
+        if (chunk.value().offset % SKETCH_BUNDLE_OFFSET_ALIGNMENT == 0) {
+            data = QByteArray::fromRawData(d->data + chunk.value().offset, int(chunk.value().size));
+        } else {
+            // Bundles written before chunks were aligned can have them anywhere, so hand those out as an (aligned) copy
+            data = QByteArray(d->data + chunk.value().offset, int(chunk.value().size));
+        }
+    }
+    return data;
+}
+
+bool SketchBundle::update(const QHash<QString, QByteArray> &changedEntries, const QStringList &removedEntries)
+{
+    if (isOpen()) {
+        qWarning() << Q_FUNC_INFO << "Attempted to update the sketch bundle" << d->fileName << "while it is open for reading";
+        return false;
+    }
+    QFile file(d->fileName);
+    if (!file.open(QIODevice::ReadWrite)) {
+        qWarning() << Q_FUNC_INFO << "Failed to open the sketch bundle" << d->fileName << "for writing:" << file.errorString();
+        return false;
+    }
+    const qint64 fileSize{file.size()};
+    QHash<QString, SketchBundleChunk> chunks;
+    SketchBundleHeader header;
+    bool isValidBundle{false};
+    if (fileSize >= qint64(sizeof(SketchBundleHeader))) {
+        const QByteArray headerData{file.read(sizeof(SketchBundleHeader))};
+        if (headerData.size() == int(sizeof(SketchBundleHeader)) && readHeader(headerData.constData(), fileSize, header) && file.seek(qint64(quint64(header.indexOffset)))) {
+            const QByteArray index{file.read(qint64(quint64(header.indexSize)))};
+            isValidBundle = readIndex(index.constData(), index.size(), header.entryCount, fileSize, chunks);
+        }
+    }
+    if (!isValidBundle) {
+        file.close();
+        if (fileSize > 0) {
+            // Whatever is in the file (a damaged bundle, one written by a newer version, or something else
+            // entirely) may still be of use to somebody, and the chunks we were given are not all of it
+            qWarning() << Q_FUNC_INFO << d->fileName << "is not a sketch bundle which can be updated, and has been left as it is";
+            return false;
+        }
+        // There is no bundle yet, so start one with just the new chunks
+        QHash<QString, QByteArray> entries{changedEntries};
+        for (const QString &name : removedEntries) {
+            entries.remove(name);
+        }
+        return d->rewrite(entries);
+    }
+
+    // Nothing the current index refers to (including the index itself) is touched until the header has been
+    // switched over to the new index, so whatever happens part way through, the bundle stays as it was. New
+    // data goes in space nothing refers to any more (such as where an older version of a chunk used to be),
+    // or if nothing is big enough, after everything else in the file.
+    SketchBundleSpace space(fileSize);
+    space.reserve(0, header.headerSize);
+    space.reserve(qint64(quint64(header.indexOffset)), qint64(quint64(header.indexSize)));
+    for (const SketchBundleChunk &chunk : qAsConst(chunks)) {
+        space.reserve(chunk.offset, chunk.capacity);
+    }
+    space.findFreeSpace();
+
+    for (const QString &name : removedEntries) {
+        chunks.remove(name);
+    }
+    bool success{true};
+    for (QHash<QString, QByteArray>::const_iterator entry = changedEntries.constBegin(); success && entry != changedEntries.constEnd(); ++entry) {
+        const QByteArray &data = entry.value();
+        SketchBundleChunk newChunk;
+        newChunk.size = data.size();
+        newChunk.capacity = chunkCapacity(newChunk.size);
+        newChunk.offset = space.allocate(newChunk.capacity);
+        success = file.seek(newChunk.offset) && file.write(data) == data.size() && file.write(QByteArray(int(newChunk.capacity - newChunk.size), '\0')) == newChunk.capacity - newChunk.size;
+        chunks.insert(entry.key(), newChunk);
+    }
+    const QByteArray index{serializeIndex(chunks)};
+    const qint64 indexOffset{space.allocate(index.size())};
+    if (success) {
+        success = file.seek(indexOffset) && file.write(index) == index.size() && syncFile(file);
+    }
+    if (success) {
+        const SketchBundleHeader newHeader{makeHeader(chunks.count(), indexOffset, index.size())};
+        success = file.seek(0) && file.write(reinterpret_cast<const char*>(&newHeader), sizeof(SketchBundleHeader)) == qint64(sizeof(SketchBundleHeader)) && syncFile(file);
+    }
+    if (!success) {
+        qWarning() << Q_FUNC_INFO << "Failed to update the sketch bundle" << d->fileName << ":" << file.errorString();
+        file.close();
+        return false;
+    }
+
+    // If the file is by now mostly space which is no longer used, write it out afresh
+    qint64 usedSize{qint64(sizeof(SketchBundleHeader)) + index.size()};
+    for (const SketchBundleChunk &chunk : qAsConst(chunks)) {
+        usedSize += chunk.capacity;
+    }
+    const qint64 totalSize{space.end()};
+    if (totalSize - usedSize > usedSize + SKETCH_BUNDLE_COMPACTION_SLACK) {
+        QHash<QString, QByteArray> entries;
+        entries.reserve(chunks.count());
+        for (QHash<QString, SketchBundleChunk>::const_iterator chunk = chunks.constBegin(); success && chunk != chunks.constEnd(); ++chunk) {
+            QByteArray data;
+            success = file.seek(chunk.value().offset);
+            if (success) {
+                data = file.read(chunk.value().size);
+                success = (data.size() == chunk.value().size);
+            }
+            entries.insert(chunk.key(), data);
+        }
+        file.close();
+        if (!success) {
+            qWarning() << Q_FUNC_INFO << "Failed to read the sketch bundle" << d->fileName << "back for compacting it";
+            return false;
+        }
+        return d->rewrite(entries);
+    }
+    file.close();
+    return true;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SKETCHBUNDLE_H
+#define SKETCHBUNDLE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+// The version of the bundle format written by SketchBundle (bundles with a newer version are refused)
+#define SKETCH_BUNDLE_VERSION 1
+// The name of the bundle file, which lives in a sketch's sequences directory
+#define SKETCH_BUNDLE_FILE_NAME "sequences.bundle"
+
+/**
+ * \brief A single file holding named chunks of data, used to store all of a sketch's sequences and patterns
+ *
+ * Instead of a directory for each sequence, each with a metadata file and a file for every pattern, a
+ * bundle holds the same files as chunks named by their path relative to the sketch's sequences directory
+ * (such as "t1/patterns/pattern-t1-ch1-parta.pattern.bin"). Loading a sketch from slow storage then
+ * needs a single file opened, rather than hundreds of them listed, matched and opened. A bundle consists of:
+ *
+ * - A header, with the location of the index
+ * - The chunks, each of which has some room to grow, so the space left behind by one version of a pattern
+ *   will usually fit the next
+ * - The index, with the name, location, size and capacity of each chunk
+ *
+ * Opening a bundle only reads the header and the index, and a chunk's data is only read when it is
+ * asked for (the file is memory mapped while open, where possible, unless it is opened with InMemoryRead). When updating a bundle, nothing the
+ * current index refers to is overwritten: changed chunks, and then a new index, are written into space
+ * which is no longer referred to, or added to the end of the file. Only once those are safely on the
+ * storage is the header pointed at the new index, so an update which is interrupted leaves the bundle as
+ * it was. Once too much of the file is space which is no longer used, the whole bundle is rewritten.
+ * All values are little endian.
+ */
+class SketchBundle {
+public:
+    enum ReadMode {
+        // The file is memory mapped where possible, so only the parts which are used are read
+        MappedRead,
+        // The whole file is read into memory, so what is read stays as it was, even if the file is updated while the bundle is open
+        InMemoryRead,
+    };
+    explicit SketchBundle(const QString &fileName);
+    ~SketchBundle();
+
+    QString fileName() const;
+    /**
+     * \brief Open the bundle for reading, which reads the header and the index
+     * @param mode How the file's contents are read (see ReadMode)
+     * @return True if the bundle exists and is valid
+     */
+    bool open(ReadMode mode = MappedRead);
+    /**
+     * \brief Close the bundle, after which any data fetched using entry() is no longer valid
+     */
+    void close();
+    bool isOpen() const;
+
+    /**
+     * \brief The names of all the chunks in the bundle
+     */
+    QStringList entryNames() const;
+    bool contains(const QString &name) const;
+    /**
+     * \brief The data of the named chunk
+     * @note The data is not copied out of the file, and is only valid for as long as the bundle is open. It
+     * starts at an address which is aligned to at least 8 bytes.
+     * @param name The name of the chunk to fetch
+     * @return The chunk's data, or a null QByteArray if the bundle has no chunk by that name
+     */
+    QByteArray entry(const QString &name) const;
+
+    /**
+     * \brief Change the bundle's chunks, creating the bundle file if it does not exist yet (or is empty)
+     * A file which is not a bundle this version can read (including one written by a newer version) is
+     * never changed, and the update fails instead.
+     * @note The bundle must not be open while it is updated, as the file changes underneath it
+     * @param changedEntries The chunks to write, by name (replacing any existing chunks with the same names)
+     * @param removedEntries The names of the chunks to remove
+     * @return True if the bundle was successfully updated (and, if it was due for it, compacted)
+     */
+    bool update(const QHash<QString, QByteArray> &changedEntries, const QStringList &removedEntries);
+private:
+    Q_DISABLE_COPY(SketchBundle)
+    class Private;
+    Private *d;
+};
+
+#endif//SKETCHBUNDLE_H
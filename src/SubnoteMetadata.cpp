@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SubnoteMetadata.h"
+
+#include <cmath>
+#include <limits>
+
+static const QLatin1String velocityKey{"velocity"};
+static const QLatin1String delayKey{"delay"};
+static const QLatin1String durationKey{"duration"};
+
+static SubnoteMetadata::Field fieldForKey(const QString &key)
+{
+    if (key == velocityKey) {
+        return SubnoteMetadata::VelocityField;
+    } else if (key == delayKey) {
+        return SubnoteMetadata::DelayField;
+    } else if (key == durationKey) {
+        return SubnoteMetadata::DurationField;
+    }
+    return SubnoteMetadata::NoFields;
+}
+
+// Fetch the value as an integer, if it is one (rather than something which merely converts to one,
+// such as a string or a fractional number). Json numbers are all doubles, so whole doubles count.
+static bool integerValue(const QVariant &value, qint64 &integer)
+{
+    switch (value.userType()) {
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::ULong:
+        case QMetaType::LongLong:
+        case QMetaType::Short:
+        case QMetaType::UShort:
+        case QMetaType::SChar:
+        case QMetaType::UChar:
+            integer = value.toLongLong();
+            return true;
+        case QMetaType::ULongLong:
+            if (value.toULongLong() <= quint64(std::numeric_limits<qint64>::max())) {
+                integer = value.toLongLong();
+                return true;
+            }
+            break;
+        case QMetaType::Double:
+        case QMetaType::Float:
+        {
+            const double number{value.toDouble()};
+            if (std::isfinite(number) && std::floor(number) == number && std::fabs(number) < 9007199254740992.0) {
+                integer = qint64(number);
+                return true;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return false;
+}
+
+SubnoteMetadata::SubnoteMetadata(int count)
+    : d(new SubnoteMetadataData)
+{
+    d->fields.fill(NoFields, count);
+    d->velocities.fill(0, count);
+    d->delays.fill(0, count);
+    d->durations.fill(0, count);
+}
+
+SubnoteMetadata SubnoteMetadata::fromVariant(const QVariant &metadata)
+{
+    SubnoteMetadata result;
+    if (metadata.type() == QVariant::List) {
+        const QVariantList list{metadata.toList()};
+        for (const QVariant &subnoteMetadata : list) {
+            if (subnoteMetadata.type() != QVariant::Hash && subnoteMetadata.type() != QVariant::Map) {
+                return result;
+            }
+        }
+        result = SubnoteMetadata(list.count());
+        for (int subnote = 0; subnote < list.count(); ++subnote) {
+            result.setHash(subnote, list.at(subnote).toHash());
+        }
+    }
+    return result;
+}
+
+QVariantList SubnoteMetadata::toVariantList() const
+{
+    QVariantList list;
+    list.reserve(count());
+    for (int subnote = 0; subnote < count(); ++subnote) {
+        list << hash(subnote);
+    }
+    return list;
+}
+
+QVariant SubnoteMetadata::value(int subnote, const QString &key) const
+{
+    QVariant result;
+    if (subnote > -1 && subnote < count()) {
+        const Field field{fieldForKey(key)};
+        if (field == NoFields || !(d->fields.at(subnote) & field)) {
+            // Typed keys whose value could not be stored typed are kept in the other data as well
+            result = d->otherData.value(subnote).value(key);
+        } else {
+            switch (field) {
+                case VelocityField:
+                    result = int(d->velocities.at(subnote));
+                    break;
+                case DelayField:
+                    result = int(d->delays.at(subnote));
+                    break;
+                case DurationField:
+                    result = int(d->durations.at(subnote));
+                    break;
+                case NoFields:
+                    break;
+            }
+        }
+    }
+    return result;
+}
+
+int SubnoteMetadata::otherDataInteger(int subnote, Field field, int defaultValue) const
+{
+    const QHash<int, QVariantHash>::const_iterator otherData{d->otherData.constFind(subnote)};
+    if (otherData != d->otherData.constEnd()) {
+        const QLatin1String key{field == VelocityField ? velocityKey : (field == DelayField ? delayKey : durationKey)};
+        const QVariantHash::const_iterator value{otherData->constFind(key)};
+        if (value != otherData->constEnd()) {
+            return value->toInt();
+        }
+    }
+    return defaultValue;
+}
+
+QVariantHash SubnoteMetadata::hash(int subnote) const
+{
+    QVariantHash result;
+    if (subnote > -1 && subnote < count()) {
+        result = d->otherData.value(subnote);
+        const quint8 fields{d->fields.at(subnote)};
+        if (fields & VelocityField) {
+            result[velocityKey] = int(d->velocities.at(subnote));
+        }
+        if (fields & DelayField) {
+            result[delayKey] = int(d->delays.at(subnote));
+        }
+        if (fields & DurationField) {
+            result[durationKey] = int(d->durations.at(subnote));
+        }
+    }
+    return result;
+}
+
+bool SubnoteMetadata::setValue(int subnote, const QString &key, const QVariant &value)
+{
+    bool storedTyped{false};
+    if (subnote > -1 && subnote < count()) {
+        const Field field{fieldForKey(key)};
+        qint64 integer{0};
+        bool fits{integerValue(value, integer)};
+        if (fits) {
+            switch (field) {
+                case VelocityField:
+                    fits = (integer >= 0 && integer <= 127);
+                    break;
+                case DelayField:
+                case DurationField:
+                    fits = (integer >= std::numeric_limits<qint16>::min() && integer <= std::numeric_limits<qint16>::max());
+                    break;
+                case NoFields:
+                    fits = false;
+                    break;
+            }
+        }
+        if (!fits) {
+            // Anything we can't store typed goes in the other data, replacing any typed value for the key
+            d->fields[subnote] &= ~field;
+            switch (field) {
+                case VelocityField:
+                    d->velocities[subnote] = 0;
+                    break;
+                case DelayField:
+                    d->delays[subnote] = 0;
+                    break;
+                case DurationField:
+                    d->durations[subnote] = 0;
+                    break;
+                case NoFields:
+                    break;
+            }
+            if (value.isValid()) {
+                d->otherData[subnote][key] = value;
+            } else if (d->otherData.contains(subnote)) {
+                QVariantHash &otherData = d->otherData[subnote];
+                otherData.remove(key);
+                if (otherData.isEmpty()) {
+                    d->otherData.remove(subnote);
+                }
+            }
+        } else {
+            storedTyped = true;
+            d->fields[subnote] |= field;
+            switch (field) {
+                case VelocityField:
+                    d->velocities[subnote] = qint8(integer);
+                    break;
+                case DelayField:
+                    d->delays[subnote] = qint16(integer);
+                    break;
+                case DurationField:
+                    d->durations[subnote] = qint16(integer);
+                    break;
+                case NoFields:
+                    break;
+            }
+            if (d->otherData.contains(subnote)) {
+                QVariantHash &otherData = d->otherData[subnote];
+                otherData.remove(key);
+                if (otherData.isEmpty()) {
+                    d->otherData.remove(subnote);
+                }
+            }
+        }
+    }
+    return storedTyped;
+}
+
+bool SubnoteMetadata::setFields(int subnote, int fields, int velocity, int delay, int duration)
+{
+    bool unclamped{false};
+    if (subnote > -1 && subnote < count()) {
+        const int shortMin{std::numeric_limits<qint16>::min()};
+        const int shortMax{std::numeric_limits<qint16>::max()};
+        fields &= (VelocityField | DelayField | DurationField);
+        const int boundedVelocity{qBound(0, velocity, 127)};
+        const int boundedDelay{qBound(shortMin, delay, shortMax)};
+        const int boundedDuration{qBound(shortMin, duration, shortMax)};
+        d->fields[subnote] = quint8(fields);
+        d->velocities[subnote] = (fields & VelocityField) ? qint8(boundedVelocity) : 0;
+        d->delays[subnote] = (fields & DelayField) ? qint16(boundedDelay) : 0;
+        d->durations[subnote] = (fields & DurationField) ? qint16(boundedDuration) : 0;
+        unclamped = (!(fields & VelocityField) || boundedVelocity == velocity)
+            && (!(fields & DelayField) || boundedDelay == delay)
+            && (!(fields & DurationField) || boundedDuration == duration);
+    }
+    return unclamped;
+}
+
+void SubnoteMetadata::setHash(int subnote, const QVariantHash &hash)
+{
+    if (subnote > -1 && subnote < count()) {
+        d->fields[subnote] = NoFields;
+        d->velocities[subnote] = 0;
+        d->delays[subnote] = 0;
+        d->durations[subnote] = 0;
+        d->otherData.remove(subnote);
+        for (QVariantHash::const_iterator iterator = hash.constBegin(); iterator != hash.constEnd(); ++iterator) {
+            setValue(subnote, iterator.key(), iterator.value());
+        }
+    }
+}
+
+void SubnoteMetadata::insert(int subnote)
+{
+    if (!d) {
+        d = new SubnoteMetadataData;
+    }
+    if (subnote > -1 && subnote <= count()) {
+        d->fields.insert(subnote, NoFields);
+        d->velocities.insert(subnote, 0);
+        d->delays.insert(subnote, 0);
+        d->durations.insert(subnote, 0);
+        if (!d->otherData.isEmpty()) {
+            QHash<int, QVariantHash> otherData;
+            for (QHash<int, QVariantHash>::const_iterator iterator = d->otherData.constBegin(); iterator != d->otherData.constEnd(); ++iterator) {
+                otherData.insert(iterator.key() < subnote ? iterator.key() : iterator.key() + 1, iterator.value());
+            }
+            d->otherData.swap(otherData);
+        }
+    }
+}
+
+void SubnoteMetadata::removeAt(int subnote)
+{
+    if (subnote > -1 && subnote < count()) {
+        d->fields.removeAt(subnote);
+        d->velocities.removeAt(subnote);
+        d->delays.removeAt(subnote);
+        d->durations.removeAt(subnote);
+        if (!d->otherData.isEmpty()) {
+            QHash<int, QVariantHash> otherData;
+            for (QHash<int, QVariantHash>::const_iterator iterator = d->otherData.constBegin(); iterator != d->otherData.constEnd(); ++iterator) {
+                if (iterator.key() != subnote) {
+                    otherData.insert(iterator.key() < subnote ? iterator.key() : iterator.key() - 1, iterator.value());
+                }
+            }
+            d->otherData.swap(otherData);
+        }
+    }
+}
+
+bool SubnoteMetadata::operator==(const SubnoteMetadata &other) const
+{
+    if (d == other.d) {
+        return true;
+    } else if (!d || !other.d) {
+        return false;
+    }
+    return d->fields == other.d->fields
+        && d->velocities == other.d->velocities
+        && d->delays == other.d->delays
+        && d->durations == other.d->durations
+        && d->otherData == other.d->otherData;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2023 Dan Leinir Turthra Jensen <admin@leinir.dk>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SUBNOTEMETADATA_H
+#define SUBNOTEMETADATA_H
+
+#include <QHash>
+#include <QSharedData>
+#include <QVariant>
+#include <QVector>
+
+// The velocity used for subnotes which have not been given one
+#define SUBNOTE_DEFAULT_VELOCITY 64
+
+class SubnoteMetadataData : public QSharedData {
+public:
+    // Which of the typed fields have been set for each subnote (see SubnoteMetadata::Field)
+    QVector<quint8> fields;
+    // The typed fields, which hold zero when not set
+    QVector<qint8> velocities;
+    QVector<qint16> delays;
+    QVector<qint16> durations;
+    // Any metadata which is not one of the typed fields, by subnote index
+    QHash<int, QVariantHash> otherData;
+};
+
+/**
+ * \brief The metadata for the subnotes of a compound note, as stored on a position in a pattern
+ *
+ * To QML (and in saved patterns), the metadata for a position is a list containing a hash for each of
+ * the subnotes of the position's compound note, with optional "velocity", "delay" and "duration" keys,
+ * as well as anything else anybody might have wanted to store there. This stores those three as arrays
+ * of small integers instead, and only uses a hash for any other keys. Use toVariantList() (or
+ * NotesModel::getMetadata()) to get the list form, and fromVariant() to create one from the list form.
+ *
+ * This is implicitly shared, so copying it is cheap, and copies only detach when they are changed.
+ * A default constructed instance is null, which means there is no subnote metadata (as opposed to
+ * metadata for zero subnotes).
+ */
+class SubnoteMetadata {
+public:
+    enum Field {
+        NoFields = 0x0,
+        VelocityField = 0x1,
+        DelayField = 0x2,
+        DurationField = 0x4,
+    };
+    /**
+     * \brief Create a null instance
+     */
+    SubnoteMetadata() = default;
+    /**
+     * \brief Create an instance with the given number of subnotes, none of which have any metadata
+     */
+    explicit SubnoteMetadata(int count);
+
+    /**
+     * \brief Create an instance from the list form of the metadata
+     * @param metadata A list of hashes (or maps), one for each subnote
+     * @return The typed metadata, or a null instance if the metadata was not in the list form
+     */
+    static SubnoteMetadata fromVariant(const QVariant &metadata);
+    /**
+     * \brief The list form of the metadata, with a QVariantHash for each subnote
+     */
+    QVariantList toVariantList() const;
+
+    inline bool isNull() const {
+        return !d;
+    }
+    inline int count() const {
+        return d ? d->fields.count() : 0;
+    }
+    /**
+     * \brief Whether the given subnote has any metadata set at all
+     */
+    inline bool hasMetadata(int subnote) const {
+        return subnote > -1 && subnote < count() && (d->fields.at(subnote) != NoFields || d->otherData.contains(subnote));
+    }
+    /**
+     * \brief The given subnote's velocity, or SUBNOTE_DEFAULT_VELOCITY if it has not been set
+     * A velocity which could not be stored typed (see setValue()) is converted the way QVariant::toInt() does
+     */
+    inline int velocity(int subnote) const {
+        if (subnote > -1 && subnote < count()) {
+            if (d->fields.at(subnote) & VelocityField) {
+                return d->velocities.at(subnote);
+            } else if (!d->otherData.isEmpty()) {
+                return otherDataInteger(subnote, VelocityField, SUBNOTE_DEFAULT_VELOCITY);
+            }
+        }
+        return SUBNOTE_DEFAULT_VELOCITY;
+    }
+    /**
+     * \brief The given subnote's delay (in the pattern's 32ppqn), or 0 if it has not been set
+     * A delay which could not be stored typed (see setValue()) is converted the way QVariant::toInt() does
+     */
+    inline int delay(int subnote) const {
+        if (subnote > -1 && subnote < count()) {
+            if (d->fields.at(subnote) & DelayField) {
+                return d->delays.at(subnote);
+            } else if (!d->otherData.isEmpty()) {
+                return otherDataInteger(subnote, DelayField, 0);
+            }
+        }
+        return 0;
+    }
+    /**
+     * \brief The given subnote's duration (in the pattern's 32ppqn), or 0 if it has not been set
+     * A duration which could not be stored typed (see setValue()) is converted the way QVariant::toInt() does
+     */
+    inline int duration(int subnote) const {
+        if (subnote > -1 && subnote < count()) {
+            if (d->fields.at(subnote) & DurationField) {
+                return d->durations.at(subnote);
+            } else if (!d->otherData.isEmpty()) {
+                return otherDataInteger(subnote, DurationField, 0);
+            }
+        }
+        return 0;
+    }
+    /**
+     * \brief Which of the typed fields have been set for the given subnote (a combination of Field values)
+     */
+    inline int fields(int subnote) const {
+        return (subnote > -1 && subnote < count()) ? d->fields.at(subnote) : int(NoFields);
+    }
+    /**
+     * \brief Whether any subnote has metadata other than the typed fields
+     */
+    inline bool hasOtherData() const {
+        return d && !d->otherData.isEmpty();
+    }
+    /**
+     * \brief Set all the typed fields of a subnote in one go
+     * Any typed field not included in fields is unset, and the values are clamped to what the fields can
+     * hold (velocity to the midi range, and delay and duration to what fits in 16 bits)
+     * @param subnote The index of the subnote to set the fields on
+     * @param fields The fields to set (a combination of Field values)
+     * @param velocity The velocity (only used if fields includes VelocityField)
+     * @param delay The delay (only used if fields includes DelayField)
+     * @param duration The duration (only used if fields includes DurationField)
+     * @return True if the fields were set, and none of the values had to be clamped
+     */
+    bool setFields(int subnote, int fields, int velocity, int delay, int duration);
+
+    /**
+     * \brief Get a single piece of metadata for a subnote
+     * @return The value, or an invalid variant if the subnote does not exist or the key is not set
+     */
+    QVariant value(int subnote, const QString &key) const;
+    /**
+     * \brief All the metadata for a subnote, in the form used in the list form
+     */
+    QVariantHash hash(int subnote) const;
+    /**
+     * \brief Set a single piece of metadata for a subnote
+     * Velocity, delay and duration are only stored in their typed fields if the value is an integer
+     * which fits (the midi range for velocity, and 16 bits for delay and duration). Anything else,
+     * such as strings, fractional numbers or values out of range, is kept exactly as it was given,
+     * alongside any other metadata (and so does not count as the typed field being set).
+     * velocity(), delay() and duration() still read such values, converting them to integers.
+     * @param subnote The index of the subnote to set the metadata on
+     * @param key The name of the piece of metadata
+     * @param value The new value (pass an invalid variant to unset the key)
+     * @return True if the value was stored in one of the typed fields
+     */
+    bool setValue(int subnote, const QString &key, const QVariant &value);
+    /**
+     * \brief Replace all the metadata for a subnote with what is in the hash
+     */
+    void setHash(int subnote, const QVariantHash &hash);
+
+    /**
+     * \brief Insert a subnote without any metadata at the given position
+     */
+    void insert(int subnote);
+    /**
+     * \brief Add a subnote without any metadata at the end
+     */
+    inline void append() {
+        insert(count());
+    }
+    /**
+     * \brief Remove the given subnote's metadata, moving any following subnotes up by one
+     */
+    void removeAt(int subnote);
+
+    bool operator==(const SubnoteMetadata &other) const;
+    inline bool operator!=(const SubnoteMetadata &other) const {
+        return !(*this == other);
+    }
+private:
+    // The integer form of a typed field's value which is kept in the other data, or defaultValue if there is none
+    int otherDataInteger(int subnote, Field field, int defaultValue) const;
+    QSharedDataPointer<SubnoteMetadataData> d;
+};
+Q_DECLARE_TYPEINFO(SubnoteMetadata, Q_MOVABLE_TYPE);
+
+#endif//SUBNOTEMETADATA_H